@@ -1,4 +1,4 @@
 test [ ! -d ./bin] && mkdir ./bin
 pushd bin
-gcc ../src/main.c -O2 -Wall -Wno-format -Wno-dangling-else -o ala.exe
+gcc ../src/main.c -O2 -Wall -Wno-format -Wno-dangling-else -pthread -o ala.exe
 popd
\ No newline at end of file
@@ -8,6 +8,22 @@ typedef enum {
     PRINT_NUMBERS = 2,
     ALA_EXTRA = 4,
     ALA_DEBUG = 8,
+    ALA_COMPILE = 16,
+    ALA_STRIP = 32,
+    ALA_WATCH = 64,
+    ALA_OBJECT = 128,
+    ALA_RECORD = 256,
+    ALA_REPLAY = 512,
+    ALA_OPTIMIZE = 1024,
+    ALA_MEMO_STATS = 2048,
+    ALA_INLINE = 4096,
+    ALA_BENCH = 8192,
+    ALA_STATS = 16384,
+    ALA_COVERAGE = 32768,
+    ALA_PROFILE = 65536,
+    ALA_LAYOUT = 131072,
+    ALA_DETERMINISTIC = 262144,
+    ALA_CYCLES = 524288,
 } ala_flags;
 
 typedef int8_t s8;
@@ -41,6 +57,26 @@ void InitializeArena(memory_arena *Arena, size_t Size, void *Base)
     Arena->Next = 0;
 }
 
+// NOTE(vic): Arena that lives in its own block, for work that can't share the main one (threads)
+memory_arena *CreateArena(size_t Size)
+{
+    u8 *Memory = (u8 *)malloc(Size);
+    memset(Memory, 0, Size);
+    memory_arena *Arena = (memory_arena *)Memory;
+    InitializeArena(Arena, Size, Memory + sizeof(memory_arena));
+    return Arena;
+}
+
+// NOTE(vic): Frees every block of an arena made with CreateArena
+void FreeArena(memory_arena *Arena)
+{
+    while(Arena) {
+        memory_arena *Next = Arena->Next;
+        free(Arena);
+        Arena = Next;
+    }
+}
+
 #define PushStruct(Arena, type) (type *)PushSize_(Arena, sizeof(type))
 #define PushArray(Arena, Count, type) (type *)PushSize_(Arena, (Count)*sizeof(type))
 #define PushSize(Arena, Size) PushSize_(Arena, Size_)
@@ -49,10 +85,15 @@ void *PushSize_(memory_arena **Arena, size_t SizeInit)
     size_t Size = SizeInit;
     
     if(((*Arena)->Used + Size) > (*Arena)->Size) {
-        void *Memory = malloc(ARENA_MEMORY_SIZE);
-        memset(Memory, 0, ARENA_MEMORY_SIZE);
-        (*Arena)->Next = (memory_arena *)(*Arena)->Base;
-        InitializeArena((*Arena)->Next, ARENA_MEMORY_SIZE, Memory);
+        // NOTE(vic): New blocks are at least as big as the one that ran out
+        size_t BlockSize = (*Arena)->Size + sizeof(memory_arena);
+        if(BlockSize < Size + sizeof(memory_arena)) {
+            BlockSize = Size + sizeof(memory_arena);
+        }
+        u8 *Memory = (u8 *)malloc(BlockSize);
+        memset(Memory, 0, BlockSize);
+        (*Arena)->Next = (memory_arena *)Memory;
+        InitializeArena((*Arena)->Next, BlockSize, Memory + sizeof(memory_arena));
         *Arena = (*Arena)->Next;
     }
     
@@ -95,17 +136,39 @@ typedef enum {
     
     IOP_CALL = 25, // This is an extra -> doesn't exist in A level assembly
     IOP_RETURN = 26, // This is an extra -> doesn't exist in A level assembly
+    IOP_SPAWN = 27, // This is an extra -> doesn't exist in A level assembly
+    IOP_JOIN = 28, // This is an extra -> doesn't exist in A level assembly
+    IOP_CAS = 29, // This is an extra -> doesn't exist in A level assembly
+    IOP_SUB = 30, // This is an extra -> doesn't exist in A level assembly
+    IOP_MUL = 31, // This is an extra -> doesn't exist in A level assembly
+    IOP_DIV = 32, // This is an extra -> doesn't exist in A level assembly
+    IOP_MOD = 33, // This is an extra -> doesn't exist in A level assembly
+    IOP_JPG = 34, // This is an extra -> doesn't exist in A level assembly
+    IOP_JPL = 35, // This is an extra -> doesn't exist in A level assembly
+    IOP_COPY = 36, // This is an extra -> doesn't exist in A level assembly
+    IOP_FILL = 37, // This is an extra -> doesn't exist in A level assembly
     
     // IOP_JPI // indirect jump
     
     IOP_COUNT,
+    
+    // NOTE(vic): Never parsed, the debugger puts it over the instructions it has to stop at
+    IOP_BREAK = IOP_COUNT,
+    // NOTE(vic): -O puts it over the loops it can run in one go (idiom.c)
+    IOP_IDIOM,
+    // NOTE(vic): Same for CALLs to routines -O can memoize and their RETURNs (memo.c)
+    IOP_MEMO_CALL,
+    IOP_MEMO_RETURN,
+    // NOTE(vic): And where -snapshot stops the first run (snapshot.c)
+    IOP_SNAPSHOT,
 } instruction_code;
 
-typedef struct {
+typedef struct _symbol {
     String_View Name;
     int Evaluated;
     size_t LineRef;
     int FileIndex;
+    struct _symbol *Definition; // set by ResolveSymbols, can be in another file
 } symbol;
 
 typedef struct _symbol_table {
@@ -120,6 +183,7 @@ typedef struct {
     long int Operand;
     symbol *Label;
     int Immediate;
+    int FileIndex;
 } line_of_code;
 
 // TODO(vic): Test only data here!
@@ -130,6 +194,73 @@ typedef struct {
     long int *Data;
 } line_map;
 
+// NOTE(vic): Addressed by index, never by pointer, so a .alb image maps back without fixups
+#define INVALID_TARGET 0xFFFFFFFF
+
+// NOTE(vic): What Evaluate reads, 8 bytes so big programs stay in cache
+typedef struct {
+    u8 Opcode;
+    u8 Immediate;
+    u16 AddressFileIndex; // file the operand address refers to
+    union {
+        u32 Target; // cell for data instructions, instruction for jumps, INVALID_TARGET if it can't be resolved
+        s32 Operand; // immediate value, or address in AddressFileIndex for LDX, STX, COPY and FILL
+    };
+} instruction;
+
+// NOTE(vic): Cold side of an instruction, only diagnostics, the debugger and traces look at it
+typedef struct {
+    u16 FileIndex; // file the instruction comes from
+    u16 Reserved;
+    u32 LineInFile;
+    long int Operand; // as written: immediate value or line in AddressFileIndex
+} instruction_info;
+
+typedef struct {
+    u32 FirstCell;
+    u32 LineCount;
+} file_info;
+
+typedef struct {
+    u32 InstructionCount;
+    u32 CellCount;
+    u32 FileCount;
+    u32 EntryPoint;
+    
+    instruction *Instructions;
+    instruction_info *InstructionInfo; // parallel to Instructions
+    file_info *Files;
+    long int *Cells; // one cell per source line
+    u8 *CellHasData;
+    
+    // NOTE(vic): Debug info, Lines can be null (stripped image)
+    String_View *FileNames;
+    String_View *Lines; // indexed by cell
+} linked_program;
+
+// NOTE(vic): What CMP leaves for the jumps after it
+typedef enum {
+    COMPARED_EQUAL = 1,
+    COMPARED_GREATER = 2, // ACC was greater
+    COMPARED_LESS = 4,
+} compare_result;
+
+int CompareValues(long int ACC, long int Value)
+{
+    return (ACC == Value)*COMPARED_EQUAL | (ACC > Value)*COMPARED_GREATER | (ACC < Value)*COMPARED_LESS;
+}
+
+// NOTE(vic): Copy of the registers in Evaluate for the cold paths that need to see them
+typedef struct {
+    int ACC;
+    int IX;
+    int LastCompareResult; // compare_result
+    u32 *CallStack; // return addresses (the CALLs), CallDepth of them
+    u32 CallDepth;
+    size_t Line; // instruction about to run
+    u64 Steps; // instructions run before this one
+} machine_state;
+
 typedef struct {
     size_t Capacity;
     char *Cstr;
@@ -138,8 +269,9 @@ typedef struct {
 typedef struct {
     memory_arena **Arena;
     tmp_cstr *tc;
+    FILE *Errors;
     String_View *File;
-    String_View **ProgramLines;
+    String_View *ProgramLines;
     int FileIndex;
     line_of_code *Program;
     
@@ -148,8 +280,29 @@ typedef struct {
     
     symbol_table *SymbolTable;
     symbol_table **CurrentSymbolTable;
+    symbol **SymbolBuckets;
+    size_t SymbolBucketCount;
+    size_t SymbolCount;
 } lexer;
 
+// NOTE(vic): Files only meet in LinkProgram, so one can be parsed again on its own
+typedef struct {
+    String_View Name;
+    String_View Content;
+    
+    size_t LineCount;
+    String_View *Lines;
+    line_map *LineMappings; // LOC is relative to the start of this file
+    line_of_code *Program;
+    size_t LOCCount;
+    
+    symbol_table *SymbolTable; // labels declared or used in this file
+    symbol *StartSymbol;
+    size_t StartLOC;
+    
+    int IsObject; // loaded from a .alo, there's no source to parse
+} source_file;
+
 static const String_View InstructionList[IOP_COUNT] = {
     [IOP_LDM] = SV_STATIC("LDM"),
     [IOP_LDD] = SV_STATIC("LDD"),
@@ -180,6 +333,17 @@ static const String_View InstructionList[IOP_COUNT] = {
     
     [IOP_CALL] = SV_STATIC("CALL"),
     [IOP_RETURN] = SV_STATIC("RETURN"),
+    [IOP_SPAWN] = SV_STATIC("SPAWN"),
+    [IOP_JOIN] = SV_STATIC("JOIN"),
+    [IOP_CAS] = SV_STATIC("CAS"),
+    [IOP_SUB] = SV_STATIC("SUB"),
+    [IOP_MUL] = SV_STATIC("MUL"),
+    [IOP_DIV] = SV_STATIC("DIV"),
+    [IOP_MOD] = SV_STATIC("MOD"),
+    [IOP_JPG] = SV_STATIC("JPG"),
+    [IOP_JPL] = SV_STATIC("JPL"),
+    [IOP_COPY] = SV_STATIC("COPY"),
+    [IOP_FILL] = SV_STATIC("FILL"),
 };
 
 static const char *InstructionListInfo[IOP_COUNT] = {
@@ -220,6 +384,24 @@ static const char *InstructionListInfo[IOP_COUNT] = {
     
     [IOP_CALL] = "CALL <label>: Records the current address and jumps to label",
     [IOP_RETURN] = "RETURN: Returns to the last recorded address (by a CALL instruction)",
+    [IOP_SPAWN] = "SPAWN <label>: Starts another thread at label with a copy of ACC and IX.\n"
+        "Its number is loaded to ACC",
+    [IOP_JOIN] = "JOIN: Waits for the threads this one started to end",
+    [IOP_CAS] = "CAS <address>: If the contents of <address> are ACC, store IX at <address>.\n"
+        "Either way, load what it had to ACC. JPE jumps after it if IX was stored",
+    [IOP_SUB] = "SUB #n: Subtract the number n from ACC\n"
+        "SUB <address>: Subtract the contents of <address> from ACC",
+    [IOP_MUL] = "MUL #n: Multiply ACC by the number n\n"
+        "MUL <address>: Multiply ACC by the contents of <address>",
+    [IOP_DIV] = "DIV #n: Divide ACC by the number n, the result is rounded towards 0\n"
+        "DIV <address>: Divide ACC by the contents of <address>",
+    [IOP_MOD] = "MOD #n: Load the remainder of dividing ACC by the number n to ACC\n"
+        "MOD <address>: Load the remainder of dividing ACC by the contents of <address> to ACC",
+    [IOP_JPG] = "JPG <address>: Following a compare instruction, jump to <address> if ACC was greater",
+    [IOP_JPL] = "JPL <address>: Following a compare instruction, jump to <address> if ACC was less",
+    [IOP_COPY] = "COPY <address>: Copy the contents of the IX addresses from the address in ACC on\n"
+        "to the IX addresses from <address> on",
+    [IOP_FILL] = "FILL <address>: Store ACC at the IX addresses from <address> on",
 };
 
 int IsSet(int A, int Flag)
@@ -0,0 +1,92 @@
+// NOTE(vic): -bench without -inputs, the watched evaluator against the one picked for the flags
+
+#ifdef __linux__
+#define BENCH_SECONDS 0.5
+
+static String_View ReadAllInput(FILE *File)
+{
+    size_t Size = 0;
+    size_t Capacity = 4096;
+    char *Data = malloc(Capacity);
+    size_t Read;
+    while((Read = fread(Data + Size, 1, Capacity - Size, File)) > 0) {
+        Size += Read;
+        if(Size == Capacity) {
+            Capacity *= 2;
+            Data = realloc(Data, Capacity);
+        }
+    }
+    return sv_from_parts(Data, Size);
+}
+
+static void RunWithInput(linked_program *Program, int Flags, evaluator *Evaluator, String_View Input)
+{
+    FILE *SavedStdin = stdin;
+    stdin = Input.count ? fmemopen((void *)Input.data, Input.count, "r") : fopen("/dev/null", "r");
+    run_options Options = {0};
+    Evaluator(Program, Flags, &Options);
+    fclose(stdin);
+    stdin = SavedStdin;
+}
+
+// NOTE(vic): Returns the seconds for one run
+static double TimeEvaluator(linked_program *Program, int Flags, evaluator *Evaluator, String_View Input,
+                            long int *Cells, int *Runs)
+{
+    FILE *SavedStdout = stdout;
+    stdout = fopen("/dev/null", "w");
+    
+    *Runs = 0;
+    double Start = GetSeconds();
+    double Seconds;
+    do {
+        memcpy(Program->Cells, Cells, Program->CellCount*sizeof(long int));
+        RunWithInput(Program, Flags, Evaluator, Input);
+        ++*Runs;
+        Seconds = GetSeconds() - Start;
+    } while(Seconds < BENCH_SECONDS);
+    
+    fclose(stdout);
+    stdout = SavedStdout;
+    return Seconds / *Runs;
+}
+
+void BenchProgram(linked_program *Program, int Flags)
+{
+    if(Flags & (ALA_DEBUG | ALA_RECORD | ALA_REPLAY)) {
+        fprintf(stderr, "ERROR: '-bench' can't be used with '-debug', '-record' or '-replay'\n");
+        exit(1);
+    }
+    
+    String_View Input = ReadAllInput(stdin);
+    long int *Cells = malloc(Program->CellCount*sizeof(long int));
+    memcpy(Cells, Program->Cells, Program->CellCount*sizeof(long int));
+    
+    run_options Options = {0};
+    evaluator *Picked = PickEvaluator(Flags, &Options);
+    RunWithInput(Program, Flags, Picked, Input);
+    fflush(stdout);
+    
+    int WatchedRuns, PickedRuns;
+    double WatchedSeconds = TimeEvaluator(Program, Flags, EvaluateWatched, Input, Cells, &WatchedRuns);
+    double PickedSeconds = TimeEvaluator(Program, Flags, Picked, Input, Cells, &PickedRuns);
+    const char *PickedName = Picked == EvaluateCharacters ? "EvaluateCharacters" :
+        Picked == EvaluateNumbers ? "EvaluateNumbers" :
+        Picked == EvaluateCharactersNoLimit ? "EvaluateCharactersNoLimit" : "EvaluateNumbersNoLimit";
+    
+    fprintf(stderr, "NOTE: EvaluateWatched: %.3f ms per run (%d runs)\n"
+            "NOTE: %s: %.3f ms per run (%d runs, %.2fx)\n",
+            WatchedSeconds*1000.0, WatchedRuns,
+            PickedName, PickedSeconds*1000.0, PickedRuns, WatchedSeconds/PickedSeconds);
+    
+    memcpy(Program->Cells, Cells, Program->CellCount*sizeof(long int));
+    free(Cells);
+    free((char *)Input.data);
+}
+#else
+void BenchProgram(linked_program *Program, int Flags)
+{
+    fprintf(stderr, "ERROR: '-bench' is only supported on linux\n");
+    exit(1);
+}
+#endif
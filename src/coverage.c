@@ -0,0 +1,246 @@
+// NOTE(vic): -coverage, only jumps and errors are marked while it runs, at exit the lines are added to
+// first.alc and written to first.cov and first.info (lcov)
+
+#define ALA_COVERAGE_MAGIC 0x434C4123 // "#ALC"
+#define ALA_COVERAGE_VERSION 1
+
+typedef enum {
+    // NOTE(vic): Marks of the instructions while it runs
+    COVERAGE_ARRIVED = 1,
+    COVERAGE_JUMPED = 2,
+    COVERAGE_FELL_THROUGH = 4,
+    COVERAGE_LEFT = 32, // a RETURN or END ran, the jumps have JUMPED or FELL_THROUGH
+    COVERAGE_FAILED = 64, // a run failed at it and didn't fall through
+    
+    // NOTE(vic): Marks of the source lines, JUMPED and FELL_THROUGH stay as they are
+    COVERAGE_RAN = 1,
+    COVERAGE_CODE = 8,
+    COVERAGE_BRANCH = 16, // has a JPE, JPN, JPG or JPL
+} coverage_mark;
+
+typedef struct {
+    u32 Magic;
+    u32 Version;
+    u32 SourceHash;
+    u32 CellCount;
+} coverage_header;
+
+typedef struct {
+    linked_program Program; // a copy, the one it was made with may be gone when the process ends
+    char *DataPath; // .alc
+    char *ListingPath; // .cov
+    char *LcovPath; // .info
+    u8 *Marks; // one per instruction and one past the end
+} coverage;
+
+static coverage *RunCoverage;
+
+static u32 HashSource(linked_program *Program)
+{
+    if(!Program->Lines) {
+        return HashName(sv_from_parts((const char *)Program->CellHasData, Program->CellCount));
+    }
+    u32 Hash = Program->CellCount;
+    for(u32 i = 0; i < Program->CellCount; i++) Hash = Hash*31 + HashName(Program->Lines[i]);
+    return Hash;
+}
+
+// NOTE(vic): Marks a run fills in, shared with the children of -inputs
+static u8 *AllocateMarks(size_t Size)
+{
+#ifdef __linux__
+    void *Marks = mmap(0, Size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    return Marks == MAP_FAILED ? 0 : (u8 *)Marks;
+#else
+    return (u8 *)calloc(Size, 1);
+#endif
+}
+
+// NOTE(vic): Called by FailAt, marks the instruction the run failed at
+void StopCoverageAt(u32 Index)
+{
+    if(RunCoverage && Index < RunCoverage->Program.InstructionCount) RunCoverage->Marks[Index] |= COVERAGE_FAILED;
+}
+
+static u8 *LineOf(linked_program *Program, u8 *Lines, u32 Index)
+{
+    instruction_info *Info = Program->InstructionInfo + Index;
+    return Lines + Program->Files[Info->FileIndex].FirstCell + Info->LineInFile;
+}
+
+// NOTE(vic): An instruction ran if something arrived at it or the one before ran and fell through
+static void MarkLines(coverage *Coverage, u8 *Lines)
+{
+    linked_program *Program = &Coverage->Program;
+    u8 *Marks = Coverage->Marks;
+    u32 Count = Program->InstructionCount;
+    for(u32 i = 0; i < Count; i++)
+    {
+        instruction *Instruction = Program->Instructions + i;
+        if(Marks[i] & COVERAGE_JUMPED && Instruction->Target < Count) Marks[Instruction->Target] |= COVERAGE_ARRIVED;
+        if(Marks[i] & COVERAGE_FELL_THROUGH) Marks[i + 1] |= COVERAGE_ARRIVED;
+    }
+    
+    int Ran = 0;
+    for(u32 i = 0; i < Count; i++)
+    {
+        Ran = (Marks[i] & COVERAGE_ARRIVED) ||
+            (Ran && FallsThrough(Program->Instructions[i - 1].Opcode) && !(Marks[i - 1] & COVERAGE_FAILED));
+        u8 *Line = LineOf(Program, Lines, i);
+        int Opcode = Program->Instructions[i].Opcode;
+        *Line |= COVERAGE_CODE | (Ran ? COVERAGE_RAN : 0) | (Marks[i] & (COVERAGE_JUMPED | COVERAGE_FELL_THROUGH)) |
+            (IsBranchInstruction(Opcode) ? COVERAGE_BRANCH : 0);
+    }
+    
+    // NOTE(vic): Where another run went past the instruction that failed, it fell through to what ran after it
+    u8 Left = COVERAGE_JUMPED | COVERAGE_FELL_THROUGH | COVERAGE_LEFT | COVERAGE_FAILED;
+    Ran = 0;
+    for(u32 i = Count; i-- > 0;)
+    {
+        Ran = (Marks[i] & Left) ||
+            (Ran && !(Marks[i + 1] & COVERAGE_ARRIVED) && FallsThrough(Program->Instructions[i].Opcode));
+        if(Ran) *LineOf(Program, Lines, i) |= COVERAGE_RAN;
+    }
+}
+
+// NOTE(vic): Adds the marks of earlier runs, unless they were for another version of the program
+static void AddEarlierRuns(coverage *Coverage, u8 *Lines, u32 SourceHash)
+{
+    FILE *File = fopen(Coverage->DataPath, "rb");
+    if(!File) return;
+    
+    linked_program *Program = &Coverage->Program;
+    coverage_header Header;
+    u8 *Earlier = malloc(Program->CellCount + 1);
+    if(fread(&Header, sizeof(Header), 1, File) == 1 && Header.Magic == ALA_COVERAGE_MAGIC &&
+       Header.Version == ALA_COVERAGE_VERSION && Header.SourceHash == SourceHash &&
+       Header.CellCount == Program->CellCount && fread(Earlier, 1, Program->CellCount, File) == Program->CellCount)
+    {
+        for(u32 i = 0; i < Program->CellCount; i++) Lines[i] |= Earlier[i];
+    }
+    else {
+        fprintf(stderr, "NOTE: %s is from another version of the program, coverage starts again\n",
+                Coverage->DataPath);
+    }
+    free(Earlier);
+    fclose(File);
+}
+
+static void WriteListing(coverage *Coverage, u8 *Lines, FILE *Out)
+{
+    linked_program *Program = &Coverage->Program;
+    for(u32 FileIndex = 0; FileIndex < Program->FileCount; FileIndex++)
+    {
+        file_info *File = Program->Files + FileIndex;
+        fprintf(Out, "=== "SV_Fmt" ===\n", SV_Arg(Program->FileNames[FileIndex]));
+        for(u32 Line = 0; Line < File->LineCount; Line++)
+        {
+            u8 Marks = Lines[File->FirstCell + Line];
+            String_View Text = Program->Lines ? Program->Lines[File->FirstCell + Line] : SV_NULL;
+            char Mark = !(Marks & COVERAGE_CODE) ? ' ' : (Marks & COVERAGE_RAN) ? '+' : '-';
+            fprintf(Out, "%5u %c | "SV_Fmt, Line + 1, Mark, SV_Arg(Text));
+            
+            u8 Branch = Marks & (COVERAGE_JUMPED | COVERAGE_FELL_THROUGH);
+            if(Marks & COVERAGE_BRANCH && Marks & COVERAGE_RAN && Branch != (COVERAGE_JUMPED | COVERAGE_FELL_THROUGH)) {
+                fprintf(Out, "   <- %s", Branch == COVERAGE_JUMPED ? "never fell through" : "never jumped");
+            }
+            fprintf(Out, "\n");
+        }
+    }
+}
+
+// NOTE(vic): lcov's tracefile, the times are 1 for what ran, only that is known
+static void WriteLcov(coverage *Coverage, u8 *Lines, FILE *Out)
+{
+    linked_program *Program = &Coverage->Program;
+    fprintf(Out, "TN:\n");
+    for(u32 FileIndex = 0; FileIndex < Program->FileCount; FileIndex++)
+    {
+        file_info *File = Program->Files + FileIndex;
+        fprintf(Out, "SF:"SV_Fmt"\n", SV_Arg(Program->FileNames[FileIndex]));
+        
+        u32 Found = 0, Hit = 0, BranchesFound = 0, BranchesHit = 0;
+        for(u32 Line = 0; Line < File->LineCount; Line++)
+        {
+            u8 Marks = Lines[File->FirstCell + Line];
+            if(!(Marks & COVERAGE_CODE)) continue;
+            int Ran = (Marks & COVERAGE_RAN) != 0;
+            fprintf(Out, "DA:%u,%d\n", Line + 1, Ran);
+            Found++;
+            Hit += Ran;
+            if(!(Marks & COVERAGE_BRANCH)) continue;
+            
+            int Jumped = (Marks & COVERAGE_JUMPED) != 0;
+            int FellThrough = (Marks & COVERAGE_FELL_THROUGH) != 0;
+            if(Ran) {
+                fprintf(Out, "BRDA:%u,0,0,%d\nBRDA:%u,0,1,%d\n", Line + 1, Jumped, Line + 1, FellThrough);
+            }
+            else {
+                fprintf(Out, "BRDA:%u,0,0,-\nBRDA:%u,0,1,-\n", Line + 1, Line + 1);
+            }
+            BranchesFound += 2;
+            BranchesHit += Jumped + FellThrough;
+        }
+        fprintf(Out, "BRF:%u\nBRH:%u\nLF:%u\nLH:%u\nend_of_record\n", BranchesFound, BranchesHit, Found, Hit);
+    }
+}
+
+static FILE *OpenCoverageFile(const char *Path)
+{
+    FILE *File = fopen(Path, "wb");
+    if(!File) {
+        fprintf(stderr, "ERROR: Could not write %s: %s\n", Path, strerror(errno));
+    }
+    return File;
+}
+
+static void WriteCoverage(void)
+{
+    coverage *Coverage = RunCoverage;
+    if(!Coverage || !ReportsAtExit) return;
+    
+    linked_program *Program = &Coverage->Program;
+    u8 *Lines = calloc(Program->CellCount + 1, 1);
+    MarkLines(Coverage, Lines);
+    u32 SourceHash = HashSource(Program);
+    AddEarlierRuns(Coverage, Lines, SourceHash);
+    
+    FILE *Out = OpenCoverageFile(Coverage->DataPath);
+    if(Out) {
+        coverage_header Header = {
+            .Magic = ALA_COVERAGE_MAGIC,
+            .Version = ALA_COVERAGE_VERSION,
+            .SourceHash = SourceHash,
+            .CellCount = Program->CellCount,
+        };
+        fwrite(&Header, sizeof(Header), 1, Out);
+        fwrite(Lines, 1, Program->CellCount, Out);
+        fclose(Out);
+    }
+    if((Out = OpenCoverageFile(Coverage->ListingPath))) {
+        WriteListing(Coverage, Lines, Out);
+        fclose(Out);
+    }
+    if((Out = OpenCoverageFile(Coverage->LcovPath))) {
+        WriteLcov(Coverage, Lines, Out);
+        fclose(Out);
+    }
+    free(Lines);
+}
+
+coverage *StartCoverage(String_View FirstFile, const char *Extension, linked_program *Program)
+{
+    coverage *Coverage = calloc(1, sizeof(coverage));
+    Coverage->Program = *Program;
+    Coverage->DataPath = ReplaceExtension(FirstFile, Extension, ".alc");
+    Coverage->ListingPath = ReplaceExtension(FirstFile, Extension, ".cov");
+    Coverage->LcovPath = ReplaceExtension(FirstFile, Extension, ".info");
+    Coverage->Marks = AllocateMarks(Program->InstructionCount + 1);
+    if(!Coverage->Marks) {
+        fprintf(stderr, "ERROR: Could not allocate the coverage marks: %s\n", strerror(errno));
+        exit(1);
+    }
+    RunCoverage = Coverage;
+    atexit(WriteCoverage);
+    return Coverage;
+}
@@ -0,0 +1,230 @@
+// NOTE(vic): -cycles[=<file>], the counts of -stats times what each instruction and its memory
+// accesses cost, per source line in first.cyc
+
+#define TOP_CYCLE_LINES 5
+
+typedef struct {
+    u32 Costs[IOP_SNAPSHOT + 1];
+    u32 MemoryCycles; // per cell read or written
+    u32 IndirectCycles; // LDI and STI, reading the address
+    u32 IndexedCycles; // LDX and STX, adding IX
+    
+    linked_program Program; // a copy, the one it was made with may be gone when the process ends
+    char *ListingPath; // .cyc
+    u64 *CellAccesses; // of COPY and FILL while Evaluate runs, one per instruction
+    
+    // NOTE(vic): One per source line, indexed by cell
+    u64 *LineCycles;
+    u64 *LineCounts;
+    u64 Cycles;
+    u64 Instructions;
+} cycle_model;
+
+static cycle_model RunCycles;
+
+static u32 MemoryAccesses(instruction *I)
+{
+    switch(I->Opcode)
+    {
+        case IOP_LDD: case IOP_LDI: case IOP_LDX:
+        case IOP_STO: case IOP_STI: case IOP_STX:
+        case IOP_CALL: case IOP_RETURN: return 1;
+        
+        case IOP_ADD: case IOP_SUB: case IOP_MUL: case IOP_DIV: case IOP_MOD:
+        case IOP_AND: case IOP_XOR: case IOP_OR: case IOP_CMP: return !I->Immediate;
+        
+        case IOP_CAS: return 2;
+        default: return 0;
+    }
+}
+
+static u64 InstructionCycles(cycle_model *Model, instruction *I)
+{
+    u64 Cycles = Model->Costs[I->Opcode] + (u64)Model->MemoryCycles*MemoryAccesses(I);
+    if(I->Opcode == IOP_LDI || I->Opcode == IOP_STI) Cycles += Model->IndirectCycles;
+    if(I->Opcode == IOP_LDX || I->Opcode == IOP_STX) Cycles += Model->IndexedCycles;
+    return Cycles;
+}
+
+// NOTE(vic): Called by EndStatsRun, Count is how often instruction Index ran
+void AddCycles(u32 Index, u64 Count)
+{
+    cycle_model *Model = &RunCycles;
+    if(!Model->LineCycles) return;
+    
+    linked_program *Program = &Model->Program;
+    instruction_info *Info = Program->InstructionInfo + Index;
+    u32 Cell = Program->Files[Info->FileIndex].FirstCell + Info->LineInFile;
+    u64 Cycles = Count*InstructionCycles(Model, Program->Instructions + Index) +
+        Model->MemoryCycles*Model->CellAccesses[Index];
+    Model->LineCycles[Cell] += Cycles;
+    Model->LineCounts[Cell] += Count;
+    Model->Cycles += Cycles;
+    Model->Instructions += Count;
+    Model->CellAccesses[Index] = 0;
+}
+
+// NOTE(vic): Name is an instruction (INC and DEC are both of theirs) or one of the extra costs
+static int SetCost(cycle_model *Model, String_View Name, u32 Cycles)
+{
+    if(sv_eq_ignorecase(Name, SV("memory"))) Model->MemoryCycles = Cycles;
+    else if(sv_eq_ignorecase(Name, SV("indirect"))) Model->IndirectCycles = Cycles;
+    else if(sv_eq_ignorecase(Name, SV("indexed"))) Model->IndexedCycles = Cycles;
+    else {
+        int Found = 0;
+        for(int i = 0; i < IOP_COUNT; i++) {
+            if(!sv_eq_ignorecase(Name, InstructionList[i])) continue;
+            Model->Costs[i] = Cycles;
+            Found = 1;
+        }
+        return Found;
+    }
+    return 1;
+}
+
+static void ReadCosts(cycle_model *Model, const char *Path)
+{
+    String_View Content = sv_ReadEntireFile(Path);
+    if(!Content.data) {
+        fprintf(stderr, "ERROR: Could not read file %s: %s\n", Path, strerror(errno));
+        exit(1);
+    }
+    
+    String_View Rest = Content;
+    for(u32 LineNumber = 1; Rest.count > 0; LineNumber++)
+    {
+        String_View Line = sv_chop_by_delim(&Rest, '\n');
+        Line = sv_trim(sv_chop_by_sv(&Line, SV("//")));
+        if(Line.count == 0) continue;
+        
+        String_View Name = sv_trim(sv_chop_by_delim(&Line, ' '));
+        String_View Value = sv_trim(Line);
+        size_t Digits = 0;
+        while(Digits < Value.count && isdigit(Value.data[Digits])) Digits++;
+        if(Value.count == 0 || Digits != Value.count || Value.count > 9) {
+            fprintf(stderr, "%s(%u): ERROR: Expected '<name> <cycles>', the cycles a number\n", Path, LineNumber);
+            exit(1);
+        }
+        if(!SetCost(Model, Name, (u32)sv_to_u64(Value))) {
+            fprintf(stderr, "%s(%u): ERROR: '"SV_Fmt"' isn't an instruction, MEMORY, INDIRECT or INDEXED\n",
+                    Path, LineNumber, SV_Arg(Name));
+            exit(1);
+        }
+    }
+    free((char *)Content.data);
+}
+
+// NOTE(vic): The costs that ran, in the format of <file>
+static void WriteCosts(cycle_model *Model, FILE *Out)
+{
+    fprintf(Out, "// Costs in cycles\n");
+    for(int i = 0; i < IOP_COUNT; i++)
+    {
+        if(i == IOP_IXINC || i == IOP_IXDEC) continue; // same names as INC and DEC ACC
+        fprintf(Out, SV_Fmt" %u\n", SV_Arg(InstructionList[i]), Model->Costs[i]);
+    }
+    fprintf(Out, "MEMORY %u\nINDIRECT %u\nINDEXED %u\n\n", Model->MemoryCycles, Model->IndirectCycles,
+            Model->IndexedCycles);
+}
+
+static void WriteCycleListing(cycle_model *Model, FILE *Out)
+{
+    linked_program *Program = &Model->Program;
+    WriteCosts(Model, Out);
+    for(u32 FileIndex = 0; FileIndex < Program->FileCount; FileIndex++)
+    {
+        file_info *File = Program->Files + FileIndex;
+        fprintf(Out, "=== "SV_Fmt" ===\n", SV_Arg(Program->FileNames[FileIndex]));
+        for(u32 Line = 0; Line < File->LineCount; Line++)
+        {
+            u32 Cell = File->FirstCell + Line;
+            String_View Text = Program->Lines ? Program->Lines[Cell] : SV_NULL;
+            if(Model->LineCounts[Cell]) {
+                fprintf(Out, "%5u %14llu %5.1f%% | "SV_Fmt"\n", Line + 1, (unsigned long long)Model->LineCycles[Cell],
+                        100.0*Model->LineCycles[Cell]/Model->Cycles, SV_Arg(Text));
+            }
+            else {
+                fprintf(Out, "%5u %14s %6s | "SV_Fmt"\n", Line + 1, "", "", SV_Arg(Text));
+            }
+        }
+    }
+}
+
+static void WriteTopLines(cycle_model *Model)
+{
+    linked_program *Program = &Model->Program;
+    u32 Top[TOP_CYCLE_LINES];
+    u32 TopCount = 0;
+    for(u32 Cell = 0; Cell < Program->CellCount; Cell++)
+    {
+        if(!Model->LineCycles[Cell]) continue;
+        u32 At = TopCount < TOP_CYCLE_LINES ? TopCount++ : TOP_CYCLE_LINES;
+        for(; At > 0 && Model->LineCycles[Top[At - 1]] < Model->LineCycles[Cell]; At--) {
+            if(At < TOP_CYCLE_LINES) Top[At] = Top[At - 1];
+        }
+        if(At < TOP_CYCLE_LINES) Top[At] = Cell;
+    }
+    
+    if(TopCount) fprintf(stderr, "Lines that cost the most:\n");
+    for(u32 i = 0; i < TopCount; i++)
+    {
+        u32 FileIndex = 0;
+        while(FileIndex + 1 < Program->FileCount && Program->Files[FileIndex + 1].FirstCell <= Top[i]) FileIndex++;
+        String_View Text = Program->Lines ? sv_trim(Program->Lines[Top[i]]) : SV_NULL;
+        fprintf(stderr, "  "SV_Fmt"(%u): %llu cycles, %.1f%% | "SV_Fmt"\n", SV_Arg(Program->FileNames[FileIndex]),
+                Top[i] - Program->Files[FileIndex].FirstCell, (unsigned long long)Model->LineCycles[Top[i]],
+                100.0*Model->LineCycles[Top[i]]/Model->Cycles, SV_Arg(Text));
+    }
+}
+
+static void WriteCycles(void)
+{
+    cycle_model *Model = &RunCycles;
+    if(!Model->LineCycles || !ReportsAtExit) return;
+    if(RunStats.EvaluateStarted != 0) {
+        // NOTE(vic): It failed
+        EndStatsRun(&RunStats);
+    }
+    
+    fflush(stdout);
+    // NOTE(vic): Errors don't end their line
+    fprintf(stderr, "\nCycles: %llu for %llu instructions (%.2f per instruction)\n",
+            (unsigned long long)Model->Cycles, (unsigned long long)Model->Instructions,
+            Model->Instructions ? (double)Model->Cycles/Model->Instructions : 0.0);
+    WriteTopLines(Model);
+    
+    FILE *Out = fopen(Model->ListingPath, "w");
+    if(!Out) {
+        fprintf(stderr, "ERROR: Could not write %s: %s\n", Model->ListingPath, strerror(errno));
+        return;
+    }
+    WriteCycleListing(Model, Out);
+    fclose(Out);
+    fprintf(stderr, "Every line in %s\n", Model->ListingPath);
+}
+
+// NOTE(vic): Before the program is loaded, a wrong <file> stops it right away
+void StartCycles(const char *CostsPath)
+{
+    cycle_model *Model = &RunCycles;
+    for(int i = 0; i <= IOP_SNAPSHOT; i++) Model->Costs[i] = 1;
+    Model->Costs[IOP_MUL] = 4;
+    Model->Costs[IOP_DIV] = 12;
+    Model->Costs[IOP_MOD] = 12;
+    Model->MemoryCycles = 2;
+    Model->IndirectCycles = 2;
+    Model->IndexedCycles = 1;
+    if(CostsPath) ReadCosts(Model, CostsPath);
+    atexit(WriteCycles);
+}
+
+cycle_model *BeginCycles(String_View FirstFile, const char *Extension, linked_program *Program)
+{
+    cycle_model *Model = &RunCycles;
+    Model->Program = *Program;
+    Model->ListingPath = ReplaceExtension(FirstFile, Extension, ".cyc");
+    Model->CellAccesses = calloc(Program->InstructionCount + 1, sizeof(u64));
+    Model->LineCycles = calloc(Program->CellCount + 1, sizeof(u64));
+    Model->LineCounts = calloc(Program->CellCount + 1, sizeof(u64));
+    return Model;
+}
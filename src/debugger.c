@@ -0,0 +1,708 @@
+// NOTE(vic): -debug, the instructions it stops at get IOP_BREAK, the rest run as without it
+
+#define MAX_BREAKPOINTS 64
+#define MAX_WATCHPOINTS 64
+
+typedef enum {
+    BREAK_USER = 1,
+    BREAK_STEP = 2,
+    BREAK_WATCH = 4, // instructions that can store to a watched cell
+    BREAK_TRAVEL = 8, // every instruction while going back
+} break_kind;
+
+typedef enum {
+    TRAVEL_NONE,
+    TRAVEL_TO, // run to TravelTarget
+    TRAVEL_SEARCH, // find the last stop before TravelTarget
+} travel_mode;
+
+typedef enum {
+    COMPARE_NONE,
+    COMPARE_EQ,
+    COMPARE_NE,
+    COMPARE_LT,
+    COMPARE_GT,
+    COMPARE_LE,
+    COMPARE_GE,
+} compare_op;
+
+typedef struct {
+    int Used;
+    u32 Instruction;
+    int Register; // 'A' (ACC) or 'X' (IX) if the breakpoint has a condition
+    compare_op Compare;
+    long int Value;
+} breakpoint;
+
+typedef struct {
+    int Used;
+    u32 Cell;
+    String_View Name;
+} watchpoint;
+
+typedef struct {
+    linked_program *Program;
+    u8 *OriginalOpcodes;
+    u8 *BreakKinds;
+    
+    breakpoint Breakpoints[MAX_BREAKPOINTS];
+    watchpoint Watchpoints[MAX_WATCHPOINTS];
+    
+    u32 StepBreaks[2];
+    int StepBreakCount;
+    
+    // NOTE(vic): Going back, only when replaying
+    recording *Recording;
+    travel_mode Travel;
+    u64 TravelTarget;
+    u64 SegmentEnd;
+    size_t SearchSnapshot;
+    int Found;
+} debugger;
+
+void ShowStepCommands()
+{
+    printf("Commands:\n"
+           "help (h): Show commands\n"
+           "next (n/[enter]): Go to the next instruction\n"
+           "registers (r): Show the values in the ACC and IX registers\n"
+           "continue (c): Continue the execution until a breakpoint or watchpoint stops it\n"
+           "reverse-step (rs): Go back to the previous instruction (only with '-replay')\n"
+           "reverse-continue (rc): Go back to the last breakpoint or watchpoint hit (only with '-replay')\n"
+           "break (b) <where> [if acc|ix <op> <number>]: Stop before the instruction at <where>,\n"
+           "    <where> is a label, a line in the current file or <file>:<line>, <op> is one of\n"
+           "    == != < > <= >=\n"
+           "watch (w) <label>: Stop when an instruction is about to change the data in <label>\n"
+           "delete (d) <number>: Delete a breakpoint or watchpoint\n"
+           "list (l): Show the breakpoints and watchpoints\n"
+           "print (p) <label>: Show the data in <label>\n"
+           "quit (q): Quit ALA debugger\n");
+}
+
+void UpdateBreak(debugger *Debugger, u32 Index)
+{
+    instruction *Instruction = Debugger->Program->Instructions + Index;
+    Instruction->Opcode = Debugger->BreakKinds[Index] ? IOP_BREAK : Debugger->OriginalOpcodes[Index];
+}
+
+void SetBreakKind(debugger *Debugger, u32 Index, break_kind Kind)
+{
+    Debugger->BreakKinds[Index] |= Kind;
+    UpdateBreak(Debugger, Index);
+}
+
+// NOTE(vic): Recomputes one kind of break for every instruction, only done when a command changes them
+void ClearBreakKind(debugger *Debugger, break_kind Kind)
+{
+    for(u32 i = 0; i < Debugger->Program->InstructionCount; i++) {
+        if(Debugger->BreakKinds[i] & Kind) {
+            Debugger->BreakKinds[i] &= ~Kind;
+            UpdateBreak(Debugger, i);
+        }
+    }
+}
+
+void CompileBreakpoints(debugger *Debugger)
+{
+    ClearBreakKind(Debugger, BREAK_USER);
+    for(int i = 0; i < MAX_BREAKPOINTS; i++) {
+        if(Debugger->Breakpoints[i].Used) {
+            SetBreakKind(Debugger, Debugger->Breakpoints[i].Instruction, BREAK_USER);
+        }
+    }
+}
+
+void CompileWatchpoints(debugger *Debugger)
+{
+    linked_program *Program = Debugger->Program;
+    ClearBreakKind(Debugger, BREAK_WATCH);
+    for(int w = 0; w < MAX_WATCHPOINTS; w++)
+    {
+        if(!Debugger->Watchpoints[w].Used) continue;
+        
+        u32 Cell = Debugger->Watchpoints[w].Cell;
+        for(u32 i = 0; i < Program->InstructionCount; i++)
+        {
+            instruction *Instruction = Program->Instructions + i;
+            file_info *File = Program->Files + Instruction->AddressFileIndex;
+            int Opcode = Debugger->OriginalOpcodes[i];
+            // NOTE(vic): STX, COPY and FILL can reach any cell in their file depending on IX
+            int Indexed = Opcode == IOP_STX || Opcode == IOP_COPY || Opcode == IOP_FILL;
+            if(((Opcode == IOP_STO || Opcode == IOP_STI || Opcode == IOP_CAS) && Instruction->Target == Cell) ||
+               (Indexed && Cell >= File->FirstCell && Cell < File->FirstCell + File->LineCount))
+            {
+                SetBreakKind(Debugger, i, BREAK_WATCH);
+            }
+        }
+    }
+}
+
+debugger *StartDebugger(linked_program *Program, recording *Recording)
+{
+    debugger *Debugger = calloc(1, sizeof(debugger));
+    Debugger->Program = Program;
+    Debugger->Recording = Recording && Recording->Replaying ? Recording : 0;
+    Debugger->OriginalOpcodes = malloc(Program->InstructionCount + 1);
+    Debugger->BreakKinds = calloc(Program->InstructionCount + 1, 1);
+    for(u32 i = 0; i < Program->InstructionCount; i++) {
+        Debugger->OriginalOpcodes[i] = Program->Instructions[i].Opcode;
+    }
+    
+    ShowStepCommands();
+    if(Program->EntryPoint < Program->InstructionCount) {
+        Debugger->StepBreaks[Debugger->StepBreakCount++] = Program->EntryPoint;
+        SetBreakKind(Debugger, Program->EntryPoint, BREAK_STEP);
+    }
+    return Debugger;
+}
+
+// NOTE(vic): Puts the real opcodes back, the linked program can be run again afterwards
+void StopDebugger(debugger *Debugger)
+{
+    if(!Debugger) return;
+    
+    for(u32 i = 0; i < Debugger->Program->InstructionCount; i++) {
+        Debugger->Program->Instructions[i].Opcode = Debugger->OriginalOpcodes[i];
+    }
+    free(Debugger->OriginalOpcodes);
+    free(Debugger->BreakKinds);
+    free(Debugger);
+}
+
+void ClearStepBreaks(debugger *Debugger)
+{
+    for(int i = 0; i < Debugger->StepBreakCount; i++) {
+        u32 Index = Debugger->StepBreaks[i];
+        Debugger->BreakKinds[Index] &= ~BREAK_STEP;
+        UpdateBreak(Debugger, Index);
+    }
+    Debugger->StepBreakCount = 0;
+}
+
+void AddStepBreak(debugger *Debugger, size_t Index)
+{
+    if(Index < Debugger->Program->InstructionCount) {
+        Debugger->StepBreaks[Debugger->StepBreakCount++] = (u32)Index;
+        SetBreakKind(Debugger, (u32)Index, BREAK_STEP);
+    }
+}
+
+// NOTE(vic): Break on every instruction that can run after this one
+void SetStepBreaks(debugger *Debugger, machine_state *State)
+{
+    instruction *Instruction = Debugger->Program->Instructions + State->Line;
+    switch(Debugger->OriginalOpcodes[State->Line])
+    {
+        case IOP_END: break;
+        case IOP_RETURN:
+        {
+            if(State->CallDepth) AddStepBreak(Debugger, State->CallStack[State->CallDepth - 1] + 1);
+        } break;
+        
+        case IOP_JMP:
+        case IOP_CALL:
+        {
+            AddStepBreak(Debugger, Instruction->Target);
+        } break;
+        
+        case IOP_JPE:
+        case IOP_JPN:
+        case IOP_JPG:
+        case IOP_JPL:
+        {
+            AddStepBreak(Debugger, State->Line + 1);
+            if(Instruction->Target != State->Line + 1) AddStepBreak(Debugger, Instruction->Target);
+        } break;
+        
+        default: AddStepBreak(Debugger, State->Line + 1); break;
+    }
+}
+
+void ShowInstruction(linked_program *Program, size_t Index)
+{
+    instruction_info *Info = Program->InstructionInfo + Index;
+    String_View Text = SV_NULL;
+    if(Program->Lines) {
+        Text = Program->Lines[Program->Files[Info->FileIndex].FirstCell + Info->LineInFile];
+    }
+    printf("%u: "SV_Fmt"\n", Info->LineInFile, SV_Arg(Text));
+}
+
+int FileOfCell(linked_program *Program, u32 Cell)
+{
+    for(u32 FileIndex = 0; FileIndex < Program->FileCount; FileIndex++) {
+        file_info *File = Program->Files + FileIndex;
+        if(Cell >= File->FirstCell && Cell < File->FirstCell + File->LineCount) return (int)FileIndex;
+    }
+    return -1;
+}
+
+// NOTE(vic): Labels aren't kept in the linked program, they are found in the source lines instead
+int FindLabelCell(linked_program *Program, String_View Name, u32 *Cell)
+{
+    if(!Program->Lines) {
+        printf("Labels are not available, the program was compiled with '-strip'\n");
+        return 0;
+    }
+    for(u32 i = 0; i < Program->CellCount; i++) {
+        String_View Line = sv_trim_left(Program->Lines[i]);
+        if(sv_starts_with(Line, Name) && Line.count > Name.count && Line.data[Name.count] == ':') {
+            *Cell = i;
+            return 1;
+        }
+    }
+    printf("Label '"SV_Fmt"' is not in the program\n", SV_Arg(Name));
+    return 0;
+}
+
+// NOTE(vic): Same as a jump, a line without an instruction (label, comment) stops at the next one
+int FindInstructionAt(linked_program *Program, int FileIndex, u32 LineInFile, u32 *Index)
+{
+    for(u32 i = 0; i < Program->InstructionCount; i++) {
+        instruction_info *Info = Program->InstructionInfo + i;
+        if(Info->FileIndex == FileIndex && Info->LineInFile >= LineInFile) {
+            *Index = i;
+            return 1;
+        }
+    }
+    printf("There are no instructions after "SV_Fmt"(%u)\n", SV_Arg(Program->FileNames[FileIndex]), LineInFile);
+    return 0;
+}
+
+int ParseDebuggerNumber(String_View Token, long int *Value)
+{
+    char Buffer[32];
+    if(Token.count == 0 || Token.count >= sizeof(Buffer)) return 0;
+    memcpy(Buffer, Token.data, Token.count);
+    Buffer[Token.count] = 0;
+    char *End;
+    *Value = strtol(Buffer, &End, 10);
+    return *End == 0;
+}
+
+// NOTE(vic): <label>, <line> in the current file or <file>:<line>
+int ParseBreakLocation(linked_program *Program, size_t CurrentIndex, String_View Where, u32 *Index)
+{
+    int FileIndex = Program->InstructionInfo[CurrentIndex].FileIndex;
+    long int Line;
+    size_t Colon;
+    if(sv_index_of(Where, ':', &Colon)) {
+        String_View FileName = sv_from_parts(Where.data, Colon);
+        String_View LineToken = sv_from_parts(Where.data + Colon + 1, Where.count - Colon - 1);
+        FileIndex = -1;
+        for(u32 i = 0; i < Program->FileCount; i++) {
+            if(sv_ends_with(Program->FileNames[i], FileName)) FileIndex = (int)i;
+        }
+        if(FileIndex < 0) {
+            printf("File '"SV_Fmt"' is not in the program\n", SV_Arg(FileName));
+            return 0;
+        }
+        if(!ParseDebuggerNumber(LineToken, &Line) || Line < 0) {
+            printf("'"SV_Fmt"' is not a line number\n", SV_Arg(LineToken));
+            return 0;
+        }
+    }
+    else if(!ParseDebuggerNumber(Where, &Line)) {
+        u32 Cell;
+        if(!FindLabelCell(Program, Where, &Cell)) return 0;
+        if(Program->CellHasData[Cell]) {
+            printf("Label '"SV_Fmt"' is data, use 'watch' to stop when it changes\n", SV_Arg(Where));
+            return 0;
+        }
+        FileIndex = FileOfCell(Program, Cell);
+        Line = Cell - Program->Files[FileIndex].FirstCell;
+    }
+    
+    return FindInstructionAt(Program, FileIndex, (u32)Line, Index);
+}
+
+compare_op ParseCompareOp(String_View Token)
+{
+    if(sv_eq(Token, SV("=="))) return COMPARE_EQ;
+    if(sv_eq(Token, SV("!="))) return COMPARE_NE;
+    if(sv_eq(Token, SV("<"))) return COMPARE_LT;
+    if(sv_eq(Token, SV(">"))) return COMPARE_GT;
+    if(sv_eq(Token, SV("<="))) return COMPARE_LE;
+    if(sv_eq(Token, SV(">="))) return COMPARE_GE;
+    return COMPARE_NONE;
+}
+
+static const char *CompareOpNames[] = {
+    [COMPARE_EQ] = "==", [COMPARE_NE] = "!=", [COMPARE_LT] = "<",
+    [COMPARE_GT] = ">", [COMPARE_LE] = "<=", [COMPARE_GE] = ">=",
+};
+
+int BreakpointConditionHolds(breakpoint *Breakpoint, machine_state *State)
+{
+    long int Value = Breakpoint->Register == 'X' ? State->IX : State->ACC;
+    switch(Breakpoint->Compare)
+    {
+        case COMPARE_EQ: return Value == Breakpoint->Value;
+        case COMPARE_NE: return Value != Breakpoint->Value;
+        case COMPARE_LT: return Value < Breakpoint->Value;
+        case COMPARE_GT: return Value > Breakpoint->Value;
+        case COMPARE_LE: return Value <= Breakpoint->Value;
+        case COMPARE_GE: return Value >= Breakpoint->Value;
+        default: return 1;
+    }
+}
+
+String_View NextDebuggerToken(String_View *Command)
+{
+    *Command = sv_trim_left(*Command);
+    String_View Token = sv_chop_by_delim(Command, ' ');
+    return sv_trim(Token);
+}
+
+void AddBreakpoint(debugger *Debugger, machine_state *State, String_View Arguments)
+{
+    String_View Where = NextDebuggerToken(&Arguments);
+    if(Where.count == 0) {
+        printf("Usage: break <where> [if acc|ix <op> <number>]\n");
+        return;
+    }
+    
+    breakpoint Breakpoint = { .Used = 1 };
+    if(!ParseBreakLocation(Debugger->Program, State->Line, Where, &Breakpoint.Instruction)) return;
+    
+    String_View If = NextDebuggerToken(&Arguments);
+    if(If.count) {
+        String_View Register = NextDebuggerToken(&Arguments);
+        String_View Op = NextDebuggerToken(&Arguments);
+        String_View Value = NextDebuggerToken(&Arguments);
+        Breakpoint.Register = sv_eq_ignorecase(Register, SV("acc")) ? 'A' :
+            sv_eq_ignorecase(Register, SV("ix")) ? 'X' : 0;
+        Breakpoint.Compare = ParseCompareOp(Op);
+        if(!sv_eq_ignorecase(If, SV("if")) || !Breakpoint.Register ||
+           Breakpoint.Compare == COMPARE_NONE || !ParseDebuggerNumber(Value, &Breakpoint.Value))
+        {
+            printf("Conditions look like 'if acc == 10' or 'if ix >= 3'\n");
+            return;
+        }
+    }
+    
+    for(int i = 0; i < MAX_BREAKPOINTS; i++) {
+        if(!Debugger->Breakpoints[i].Used) {
+            Debugger->Breakpoints[i] = Breakpoint;
+            SetBreakKind(Debugger, Breakpoint.Instruction, BREAK_USER);
+            printf("Breakpoint %d at ", i + 1);
+            ShowInstruction(Debugger->Program, Breakpoint.Instruction);
+            return;
+        }
+    }
+    printf("Can't have more than %d breakpoints\n", MAX_BREAKPOINTS);
+}
+
+void AddWatchpoint(debugger *Debugger, String_View Arguments)
+{
+    String_View Name = NextDebuggerToken(&Arguments);
+    u32 Cell;
+    if(Name.count == 0) {
+        printf("Usage: watch <label>\n");
+        return;
+    }
+    if(!FindLabelCell(Debugger->Program, Name, &Cell)) return;
+    if(!Debugger->Program->CellHasData[Cell]) {
+        printf("Label '"SV_Fmt"' has no data to watch\n", SV_Arg(Name));
+        return;
+    }
+    
+    for(int i = 0; i < MAX_WATCHPOINTS; i++) {
+        watchpoint *Watchpoint = Debugger->Watchpoints + i;
+        if(!Watchpoint->Used) {
+            Watchpoint->Used = 1;
+            Watchpoint->Cell = Cell;
+            Watchpoint->Name = sv_from_parts(sv_trim_left(Debugger->Program->Lines[Cell]).data, Name.count);
+            CompileWatchpoints(Debugger);
+            printf("Watchpoint %d on '"SV_Fmt"' (%ld)\n", MAX_BREAKPOINTS + i + 1,
+                   SV_Arg(Name), Debugger->Program->Cells[Cell]);
+            return;
+        }
+    }
+    printf("Can't have more than %d watchpoints\n", MAX_WATCHPOINTS);
+}
+
+// NOTE(vic): Watchpoints are numbered after the breakpoints so 'delete' can tell them apart
+void DeleteBreakOrWatchpoint(debugger *Debugger, String_View Arguments)
+{
+    long int Number;
+    if(!ParseDebuggerNumber(NextDebuggerToken(&Arguments), &Number)) {
+        printf("Usage: delete <number>\n");
+    }
+    else if(Number >= 1 && Number <= MAX_BREAKPOINTS && Debugger->Breakpoints[Number - 1].Used) {
+        Debugger->Breakpoints[Number - 1].Used = 0;
+        CompileBreakpoints(Debugger);
+    }
+    else if(Number > MAX_BREAKPOINTS && Number <= MAX_BREAKPOINTS + MAX_WATCHPOINTS &&
+            Debugger->Watchpoints[Number - MAX_BREAKPOINTS - 1].Used)
+    {
+        Debugger->Watchpoints[Number - MAX_BREAKPOINTS - 1].Used = 0;
+        CompileWatchpoints(Debugger);
+    }
+    else {
+        printf("There is no breakpoint or watchpoint %ld\n", Number);
+    }
+}
+
+void ListBreakAndWatchpoints(debugger *Debugger)
+{
+    for(int i = 0; i < MAX_BREAKPOINTS; i++) {
+        breakpoint *Breakpoint = Debugger->Breakpoints + i;
+        if(!Breakpoint->Used) continue;
+        
+        instruction_info *Info = Debugger->Program->InstructionInfo + Breakpoint->Instruction;
+        printf("%d: break at "SV_Fmt"(%u)", i + 1,
+               SV_Arg(Debugger->Program->FileNames[Info->FileIndex]), Info->LineInFile);
+        if(Breakpoint->Compare != COMPARE_NONE) {
+            printf(" if %s %s %ld", Breakpoint->Register == 'X' ? "ix" : "acc",
+                   CompareOpNames[Breakpoint->Compare], Breakpoint->Value);
+        }
+        printf("\n");
+    }
+    for(int i = 0; i < MAX_WATCHPOINTS; i++) {
+        watchpoint *Watchpoint = Debugger->Watchpoints + i;
+        if(Watchpoint->Used) {
+            printf("%d: watch '"SV_Fmt"'\n", MAX_BREAKPOINTS + i + 1, SV_Arg(Watchpoint->Name));
+        }
+    }
+}
+
+void PrintLabelData(debugger *Debugger, String_View Arguments)
+{
+    String_View Name = NextDebuggerToken(&Arguments);
+    u32 Cell;
+    if(Name.count == 0) {
+        printf("Usage: print <label>\n");
+    }
+    else if(FindLabelCell(Debugger->Program, Name, &Cell)) {
+        if(Debugger->Program->CellHasData[Cell]) {
+            printf(SV_Fmt" = %ld\n", SV_Arg(Name), Debugger->Program->Cells[Cell]);
+        }
+        else {
+            printf("Label '"SV_Fmt"' has no data\n", SV_Arg(Name));
+        }
+    }
+}
+
+// NOTE(vic): Going back (-replay), from the latest snapshot before the step, breaking on everything
+void StartTravel(debugger *Debugger, machine_state *State, travel_mode Mode, u64 Target)
+{
+    for(u32 i = 0; i < Debugger->Program->InstructionCount; i++) {
+        SetBreakKind(Debugger, i, BREAK_TRAVEL);
+    }
+    
+    Debugger->Travel = Mode;
+    Debugger->TravelTarget = Target;
+    Debugger->Found = 0;
+    if(Mode == TRAVEL_SEARCH) {
+        // NOTE(vic): Searched one snapshot at a time, from the latest segment to the first
+        Debugger->SearchSnapshot = FindSnapshot(Debugger->Recording, Target - 1);
+        Debugger->SegmentEnd = Target;
+        RestoreSnapshot(Debugger->Recording, Debugger->SearchSnapshot, State);
+    }
+    else {
+        RestoreSnapshot(Debugger->Recording, FindSnapshot(Debugger->Recording, Target), State);
+    }
+}
+
+void StopTravel(debugger *Debugger)
+{
+    Debugger->Travel = TRAVEL_NONE;
+    ClearBreakKind(Debugger, BREAK_TRAVEL);
+}
+
+int DebuggerPrompt(debugger *Debugger, machine_state *State)
+{
+    char buf[256];
+    for(;;)
+    {
+        String_View Command = sv_trim(sv_get_str(buf, sizeof(buf)));
+        String_View Option = NextDebuggerToken(&Command);
+        if(Option.count == 0 || sv_eq_ignorecase(Option, SV("next")) || sv_eq_ignorecase(Option, SV("n"))) {
+            SetStepBreaks(Debugger, State);
+            return 0;
+        }
+        else if(sv_eq_ignorecase(Option, SV("continue")) || sv_eq_ignorecase(Option, SV("c"))) {
+            return 0;
+        }
+        else if(sv_eq_ignorecase(Option, SV("reverse-step")) || sv_eq_ignorecase(Option, SV("rs")) ||
+                sv_eq_ignorecase(Option, SV("reverse-continue")) || sv_eq_ignorecase(Option, SV("rc")))
+        {
+            if(!Debugger->Recording) {
+                printf("Going back is only possible when replaying a recording (use '-replay')\n");
+            }
+            else if(State->Steps == 0) {
+                printf("Already at the start of the program\n");
+            }
+            else if(sv_eq_ignorecase(Option, SV("reverse-step")) || sv_eq_ignorecase(Option, SV("rs"))) {
+                StartTravel(Debugger, State, TRAVEL_TO, State->Steps - 1);
+                return 1;
+            }
+            else {
+                StartTravel(Debugger, State, TRAVEL_SEARCH, State->Steps);
+                return 1;
+            }
+        }
+        else if(sv_eq_ignorecase(Option, SV("help")) || sv_eq_ignorecase(Option, SV("h"))) {
+            ShowStepCommands();
+        }
+        else if(sv_eq_ignorecase(Option, SV("registers")) || sv_eq_ignorecase(Option, SV("r"))) {
+            printf("ACC = %d, IX = %d\n", State->ACC, State->IX);
+        }
+        else if(sv_eq_ignorecase(Option, SV("break")) || sv_eq_ignorecase(Option, SV("b"))) {
+            AddBreakpoint(Debugger, State, Command);
+        }
+        else if(sv_eq_ignorecase(Option, SV("watch")) || sv_eq_ignorecase(Option, SV("w"))) {
+            AddWatchpoint(Debugger, Command);
+        }
+        else if(sv_eq_ignorecase(Option, SV("delete")) || sv_eq_ignorecase(Option, SV("d"))) {
+            DeleteBreakOrWatchpoint(Debugger, Command);
+        }
+        else if(sv_eq_ignorecase(Option, SV("list")) || sv_eq_ignorecase(Option, SV("l"))) {
+            ListBreakAndWatchpoints(Debugger);
+        }
+        else if(sv_eq_ignorecase(Option, SV("print")) || sv_eq_ignorecase(Option, SV("p"))) {
+            PrintLabelData(Debugger, Command);
+        }
+        else if(sv_eq_ignorecase(Option, SV("quit")) || sv_eq_ignorecase(Option, SV("q"))) {
+            exit(0);
+        }
+        else {
+            printf("Unkown command\n");
+        }
+    }
+}
+
+// NOTE(vic): Whether the store about to run writes Cell, and the value it writes
+static int StoresTo(linked_program *Program, int Opcode, instruction *Instruction, machine_state *State,
+                    u32 Cell, long int *Value)
+{
+    file_info *File = Program->Files + Instruction->AddressFileIndex;
+    long int Address = (long int)Cell - (long int)File->FirstCell; // in the file of the operand
+    *Value = State->ACC;
+    switch(Opcode)
+    {
+        case IOP_STX:
+        {
+            return Address >= 0 && Address < (long int)File->LineCount && Address == Instruction->Operand + State->IX;
+        }
+        
+        // NOTE(vic): IX cells from the operand on, COPY's come from the ones from ACC on
+        case IOP_COPY:
+        case IOP_FILL:
+        {
+            long int Offset = Address - Instruction->Operand;
+            if(Address < 0 || Address >= (long int)File->LineCount || Offset < 0 || Offset >= State->IX) return 0;
+            if(Opcode == IOP_COPY) {
+                long int From = State->ACC + Offset;
+                if(From < 0 || From >= (long int)File->LineCount) return 0;
+                *Value = Program->Cells[File->FirstCell + From];
+            }
+            return 1;
+        }
+        
+        // NOTE(vic): IX, only when the cell holds ACC
+        case IOP_CAS:
+        {
+            *Value = State->IX;
+            return Instruction->Target == Cell && Program->Cells[Cell] == State->ACC;
+        }
+        
+        default: return Instruction->Target == Cell;
+    }
+}
+
+// NOTE(vic): Checks the user breakpoints and watchpoints at the instruction about to run
+int ShouldStop(debugger *Debugger, machine_state *State, int Report)
+{
+    linked_program *Program = Debugger->Program;
+    u32 Index = (u32)State->Line;
+    instruction *Instruction = Program->Instructions + Index;
+    u8 Kinds = Debugger->BreakKinds[Index];
+    int Stop = 0;
+    
+    if(Kinds & BREAK_USER) {
+        for(int i = 0; i < MAX_BREAKPOINTS; i++) {
+            breakpoint *Breakpoint = Debugger->Breakpoints + i;
+            if(Breakpoint->Used && Breakpoint->Instruction == Index && BreakpointConditionHolds(Breakpoint, State)) {
+                if(Report) printf("Breakpoint %d, "SV_Fmt"(%u)\n", i + 1,
+                                  SV_Arg(Program->FileNames[Program->InstructionInfo[Index].FileIndex]),
+                                  Program->InstructionInfo[Index].LineInFile);
+                Stop = 1;
+            }
+        }
+    }
+    
+    if(Kinds & BREAK_WATCH) {
+        for(int i = 0; i < MAX_WATCHPOINTS; i++) {
+            watchpoint *Watchpoint = Debugger->Watchpoints + i;
+            long int Value;
+            if(Watchpoint->Used && StoresTo(Program, Debugger->OriginalOpcodes[Index], Instruction, State, Watchpoint->Cell, &Value) &&
+               Program->Cells[Watchpoint->Cell] != Value) {
+                if(Report) printf("Watchpoint %d, '"SV_Fmt"' changes from %ld to %ld\n", MAX_BREAKPOINTS + i + 1,
+                                  SV_Arg(Watchpoint->Name), Program->Cells[Watchpoint->Cell], Value);
+                Stop = 1;
+            }
+        }
+    }
+    return Stop;
+}
+
+// NOTE(vic): Returns 1 once the travel got where it was going
+int Travel(debugger *Debugger, machine_state *State)
+{
+    for(;;)
+    {
+        if(Debugger->Travel == TRAVEL_TO) {
+            if(State->Steps != Debugger->TravelTarget) return 0;
+            
+            StopTravel(Debugger);
+            if(Debugger->Found) ShouldStop(Debugger, State, 1);
+            return 1;
+        }
+        
+        if(State->Steps < Debugger->SegmentEnd) {
+            if(ShouldStop(Debugger, State, 0)) {
+                Debugger->Found = 1;
+                Debugger->TravelTarget = State->Steps;
+            }
+            return 0;
+        }
+        
+        // NOTE(vic): End of the segment, go to the last stop found in it or search the one before
+        if(Debugger->Found) {
+            Debugger->Travel = TRAVEL_TO;
+            RestoreSnapshot(Debugger->Recording, Debugger->SearchSnapshot, State);
+        }
+        else if(Debugger->SearchSnapshot == 0) {
+            printf("No breakpoint or watchpoint was hit before, back at the start\n");
+            Debugger->Travel = TRAVEL_TO;
+            Debugger->TravelTarget = 0;
+            RestoreSnapshot(Debugger->Recording, 0, State);
+        }
+        else {
+            Debugger->SegmentEnd = Debugger->Recording->Snapshots[Debugger->SearchSnapshot].Steps;
+            Debugger->SearchSnapshot--;
+            RestoreSnapshot(Debugger->Recording, Debugger->SearchSnapshot, State);
+        }
+    }
+}
+
+// NOTE(vic): Returns the real opcode to run, going back changes State
+int DebugBreak(debugger *Debugger, machine_state *State)
+{
+    for(;;)
+    {
+        if(Debugger->Travel) {
+            if(!Travel(Debugger, State)) break;
+        }
+        else {
+            if(!(Debugger->BreakKinds[State->Line] & BREAK_STEP) && !ShouldStop(Debugger, State, 1)) break;
+            ClearStepBreaks(Debugger);
+        }
+        
+        ShowInstruction(Debugger->Program, State->Line);
+        if(!DebuggerPrompt(Debugger, State)) break;
+    }
+    return Debugger->OriginalOpcodes[State->Line];
+}
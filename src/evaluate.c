@@ -0,0 +1,509 @@
+// NOTE(vic): main.c includes this once per variant, EVALUATE_WATCHED has every check, EVALUATE_COUNTED
+// only the counts and the others only what EVALUATE_JMP_LIMIT and EVALUATE_PRINT_NUMBERS ask for
+
+#ifndef EVALUATE_WATCHED
+#define EVALUATE_WATCHED 0
+#endif
+#ifndef EVALUATE_COUNTED
+#define EVALUATE_COUNTED 0
+#endif
+
+// NOTE(vic): Only EvaluateWatched runs all the harts of -deterministic (spawn.c)
+#if EVALUATE_WATCHED
+#define Switching IsSet(Flags, ALA_DETERMINISTIC)
+#else
+#define Switching 0
+#endif
+
+#if EVALUATE_WATCHED || EVALUATE_COUNTED
+#define Counting (Stats != 0)
+#define Covering (Coverage != 0)
+#define Profiling (Profile != 0)
+#define CountsJumps 1
+#define PrintsNumbers IsSet(Flags, PRINT_NUMBERS)
+#else
+#define Counting 0
+#define Covering 0
+#define Profiling 0
+#define CountsJumps EVALUATE_JMP_LIMIT
+#define PrintsNumbers EVALUATE_PRINT_NUMBERS
+#endif
+
+static void EVALUATE_NAME(linked_program *Program, int Flags, run_options *Options) {
+    int ACC = 0; // accumulator
+    int IX = 0; // index register
+    int LastCompareResult = 0;
+    u32 CallStack[MAX_CALL_DEPTH];
+    u32 CallDepth = 0;
+    
+    instruction *Instructions = Program->Instructions;
+    long int *Cells = Program->Cells;
+    size_t ProgramLength = Program->InstructionCount;
+    int *JumpCounts = calloc(ProgramLength + 1, sizeof(int));
+    
+#if EVALUATE_WATCHED
+    recording *Recording = Options->Recording;
+    trace *Trace = Options->Trace;
+#else
+    recording *Recording = 0;
+    trace *Trace = 0;
+#endif
+    run_stats *Stats = EVALUATE_WATCHED || EVALUATE_COUNTED ? Options->Stats : 0;
+    u64 *BlockCounts = Stats ? Stats->BlockCounts : 0;
+    coverage *Coverage = EVALUATE_WATCHED || EVALUATE_COUNTED ? Options->Coverage : 0;
+    u8 *CoverageMarks = Coverage ? Coverage->Marks : 0;
+    branch_profile *Profile = EVALUATE_WATCHED || EVALUATE_COUNTED ? Options->Profile : 0;
+    cycle_model *Cycles = EVALUATE_WATCHED || EVALUATE_COUNTED ? Options->Cycles : 0;
+    if(Trace) {
+        BeginTrace(Trace);
+    }
+    
+    u64 Steps = 0;
+    u64 NextSnapshotStep = Recording ? BeginRecordedRun(Recording, JumpCounts, CallStack) : ~(u64)0;
+    debugger *Debugger = EVALUATE_WATCHED && IsSet(Flags, ALA_DEBUG) ? StartDebugger(Program, Recording) : 0;
+    // NOTE(vic): Whole loops and calls at once would skip what these have to see instruction by instruction
+    int RunsInOneGo = IsSet(Flags, ALA_OPTIMIZE) && !Debugger && !Recording && !Trace && !SpawnsHarts(Program);
+    // NOTE(vic): -stats counts every instruction, a memoized call doesn't say which ones it skipped
+    memo_table *Memo = RunsInOneGo && !Counting ? StartMemo(Program) : 0;
+    idiom_table *Idioms = RunsInOneGo ? StartIdioms(Program) : 0;
+    expectation *Expect = Options->Expect;
+    if(Idioms && Expect) Idioms->OutputsChecked = 1;
+    
+    run_snapshot *Snapshot = Options->Snapshot;
+    size_t FirstLine = Program->EntryPoint;
+    if(Snapshot && Snapshot->Taken) {
+        machine_state State = { .CallStack = CallStack };
+        StartFromSnapshot(Snapshot, Program, &State, JumpCounts);
+        ACC = State.ACC;
+        IX = State.IX;
+        LastCompareResult = State.LastCompareResult;
+        CallDepth = State.CallDepth;
+        FirstLine = State.Line;
+        Steps = State.Steps;
+    }
+    hart *Hart = Options->Hart;
+    u64 SwitchAt = ~(u64)0;
+    if(Hart) {
+        ACC = Hart->State.ACC;
+        IX = Hart->State.IX;
+        FirstLine = Hart->State.Line;
+    }
+    CountBlock(FirstLine);
+    MarkFlow(FirstLine, COVERAGE_ARRIVED);
+    
+    run:
+    for(size_t line = FirstLine;
+        line < ProgramLength;
+        line++, Steps++)
+    {
+        instruction *I = Instructions + line;
+        int Opcode = I->Opcode;
+        if(Trace) TraceInstruction(Trace, line, ACC, IX);
+        
+        execute:
+        switch(Opcode)
+        {
+            case IOP_LDM:
+            {
+                ACC = I->Operand;
+            } break;
+            
+            case IOP_LDD:
+            {
+                CheckTarget(I);
+                ACC = Cells[I->Target];
+            } break;
+            
+            case IOP_LDI:
+            {
+                CheckTarget(I);
+                
+                size_t Address = Cells[I->Target];
+                CheckAddress(I, Address, 
+                             "\nAddress %zd (from data in address %zd in file "SV_Fmt") not in program",
+                             Address, (size_t)InfoOf(Program, I)->Operand, SV_Arg(Program->FileNames[I->AddressFileIndex]));
+                CheckDataInAddress(I, Address,
+                                   "\nNOTE: Remember LDI is for indirect addressing");
+                
+                ACC = CellAt(I, Address);
+            } break;
+            
+            case IOP_LDX:
+            {
+                size_t Address = (size_t)I->Operand + IX;
+                
+                CheckAddress(I, Address, 
+                             "\nNOTE: Address is %zd (%zd + IX) in file "SV_Fmt, Address, Address - IX,
+                             SV_Arg(Program->FileNames[I->AddressFileIndex]));
+                CheckDataInAddress(I, Address, 
+                                   "\nNOTE: Remember LDX is for indexed addressing.\n"
+                                   "So the address is %zd + IX", Address - IX);
+                
+                ACC = CellAt(I, Address);
+            } break;
+            
+            case IOP_LDR:
+            {
+                IX = I->Operand;
+            } break;
+            
+            case IOP_STO:
+            {
+                CheckTarget(I);
+                Cells[I->Target] = ACC;
+            } break;
+            
+            case IOP_STX:
+            {
+                size_t Address = (size_t)I->Operand + IX;
+                
+                CheckAddress(I, Address, 
+                             "\nNOTE: Address is %zd (%zd + IX) in file "SV_Fmt, 
+                             Address, Address - IX, SV_Arg(Program->FileNames[I->AddressFileIndex]));
+                CheckStoreDataInAddress(I, Address, 
+                                        "\nNOTE: Remember STX is for indexed addressing.\n"
+                                        "So the address is %zd + IX", Address - IX);
+                
+                CellAt(I, Address) = ACC;
+            } break;
+            
+            case IOP_STI:
+            {
+                CheckTarget(I);
+                
+                size_t Address = Cells[I->Target];
+                CheckAddress(I, Address, 
+                             "\nAddress %zd (from data in address %zd) not in program",
+                             Address, (size_t)InfoOf(Program, I)->Operand);
+                CheckStoreDataInAddress(I, Address,
+                                        "\nNOTE: Remember LDI is for indirect addressing");
+                
+                Cells[I->Target] = ACC;
+            } break;
+            
+            case IOP_ADD:
+            {
+                CheckTarget(I);
+                ACC += Cells[I->Target];
+            } break;
+            
+            case IOP_JMP:
+            {
+                JumpToLine();
+            } break;
+            
+            case IOP_CMP: // immediate + direct
+            {
+                if(I->Immediate) {
+                    LastCompareResult = CompareValues(ACC, I->Operand);
+                }
+                else {
+                    CheckTarget(I);
+                    LastCompareResult = CompareValues(ACC, Cells[I->Target]);
+                }
+            } break;
+            
+            case IOP_JPE:
+            {
+                if(LastCompareResult & COMPARED_EQUAL) { JumpToLine(); }
+                else { CountBlock(line + 1); MarkFlow(line, COVERAGE_FELL_THROUGH); }
+            } break;
+            
+            case IOP_JPN:
+            {
+                if(!(LastCompareResult & COMPARED_EQUAL)) { JumpToLine(); }
+                else { CountBlock(line + 1); MarkFlow(line, COVERAGE_FELL_THROUGH); }
+            } break;
+            
+            case IOP_INP:
+            {
+                ACC = Recording ? RecordedInput(Recording, Steps) : (int)getchar();
+            } break;
+            
+            case IOP_OUT:
+            {
+                if(Recording && !RecordedOutput(Recording, Steps, ACC)) {
+                    // NOTE(vic): Already printed before going back
+                }
+                else if(Expect) {
+                    ExpectOutput(Expect, Program, I, ACC, PrintsNumbers);
+                }
+                else if(PrintsNumbers) {
+                    printf("%d\n", ACC);
+                }
+                else {
+                    putchar((char)ACC);
+                }
+            } break;
+            
+            case IOP_AND: // immediate + direct
+            {
+                if(I->Immediate) {
+                    ACC = ACC & I->Operand;
+                }
+                else {
+                    CheckTarget(I);
+                    ACC = ACC & Cells[I->Target];
+                }
+            } break;
+            
+            case IOP_XOR: // immediate + direct
+            {
+                if(I->Immediate) {
+                    ACC = ACC ^ I->Operand;
+                }
+                else {
+                    CheckTarget(I);
+                    ACC = ACC ^ Cells[I->Target];
+                }
+            } break;
+            
+            case IOP_OR: // immediate + direct
+            {
+                if(I->Immediate) {
+                    ACC = ACC | I->Operand;
+                }
+                else {
+                    CheckTarget(I);
+                    ACC = ACC | Cells[I->Target];
+                }
+            } break;
+            
+            case IOP_LSL:
+            {
+                ACC = ACC << I->Operand;
+            } break;
+            
+            case IOP_LSR:
+            {
+                ACC = ACC >> I->Operand;
+            } break;
+            
+            // NOTE(vic): Exit loop
+            case IOP_END:
+            {
+                if(Covering) CoverageMarks[line] |= COVERAGE_LEFT;
+                line = ProgramLength;
+            } break;
+            
+            case IOP_ACCINC: ACC++; break;
+            case IOP_ACCDEC: ACC--; break;
+            case IOP_IXINC: IX++; break;
+            case IOP_IXDEC: IX--; break;
+            
+            case IOP_CALL:
+            {
+                CheckSnapshot();
+                CheckTarget(I);
+                CheckJumpLimit(I);
+                PushCall();
+                CountJump(I->Target);
+                MarkFlow(line, COVERAGE_JUMPED);
+                line = (size_t)I->Target - 1;
+                CheckHartSwitch();
+            } break;
+            
+            case IOP_RETURN:
+            {
+                if(Covering) CoverageMarks[line] |= COVERAGE_LEFT;
+                PopCall();
+                CountJump(line + 1);
+                MarkFlow(line + 1, COVERAGE_ARRIVED);
+                CheckHartSwitch();
+            } break;
+            
+            case IOP_SPAWN:
+            {
+                CheckTarget(I);
+                if(!Hart) Hart = StartHarts(Program, Flags, Options, I, Switching);
+                CountBlock(I->Target);
+                MarkFlow(I->Target, COVERAGE_ARRIVED);
+                ACC = (int)SpawnHart(Hart, I, ACC, IX);
+                if(Switching && SwitchAt == ~(u64)0) SwitchAt = Steps + HART_SLICE;
+            } break;
+            
+            case IOP_JOIN:
+            {
+                if(Hart && !JoinHarts(Hart) && Switching) {
+                    // NOTE(vic): JOIN again on its next turn
+                    SwitchHartAt(line);
+                }
+            } break;
+            
+            case IOP_CAS:
+            {
+                CheckTarget(I);
+                long int Held = AtomicCompareSwap(Cells + I->Target, ACC, IX);
+                LastCompareResult = CompareValues(Held, ACC);
+                ACC = (int)Held;
+            } break;
+            
+            // NOTE(vic): In 32 bits, wrapping around like ADD does
+            case IOP_SUB: // immediate + direct
+            {
+                if(I->Immediate) {
+                    ACC = (int)((u32)ACC - (u32)I->Operand);
+                }
+                else {
+                    CheckTarget(I);
+                    ACC = (int)((u32)ACC - (u32)Cells[I->Target]);
+                }
+            } break;
+            
+            case IOP_MUL: // immediate + direct
+            {
+                if(I->Immediate) {
+                    ACC = (int)((u32)ACC*(u32)I->Operand);
+                }
+                else {
+                    CheckTarget(I);
+                    ACC = (int)((u32)ACC*(u32)Cells[I->Target]);
+                }
+            } break;
+            
+            case IOP_DIV: ACC = DivideValues(Program, I, IOP_DIV, ACC); break; // immediate + direct
+            case IOP_MOD: ACC = DivideValues(Program, I, IOP_MOD, ACC); break; // immediate + direct
+            
+            case IOP_JPG:
+            {
+                if(LastCompareResult & COMPARED_GREATER) { JumpToLine(); }
+                else { CountBlock(line + 1); MarkFlow(line, COVERAGE_FELL_THROUGH); }
+            } break;
+            
+            case IOP_JPL:
+            {
+                if(LastCompareResult & COMPARED_LESS) { JumpToLine(); }
+                else { CountBlock(line + 1); MarkFlow(line, COVERAGE_FELL_THROUGH); }
+            } break;
+            
+            case IOP_COPY: CopyBlock(Program, I, ACC, IX); CountCellAccesses(2*IX); break;
+            case IOP_FILL: FillBlock(Program, I, ACC, IX); CountCellAccesses(IX); break;
+            
+            // case IOP_JMI: // indirect jump
+            
+            case IOP_BREAK:
+            {
+                machine_state State = { ACC, IX, LastCompareResult, CallStack, CallDepth, line, Steps };
+                Opcode = DebugBreak(Debugger, &State);
+                
+                // NOTE(vic): Going back (-replay) restores an earlier state
+                ACC = State.ACC;
+                IX = State.IX;
+                LastCompareResult = State.LastCompareResult;
+                CallDepth = State.CallDepth;
+                line = State.Line;
+                Steps = State.Steps;
+                I = Instructions + line;
+                goto execute;
+            }
+            
+            case IOP_IDIOM:
+            {
+                machine_state State = { ACC, IX, LastCompareResult, CallStack, CallDepth, line, Steps };
+                if(!RunIdiom(Idioms, &State, JumpCounts, Flags)) {
+                    // NOTE(vic): The loop runs normally from now on
+                    Opcode = I->Opcode;
+                    goto execute;
+                }
+                
+                // NOTE(vic): The jump back was taken every time around but the last
+                u64 Iterations = (State.Steps - Steps + 1)/(State.Line - line + 1);
+                if(Counting) {
+                    Stats->SkippedSteps += State.Steps - Steps;
+                    Stats->Jumps += Iterations - 1;
+                    BlockCounts[line] += Iterations - 1;
+                    BlockCounts[State.Line + 1]++;
+                }
+                if(Covering || Profiling) {
+                    MarkFlow(State.Line, COVERAGE_FELL_THROUGH);
+                    if(Covering && Iterations > 1) CoverageMarks[State.Line] |= COVERAGE_JUMPED;
+                    if(Profiling) Profile->Counts[COVERAGE_JUMPED][State.Line] += Iterations - 1;
+                }
+                ACC = State.ACC;
+                IX = State.IX;
+                LastCompareResult = State.LastCompareResult;
+                line = State.Line;
+                Steps = State.Steps;
+            } break;
+            
+            case IOP_MEMO_CALL:
+            {
+                CheckJumpLimit(I);
+                PushCall();
+                machine_state State = { ACC, IX, LastCompareResult, CallStack, CallDepth, line, Steps };
+                if(CallMemoized(Memo, &State, JumpCounts, Flags)) {
+                    CountBlock(line + 1);
+                    MarkFlow(line, COVERAGE_FELL_THROUGH);
+                    ACC = State.ACC;
+                    IX = State.IX;
+                    LastCompareResult = State.LastCompareResult;
+                    Steps = State.Steps;
+                    CallDepth--;
+                }
+                else {
+                    CountJump(I->Target);
+                    MarkFlow(line, COVERAGE_JUMPED);
+                    line = (size_t)I->Target - 1;
+                }
+            } break;
+            
+            case IOP_MEMO_RETURN:
+            {
+                machine_state State = { ACC, IX, LastCompareResult, CallStack, CallDepth, line, Steps };
+                ReturnMemoized(Memo, &State, JumpCounts);
+                if(Covering) CoverageMarks[line] |= COVERAGE_LEFT;
+                PopCall();
+                CountJump(line + 1);
+                MarkFlow(line + 1, COVERAGE_ARRIVED);
+            } break;
+            
+            case IOP_SNAPSHOT:
+            {
+                machine_state State = { ACC, IX, LastCompareResult, CallStack, CallDepth, line, Steps };
+                TakeSnapshot(Snapshot, Program, &State, JumpCounts);
+                line = ProgramLength - 1;
+            } break;
+            
+            default:
+            {
+                assert(0 && "This shouldn't happen");
+            } break;
+        }
+    }
+    if(Hart) {
+        // NOTE(vic): Waits for the harts it spawned, or with -deterministic goes on with another one
+        machine_state State = { ACC, IX, LastCompareResult, CallStack, CallDepth, ProgramLength, Steps };
+        Hart = EndHart(Hart, &State, &JumpCounts);
+        if(Switching && Hart) {
+            GoOnAsHart();
+            FirstLine = State.Line;
+            goto run;
+        }
+    }
+    
+    StopDebugger(Debugger);
+    StopIdioms(Idioms);
+    if(Memo && IsSet(Flags, ALA_MEMO_STATS)) {
+        PrintMemoStats(Memo);
+    }
+    StopMemo(Memo);
+    if(Recording) {
+        EndRecordedRun(Recording, Steps);
+    }
+    if(Trace) {
+        EndTrace(Trace);
+    }
+    free(JumpCounts);
+}
+
+#undef Switching
+#undef Counting
+#undef Covering
+#undef Profiling
+#undef CountsJumps
+#undef PrintsNumbers
+#undef EVALUATE_NAME
+#undef EVALUATE_WATCHED
+#undef EVALUATE_COUNTED
+#undef EVALUATE_JMP_LIMIT
+#undef EVALUATE_PRINT_NUMBERS
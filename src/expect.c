@@ -0,0 +1,79 @@
+// NOTE(vic): -expect=<file>, every OUT is checked against the file and the first byte that differs stops the run
+
+typedef struct {
+    const char *Path;
+    String_View Expected;
+    size_t At; // bytes matched so far
+} expectation;
+
+expectation *StartExpectation(const char *Path)
+{
+    String_View Expected = sv_ReadEntireFile(Path);
+    if(!Expected.data) {
+        fprintf(stderr, "ERROR: Could not read file %s: %s\n", Path, strerror(errno));
+        exit(1);
+    }
+    expectation *Expect = malloc(sizeof(expectation));
+    Expect->Path = Path;
+    Expect->Expected = Expected;
+    Expect->At = 0;
+    return Expect;
+}
+
+static void ShowOutputByte(const char *What, int c)
+{
+    if(c >= 32 && c < 127) fprintf(stderr, "%s '%c' (%d)", What, c, c);
+    else fprintf(stderr, "%s %d", What, c);
+}
+
+// NOTE(vic): Called by Evaluate for each OUT instead of printing
+void ExpectOutput(expectation *Expect, linked_program *Program, instruction *I, int ACC, int PrintNumbers)
+{
+    char Text[16];
+    size_t Size = 1;
+    if(PrintNumbers) Size = (size_t)snprintf(Text, sizeof(Text), "%d\n", ACC);
+    else Text[0] = (char)ACC;
+    
+    for(size_t i = 0; i < Size; i++)
+    {
+        size_t At = Expect->At + i;
+        if(At < Expect->Expected.count && Expect->Expected.data[At] == Text[i]) continue;
+        
+        fwrite(Text, 1, i, stdout);
+        fflush(stdout);
+        instruction_info *Info = InfoOf(Program, I);
+        fprintf(stderr, "\n"SV_Fmt"(%u): ERROR: ", SV_Arg(Program->FileNames[Info->FileIndex]), Info->LineInFile);
+        if(At < Expect->Expected.count) {
+            fprintf(stderr, "Output differs from %s at byte %zu, ", Expect->Path, At);
+            ShowOutputByte("expected", (u8)Expect->Expected.data[At]);
+            ShowOutputByte(" but OUT printed", (u8)Text[i]);
+        }
+        else {
+            fprintf(stderr, "Output goes on past the end of %s (%zu bytes), ", Expect->Path, At);
+            ShowOutputByte("OUT printed", (u8)Text[i]);
+        }
+        if(Program->Lines) {
+            String_View Line = Program->Lines[Program->Files[Info->FileIndex].FirstCell + Info->LineInFile];
+            fprintf(stderr, "\nNOTE: The line is '"SV_Fmt"'", SV_Arg(sv_trim(Line)));
+        }
+        FailAt(Program, I);
+    }
+    
+    fwrite(Text, 1, Size, stdout);
+    Expect->At += Size;
+}
+
+// NOTE(vic): Called when the program ends without an error, it has to have printed everything
+void EndExpectation(expectation *Expect)
+{
+    size_t At = Expect->At;
+    size_t Count = Expect->Expected.count;
+    const char *Path = Expect->Path;
+    free((char *)Expect->Expected.data);
+    free(Expect);
+    if(At < Count) {
+        fflush(stdout);
+        fprintf(stderr, "\nERROR: The program ended after printing %zu bytes, %s has %zu", At, Path, Count);
+        Fail();
+    }
+}
@@ -2,8 +2,13 @@
 #include <io.h>
 #define F_OK 0
 #define access _access
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
 #else // linux
 #include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 #endif
 
 // NOTE(vic): Credit to Tsoding
@@ -112,3 +117,56 @@ String_View sv_ReadEntireFile(const char *FilePath)
     
     return SV_NULL;
 }
+
+
+// NOTE(vic): Private (copy-on-write) mapping, writes to the memory never reach the file
+void *MapEntireFile(const char *FilePath, size_t *Size)
+{
+    void *Result = NULL;
+#ifdef _WIN32
+    HANDLE File = CreateFileA(FilePath, GENERIC_READ, FILE_SHARE_READ, NULL,
+                              OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+    if(File == INVALID_HANDLE_VALUE) {
+        return NULL;
+    }
+    
+    LARGE_INTEGER FileSize;
+    if(GetFileSizeEx(File, &FileSize) && FileSize.QuadPart > 0) {
+        HANDLE Mapping = CreateFileMappingA(File, NULL, PAGE_WRITECOPY, 0, 0, NULL);
+        if(Mapping) {
+            Result = MapViewOfFile(Mapping, FILE_MAP_COPY, 0, 0, 0);
+            CloseHandle(Mapping);
+            if(Size) *Size = (size_t)FileSize.QuadPart;
+        }
+    }
+    CloseHandle(File);
+#else
+    int fd = open(FilePath, O_RDONLY);
+    if(fd < 0) {
+        return NULL;
+    }
+    
+    struct stat st;
+    if(fstat(fd, &st) == 0 && st.st_size > 0) {
+        Result = mmap(NULL, st.st_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+        if(Result == MAP_FAILED) {
+            Result = NULL;
+        }
+        else if(Size) {
+            *Size = (size_t)st.st_size;
+        }
+    }
+    close(fd);
+#endif
+    return Result;
+}
+
+void UnmapEntireFile(void *Memory, size_t Size)
+{
+#ifdef _WIN32
+    (void)Size;
+    UnmapViewOfFile(Memory);
+#else
+    munmap(Memory, Size);
+#endif
+}
\ No newline at end of file
@@ -0,0 +1,544 @@
+// NOTE(vic): -O runs counted loops (mult.ala, div.ala) and scans (print.ala) in one go from an
+// IOP_IDIOM at their head. One it can't run puts the real opcode back and runs normally.
+
+#define IDIOM_MAX_VARIABLES 8 // ACC, IX and cells stored to in the loop
+#define IDIOM_MAX_TERMS 4
+
+#define VARIABLE_ACC 0
+#define VARIABLE_IX 1
+
+typedef enum {
+    IDIOM_COUNTED,
+    IDIOM_SCAN,
+} idiom_kind;
+
+typedef enum {
+    SYMBOLIC_AFFINE, // Scale*Base + Offset
+    SYMBOLIC_SIGN, // (Scale*Base + Offset) & 0x80000000
+    SYMBOLIC_UNKNOWN,
+} symbolic_kind;
+
+// NOTE(vic): Constant + the sum of Scales[i]*Cells[i], all cells the loop doesn't store to
+typedef struct {
+    u32 Constant;
+    int TermCount;
+    u32 Cells[IDIOM_MAX_TERMS];
+    s32 Scales[IDIOM_MAX_TERMS];
+} invariant_sum;
+
+typedef struct {
+    symbolic_kind Kind;
+    int Base; // variable, as it was at the start of the iteration, -1 if none
+    s32 Scale; // 1 or -1
+    invariant_sum Offset;
+} symbolic_value;
+
+typedef struct {
+    idiom_kind Kind;
+    u32 Head;
+    u32 End; // the JPE/JPN back to Head
+    u8 OriginalOpcode;
+    u8 ExitWhenEqual; // JPN loops end when the compare is true
+    
+    // NOTE(vic): IDIOM_COUNTED
+    int VariableCount;
+    u32 VariableCells[IDIOM_MAX_VARIABLES]; // from variable 2, 0 is ACC and 1 is IX
+    symbolic_value Final[IDIOM_MAX_VARIABLES]; // at the end of an iteration
+    symbolic_value Compared; // ACC in the last CMP
+    
+    // NOTE(vic): Right side of the last CMP, both kinds
+    int CompareImmediate;
+    long int CompareOperand;
+    u32 CompareCell;
+    
+    // NOTE(vic): IDIOM_SCAN
+    u32 Load; // the LDX
+    int Outputs;
+    int IXStep;
+    int StepBeforeLoad;
+} loop_idiom;
+
+typedef struct {
+    linked_program *Program;
+    loop_idiom *Idioms;
+    u32 IdiomCount;
+    u32 *IdiomAt; // idiom + 1 for heads, 0 otherwise
+    int OutputsChecked; // -expect, loops that print run normally so each OUT is checked
+} idiom_table;
+
+static symbolic_value SymbolicConstant(u32 Value)
+{
+    symbolic_value Result = { SYMBOLIC_AFFINE, -1, 1 };
+    Result.Offset.Constant = Value;
+    return Result;
+}
+
+static symbolic_value SymbolicUnknown(void)
+{
+    symbolic_value Result = { SYMBOLIC_UNKNOWN, -1, 1 };
+    return Result;
+}
+
+static int AddTerm(invariant_sum *Sum, u32 Cell, s32 Scale)
+{
+    for(int i = 0; i < Sum->TermCount; i++) {
+        if(Sum->Cells[i] == Cell) {
+            Sum->Scales[i] += Scale;
+            return 1;
+        }
+    }
+    if(Sum->TermCount == IDIOM_MAX_TERMS) return 0;
+    Sum->Cells[Sum->TermCount] = Cell;
+    Sum->Scales[Sum->TermCount++] = Scale;
+    return 1;
+}
+
+static symbolic_value AddSymbolic(symbolic_value a, symbolic_value b)
+{
+    if(a.Kind != SYMBOLIC_AFFINE || b.Kind != SYMBOLIC_AFFINE) return SymbolicUnknown();
+    if(a.Base >= 0 && b.Base >= 0) return SymbolicUnknown();
+    if(a.Base < 0) {
+        a.Base = b.Base;
+        a.Scale = b.Scale;
+    }
+    a.Offset.Constant += b.Offset.Constant;
+    for(int i = 0; i < b.Offset.TermCount; i++) {
+        if(!AddTerm(&a.Offset, b.Offset.Cells[i], b.Offset.Scales[i])) return SymbolicUnknown();
+    }
+    return a;
+}
+
+// NOTE(vic): ~x == -x - 1
+static symbolic_value NotSymbolic(symbolic_value a)
+{
+    if(a.Kind != SYMBOLIC_AFFINE) return SymbolicUnknown();
+    a.Scale = -a.Scale;
+    a.Offset.Constant = ~a.Offset.Constant;
+    for(int i = 0; i < a.Offset.TermCount; i++) {
+        a.Offset.Scales[i] = -a.Offset.Scales[i];
+    }
+    return a;
+}
+
+static int FindVariable(loop_idiom *Idiom, u32 Cell)
+{
+    for(int v = 2; v < Idiom->VariableCount; v++) {
+        if(Idiom->VariableCells[v] == Cell) return v;
+    }
+    return -1;
+}
+
+static symbolic_value ReadCell(loop_idiom *Idiom, symbolic_value *Variables, u32 Cell)
+{
+    int Variable = FindVariable(Idiom, Cell);
+    if(Variable >= 0) return Variables[Variable];
+    
+    symbolic_value Result = SymbolicConstant(0);
+    AddTerm(&Result.Offset, Cell, 1);
+    return Result;
+}
+
+static int IsCellInstruction(int Opcode)
+{
+    return (Opcode == IOP_LDD || Opcode == IOP_STO || Opcode == IOP_ADD);
+}
+
+// NOTE(vic): A variable that only adds the same amount every iteration
+static int IsInduction(loop_idiom *Idiom, int Variable)
+{
+    return Idiom->Final[Variable].Base == Variable;
+}
+
+static int AnalyzeCountedLoop(linked_program *Program, loop_idiom *Idiom)
+{
+    Idiom->VariableCount = 2;
+    for(u32 i = Idiom->Head; i < Idiom->End; i++) {
+        instruction *Instruction = Program->Instructions + i;
+        if(IsCellInstruction(Instruction->Opcode) && Instruction->Target == INVALID_TARGET) return 0;
+        if(!Instruction->Immediate && Instruction->Opcode == IOP_CMP &&
+           Instruction->Target == INVALID_TARGET) return 0;
+        if(Instruction->Opcode == IOP_STO && FindVariable(Idiom, Instruction->Target) < 0) {
+            if(Idiom->VariableCount == IDIOM_MAX_VARIABLES) return 0;
+            Idiom->VariableCells[Idiom->VariableCount++] = Instruction->Target;
+        }
+    }
+    
+    symbolic_value Variables[IDIOM_MAX_VARIABLES];
+    for(int v = 0; v < Idiom->VariableCount; v++) {
+        Variables[v] = SymbolicConstant(0);
+        Variables[v].Base = v;
+    }
+    
+    int Compared = 0;
+    symbolic_value *ACC = Variables + VARIABLE_ACC;
+    symbolic_value *IX = Variables + VARIABLE_IX;
+    for(u32 i = Idiom->Head; i < Idiom->End; i++)
+    {
+        instruction *Instruction = Program->Instructions + i;
+        switch(Instruction->Opcode)
+        {
+            case IOP_LDM: *ACC = SymbolicConstant((u32)Instruction->Operand); break;
+            case IOP_LDR: *IX = SymbolicConstant((u32)Instruction->Operand); break;
+            case IOP_LDD: *ACC = ReadCell(Idiom, Variables, Instruction->Target); break;
+            case IOP_ADD: *ACC = AddSymbolic(*ACC, ReadCell(Idiom, Variables, Instruction->Target)); break;
+            case IOP_ACCINC: *ACC = AddSymbolic(*ACC, SymbolicConstant(1)); break;
+            case IOP_ACCDEC: *ACC = AddSymbolic(*ACC, SymbolicConstant((u32)-1)); break;
+            case IOP_IXINC: *IX = AddSymbolic(*IX, SymbolicConstant(1)); break;
+            case IOP_IXDEC: *IX = AddSymbolic(*IX, SymbolicConstant((u32)-1)); break;
+            
+            case IOP_STO:
+            {
+                if(ACC->Kind != SYMBOLIC_AFFINE) return 0;
+                Variables[FindVariable(Idiom, Instruction->Target)] = *ACC;
+            } break;
+            
+            case IOP_XOR:
+            {
+                *ACC = (Instruction->Immediate && (u32)Instruction->Operand == 0xFFFFFFFF) ?
+                    NotSymbolic(*ACC) : SymbolicUnknown();
+            } break;
+            
+            case IOP_AND:
+            {
+                if(Instruction->Immediate && Instruction->Operand == 0x80000000 && ACC->Kind == SYMBOLIC_AFFINE) {
+                    ACC->Kind = SYMBOLIC_SIGN;
+                }
+                else {
+                    *ACC = SymbolicUnknown();
+                }
+            } break;
+            
+            case IOP_OR:
+            case IOP_LSL:
+            case IOP_LSR:
+            {
+                *ACC = SymbolicUnknown();
+            } break;
+            
+            case IOP_CMP:
+            {
+                Compared = 1;
+                Idiom->Compared = *ACC;
+                Idiom->CompareImmediate = Instruction->Immediate;
+                Idiom->CompareOperand = Instruction->Operand;
+                Idiom->CompareCell = Instruction->Target;
+                if(!Instruction->Immediate && FindVariable(Idiom, Instruction->Target) >= 0) return 0;
+            } break;
+            
+            default: return 0;
+        }
+    }
+    if(!Compared) return 0;
+    
+    for(int v = 0; v < Idiom->VariableCount; v++) {
+        Idiom->Final[v] = Variables[v];
+        if(Variables[v].Kind != SYMBOLIC_AFFINE) return 0;
+    }
+    
+    // NOTE(vic): Every value has to come from an induction (or nothing) in a few iterations
+    for(int v = 0; v < Idiom->VariableCount; v++) {
+        int Variable = v;
+        int Depth = 0;
+        while(Idiom->Final[Variable].Base >= 0 && !IsInduction(Idiom, Variable)) {
+            Variable = Idiom->Final[Variable].Base;
+            if(++Depth > Idiom->VariableCount) return 0;
+        }
+        if(Idiom->Final[Variable].Base >= 0 && Idiom->Final[Variable].Scale != 1) return 0;
+    }
+    
+    symbolic_value *Value = &Idiom->Compared;
+    if(Value->Kind == SYMBOLIC_UNKNOWN) return 0;
+    if(Value->Base >= 0 && !IsInduction(Idiom, Value->Base)) return 0;
+    if(Value->Kind == SYMBOLIC_SIGN && !(Idiom->CompareImmediate && Idiom->CompareOperand == 0)) return 0;
+    return 1;
+}
+
+// NOTE(vic): LDX, then OUT, INC/DEC IX and CMP in any order (the IX change can also come first)
+static int AnalyzeScanLoop(linked_program *Program, loop_idiom *Idiom)
+{
+    int Loads = 0;
+    int Steps = 0;
+    int Compares = 0;
+    for(u32 i = Idiom->Head; i < Idiom->End; i++)
+    {
+        instruction *Instruction = Program->Instructions + i;
+        switch(Instruction->Opcode)
+        {
+            case IOP_LDX:
+            {
+                Loads++;
+                Idiom->Load = i;
+            } break;
+            
+            case IOP_OUT:
+            {
+                if(!Loads) return 0;
+                Idiom->Outputs++;
+            } break;
+            
+            case IOP_IXINC:
+            case IOP_IXDEC:
+            {
+                Steps++;
+                Idiom->IXStep = Instruction->Opcode == IOP_IXINC ? 1 : -1;
+                Idiom->StepBeforeLoad = !Loads;
+            } break;
+            
+            case IOP_CMP:
+            {
+                if(!Loads) return 0;
+                if(!Instruction->Immediate && Instruction->Target == INVALID_TARGET) return 0;
+                Compares++;
+                Idiom->CompareImmediate = Instruction->Immediate;
+                Idiom->CompareOperand = Instruction->Operand;
+                Idiom->CompareCell = Instruction->Target;
+            } break;
+            
+            default: return 0;
+        }
+    }
+    return (Loads == 1 && Steps == 1 && Compares == 1 && Idiom->Outputs <= 1);
+}
+
+idiom_table *StartIdioms(linked_program *Program)
+{
+    u32 Count = Program->InstructionCount;
+    idiom_table *Table = calloc(1, sizeof(idiom_table));
+    Table->Program = Program;
+    Table->Idioms = calloc(Count + 1, sizeof(loop_idiom));
+    Table->IdiomAt = calloc(Count + 1, sizeof(u32));
+    
+    for(u32 End = 0; End < Count; End++)
+    {
+        instruction *Jump = Program->Instructions + End;
+        if(Jump->Opcode != IOP_JPE && Jump->Opcode != IOP_JPN) continue;
+        u32 Head = Jump->Target;
+        if(Head == INVALID_TARGET || Head > End || Table->IdiomAt[Head]) continue;
+        
+        loop_idiom *Idiom = Table->Idioms + Table->IdiomCount;
+        memset(Idiom, 0, sizeof(loop_idiom));
+        Idiom->Head = Head;
+        Idiom->End = End;
+        Idiom->OriginalOpcode = Program->Instructions[Head].Opcode;
+        Idiom->ExitWhenEqual = Jump->Opcode == IOP_JPN;
+        if(AnalyzeCountedLoop(Program, Idiom)) {
+            Idiom->Kind = IDIOM_COUNTED;
+        }
+        else {
+            memset(Idiom, 0, sizeof(loop_idiom));
+            Idiom->Head = Head;
+            Idiom->End = End;
+            Idiom->OriginalOpcode = Program->Instructions[Head].Opcode;
+            Idiom->ExitWhenEqual = Jump->Opcode == IOP_JPN;
+            if(!AnalyzeScanLoop(Program, Idiom)) continue;
+            Idiom->Kind = IDIOM_SCAN;
+        }
+        Table->IdiomAt[Head] = ++Table->IdiomCount;
+    }
+    
+    if(!Table->IdiomCount) {
+        free(Table->Idioms);
+        free(Table->IdiomAt);
+        free(Table);
+        return 0;
+    }
+    for(u32 i = 0; i < Table->IdiomCount; i++) {
+        Program->Instructions[Table->Idioms[i].Head].Opcode = IOP_IDIOM;
+    }
+    return Table;
+}
+
+void StopIdioms(idiom_table *Table)
+{
+    if(!Table) return;
+    
+    for(u32 i = 0; i < Table->IdiomCount; i++) {
+        Table->Program->Instructions[Table->Idioms[i].Head].Opcode = Table->Idioms[i].OriginalOpcode;
+    }
+    free(Table->Idioms);
+    free(Table->IdiomAt);
+    free(Table);
+}
+
+static u32 EvaluateSum(invariant_sum *Sum, long int *Cells)
+{
+    u32 Result = Sum->Constant;
+    for(int i = 0; i < Sum->TermCount; i++) {
+        Result += (u32)Sum->Scales[i]*(u32)Cells[Sum->Cells[i]];
+    }
+    return Result;
+}
+
+// NOTE(vic): Entry has the values before the first iteration, everything wraps like an int
+static u32 ValueAfter(loop_idiom *Idiom, u32 *Entry, long int *Cells, int Variable, u64 Iterations)
+{
+    if(Iterations == 0) return Entry[Variable];
+    
+    symbolic_value *Value = Idiom->Final + Variable;
+    u32 Offset = EvaluateSum(&Value->Offset, Cells);
+    if(Value->Base < 0) return Offset;
+    if(Value->Base == Variable) return Entry[Variable] + (u32)Iterations*Offset;
+    return (u32)Value->Scale*ValueAfter(Idiom, Entry, Cells, Value->Base, Iterations - 1) + Offset;
+}
+
+// NOTE(vic): Inverse of an odd number modulo 2^32 (Newton's method, each step doubles the bits)
+static u32 InverseOdd(u32 Value)
+{
+    u32 Result = Value;
+    for(int i = 0; i < 5; i++) {
+        Result *= 2 - Value*Result;
+    }
+    return Result;
+}
+
+// NOTE(vic): First k (from 1) the loop ends in when iteration k compares P + (k - 1)*Q, 0 for never
+static u64 SolveIterations(loop_idiom *Idiom, u32 P, u32 Q, long int Right)
+{
+    int Equal = Idiom->ExitWhenEqual;
+    if(Idiom->Compared.Kind == SYMBOLIC_AFFINE)
+    {
+        // NOTE(vic): CMP compares the int ACC with a long, bigger values are never equal
+        int InRange = (long int)(int)Right == Right;
+        u32 Difference = (u32)Right - P;
+        if(!Equal) {
+            if(!InRange || Difference != 0) return 1;
+            return Q ? 2 : 0;
+        }
+        
+        // NOTE(vic): (k - 1)*Q == Difference modulo 2^32
+        if(!InRange) return 0;
+        if(Q == 0) return Difference == 0 ? 1 : 0;
+        int Shift = 0;
+        while(!(Q & (1u << Shift))) Shift++;
+        if(Difference & ((1u << Shift) - 1)) return 0;
+        u32 Mask = Shift ? (u32)((1ull << (32 - Shift)) - 1) : 0xFFFFFFFF;
+        u32 Solution = ((Difference >> Shift)*InverseOdd(Q >> Shift)) & Mask;
+        return (u64)Solution + 1;
+    }
+    
+    // NOTE(vic): CMP #0 on the sign bit, equal when the value is >= 0
+    s64 First = (s32)P;
+    s64 Step = (s32)Q;
+    int WantPositive = Equal;
+    if((First >= 0) == WantPositive) return 1;
+    if(WantPositive) {
+        if(Step <= 0) return 0;
+        return 1 + (u64)((-First + Step - 1)/Step);
+    }
+    if(Step >= 0) return 0;
+    return 1 + (u64)(First/(-Step) + 1);
+}
+
+// NOTE(vic): Jumps back to the head, they count for the jump limit
+static int FitsJumpLimit(loop_idiom *Idiom, int *JumpCounts, int Flags, u64 Iterations)
+{
+    if(IsSet(Flags, NO_JMP_LIMIT)) return 1;
+    return (u64)JumpCounts[Idiom->Head] + Iterations - 1 <= JMP_LIMIT;
+}
+
+static int RunCountedLoop(idiom_table *Table, loop_idiom *Idiom, machine_state *State, int *JumpCounts, int Flags)
+{
+    linked_program *Program = Table->Program;
+    long int *Cells = Program->Cells;
+    
+    u32 Entry[IDIOM_MAX_VARIABLES];
+    Entry[VARIABLE_ACC] = (u32)State->ACC;
+    Entry[VARIABLE_IX] = (u32)State->IX;
+    for(int v = 2; v < Idiom->VariableCount; v++) {
+        Entry[v] = (u32)Cells[Idiom->VariableCells[v]];
+    }
+    
+    symbolic_value *Compared = &Idiom->Compared;
+    u32 Offset = EvaluateSum(&Compared->Offset, Cells);
+    u32 P = Offset;
+    u32 Q = 0;
+    if(Compared->Base >= 0) {
+        P += (u32)Compared->Scale*Entry[Compared->Base];
+        Q = (u32)Compared->Scale*EvaluateSum(&Idiom->Final[Compared->Base].Offset, Cells);
+    }
+    long int Right = Idiom->CompareImmediate ? Idiom->CompareOperand : Cells[Idiom->CompareCell];
+    
+    u64 Iterations = SolveIterations(Idiom, P, Q, Right);
+    if(!Iterations || !FitsJumpLimit(Idiom, JumpCounts, Flags, Iterations)) return 0;
+    
+    // NOTE(vic): Entry has the cells that change, the others stay the same
+    State->ACC = (int)ValueAfter(Idiom, Entry, Cells, VARIABLE_ACC, Iterations);
+    State->IX = (int)ValueAfter(Idiom, Entry, Cells, VARIABLE_IX, Iterations);
+    for(int v = 2; v < Idiom->VariableCount; v++) {
+        Cells[Idiom->VariableCells[v]] = (int)ValueAfter(Idiom, Entry, Cells, v, Iterations);
+    }
+    u32 LastCompared = P + (u32)(Iterations - 1)*Q;
+    if(Compared->Kind == SYMBOLIC_SIGN) LastCompared &= 0x80000000;
+    State->LastCompareResult = CompareValues((int)LastCompared, Right);
+    JumpCounts[Idiom->Head] += (int)(Iterations - 1);
+    State->Steps += Iterations*(Idiom->End - Idiom->Head + 1) - 1;
+    return 1;
+}
+
+static int RunScanLoop(idiom_table *Table, loop_idiom *Idiom, machine_state *State, int *JumpCounts, int Flags)
+{
+    linked_program *Program = Table->Program;
+    long int *Cells = Program->Cells;
+    instruction *Load = Program->Instructions + Idiom->Load;
+    file_info *File = Program->Files + Load->AddressFileIndex;
+    long int Right = Idiom->CompareImmediate ? Idiom->CompareOperand : Cells[Idiom->CompareCell];
+    if(Idiom->Outputs && Table->OutputsChecked) return 0;
+    
+    // NOTE(vic): Everything is checked before anything is printed
+    int IX = State->IX;
+    u64 Iterations = 0;
+    int Value = 0;
+    for(;;)
+    {
+        if(Idiom->StepBeforeLoad) IX += Idiom->IXStep;
+        size_t Address = (size_t)Load->Operand + IX;
+        if(Address >= File->LineCount || !Program->CellHasData[File->FirstCell + Address]) return 0;
+        Value = (int)Cells[File->FirstCell + Address];
+        if(!Idiom->StepBeforeLoad) IX += Idiom->IXStep;
+        Iterations++;
+        
+        if((Value == Right) == Idiom->ExitWhenEqual) break;
+        if(!FitsJumpLimit(Idiom, JumpCounts, Flags, Iterations + 1)) return 0;
+    }
+    
+    if(Idiom->Outputs)
+    {
+        size_t First = (size_t)Load->Operand + State->IX + (Idiom->StepBeforeLoad ? Idiom->IXStep : 0);
+        if(IsSet(Flags, PRINT_NUMBERS)) {
+            for(u64 i = 0; i < Iterations; i++) {
+                printf("%d\n", (int)Cells[File->FirstCell + First + i*Idiom->IXStep]);
+            }
+        }
+        else {
+            char *Text = malloc(Iterations);
+            for(u64 i = 0; i < Iterations; i++) {
+                Text[i] = (char)(int)Cells[File->FirstCell + First + i*Idiom->IXStep];
+            }
+            fwrite(Text, 1, Iterations, stdout);
+            free(Text);
+        }
+    }
+    
+    State->ACC = Value;
+    State->IX = IX;
+    State->LastCompareResult = CompareValues(Value, Right);
+    JumpCounts[Idiom->Head] += (int)(Iterations - 1);
+    State->Steps += Iterations*(Idiom->End - Idiom->Head + 1) - 1;
+    return 1;
+}
+
+// NOTE(vic): Leaves State at the last instruction of the loop, or returns 0 if it has to run normally
+int RunIdiom(idiom_table *Table, machine_state *State, int *JumpCounts, int Flags)
+{
+    loop_idiom *Idiom = Table->Idioms + Table->IdiomAt[State->Line] - 1;
+    int Ran = Idiom->Kind == IDIOM_COUNTED ?
+        RunCountedLoop(Table, Idiom, State, JumpCounts, Flags) :
+        RunScanLoop(Table, Idiom, State, JumpCounts, Flags);
+    
+    if(!Ran) {
+        Table->Program->Instructions[Idiom->Head].Opcode = Idiom->OriginalOpcode;
+        return 0;
+    }
+    State->Line = Idiom->End;
+    return 1;
+}
@@ -0,0 +1,251 @@
+// NOTE(vic): .alb image, sections aligned to 8 bytes that the loader maps and points the program at
+
+#define ALA_IMAGE_MAGIC 0x424C4123 // "#ALB"
+#define ALA_IMAGE_VERSION 2
+
+typedef struct {
+    u32 Magic;
+    u32 Version;
+    u32 CellSize; // sizeof(long int) where it was compiled
+    u32 InstructionSize;
+    u32 FileCount;
+    u32 InstructionCount;
+    u32 CellCount;
+    u32 EntryPoint;
+    u64 FilesOffset;
+    u64 InstructionsOffset;
+    u64 InstructionInfoOffset;
+    u64 CellsOffset;
+    u64 CellHasDataOffset;
+    u64 DebugInfoOffset; // 0 if stripped
+    u64 DebugInfoSize;
+} image_header;
+
+// NOTE(vic): Debug info is FileNames[FileCount], Lines[CellCount], then the bytes they point into
+typedef struct {
+    u32 Offset;
+    u32 Count;
+} image_string;
+
+#define ImageAlign(Size) (((Size) + 7) & ~(u64)7)
+
+static int WriteImageSection(FILE *f, const void *Data, u64 Size)
+{
+    static const u8 Zeroes[8] = {0};
+    if(Size && fwrite(Data, 1, Size, f) != Size) return 0;
+    u64 Padding = ImageAlign(Size) - Size;
+    if(Padding && fwrite(Zeroes, 1, Padding, f) != Padding) return 0;
+    return 1;
+}
+
+int WriteProgramImage(const char *FilePath, linked_program *Program, int WithDebugInfo)
+{
+    image_header Header = {0};
+    Header.Magic = ALA_IMAGE_MAGIC;
+    Header.Version = ALA_IMAGE_VERSION;
+    Header.CellSize = sizeof(long int);
+    Header.InstructionSize = sizeof(instruction);
+    Header.FileCount = Program->FileCount;
+    Header.InstructionCount = Program->InstructionCount;
+    Header.CellCount = Program->CellCount;
+    Header.EntryPoint = Program->EntryPoint;
+    
+    u64 FilesSize = (u64)Program->FileCount*sizeof(file_info);
+    u64 InstructionsSize = (u64)Program->InstructionCount*sizeof(instruction);
+    u64 InstructionInfoSize = (u64)Program->InstructionCount*sizeof(instruction_info);
+    u64 CellsSize = (u64)Program->CellCount*sizeof(long int);
+    u64 CellHasDataSize = Program->CellCount;
+    
+    Header.FilesOffset = ImageAlign(sizeof(image_header));
+    Header.InstructionsOffset = Header.FilesOffset + ImageAlign(FilesSize);
+    Header.InstructionInfoOffset = Header.InstructionsOffset + ImageAlign(InstructionsSize);
+    Header.CellsOffset = Header.InstructionInfoOffset + ImageAlign(InstructionInfoSize);
+    Header.CellHasDataOffset = Header.CellsOffset + ImageAlign(CellsSize);
+    
+    image_string *DebugStrings = 0;
+    u64 DebugStringCount = 0;
+    u64 StringBytes = 0;
+    if(WithDebugInfo && Program->Lines) {
+        DebugStringCount = Program->FileCount + Program->CellCount;
+        DebugStrings = malloc(DebugStringCount*sizeof(image_string));
+        for(u32 i = 0; i < Program->FileCount; i++) {
+            DebugStrings[i].Offset = (u32)StringBytes;
+            DebugStrings[i].Count = (u32)Program->FileNames[i].count;
+            StringBytes += Program->FileNames[i].count;
+        }
+        for(u32 i = 0; i < Program->CellCount; i++) {
+            DebugStrings[Program->FileCount + i].Offset = (u32)StringBytes;
+            DebugStrings[Program->FileCount + i].Count = (u32)Program->Lines[i].count;
+            StringBytes += Program->Lines[i].count;
+        }
+        
+        Header.DebugInfoOffset = Header.CellHasDataOffset + ImageAlign(CellHasDataSize);
+        Header.DebugInfoSize = DebugStringCount*sizeof(image_string) + StringBytes;
+    }
+    
+    FILE *f = fopen(FilePath, "wb");
+    if(!f) {
+        free(DebugStrings);
+        return 0;
+    }
+    
+    int Ok = WriteImageSection(f, &Header, sizeof(Header)) &&
+        WriteImageSection(f, Program->Files, FilesSize) &&
+        WriteImageSection(f, Program->Instructions, InstructionsSize) &&
+        WriteImageSection(f, Program->InstructionInfo, InstructionInfoSize) &&
+        WriteImageSection(f, Program->Cells, CellsSize) &&
+        WriteImageSection(f, Program->CellHasData, CellHasDataSize);
+    
+    if(Ok && DebugStrings) {
+        Ok = fwrite(DebugStrings, sizeof(image_string), DebugStringCount, f) == DebugStringCount;
+        for(u32 i = 0; Ok && i < Program->FileCount; i++) {
+            String_View Name = Program->FileNames[i];
+            Ok = fwrite(Name.data, 1, Name.count, f) == Name.count;
+        }
+        for(u32 i = 0; Ok && i < Program->CellCount; i++) {
+            String_View Line = Program->Lines[i];
+            Ok = fwrite(Line.data, 1, Line.count, f) == Line.count;
+        }
+    }
+    
+    free(DebugStrings);
+    if(fclose(f) != 0) Ok = 0;
+    return Ok;
+}
+
+int IsJumpInstruction(int Opcode);
+
+// NOTE(vic): Evaluate trusts every index in the program, a corrupt image mustn't reach it
+static int CheckImageProgram(linked_program *Program)
+{
+    for(u32 i = 0; i < Program->FileCount; i++) {
+        file_info *File = Program->Files + i;
+        if((u64)File->FirstCell + File->LineCount > Program->CellCount) return 0;
+    }
+    for(u32 i = 0; i < Program->InstructionCount; i++)
+    {
+        instruction *I = Program->Instructions + i;
+        instruction_info *Info = Program->InstructionInfo + i;
+        if(I->Opcode >= IOP_COUNT || I->AddressFileIndex >= Program->FileCount ||
+           Info->FileIndex >= Program->FileCount || Info->LineInFile >= Program->Files[Info->FileIndex].LineCount) {
+            return 0;
+        }
+        if(I->Target == INVALID_TARGET) continue;
+        
+        switch(I->Opcode)
+        {
+            case IOP_LDD: case IOP_LDI: case IOP_STO: case IOP_STI: case IOP_CAS:
+            {
+                if(I->Target >= Program->CellCount) return 0;
+            } break;
+            
+            case IOP_ADD: case IOP_SUB: case IOP_MUL: case IOP_DIV: case IOP_MOD:
+            case IOP_AND: case IOP_XOR: case IOP_OR: case IOP_CMP:
+            {
+                if(!I->Immediate && I->Target >= Program->CellCount) return 0;
+            } break;
+            
+            default:
+            {
+                if(IsJumpInstruction(I->Opcode) && I->Target > Program->InstructionCount) return 0;
+            } break;
+        }
+    }
+    return 1;
+}
+
+// NOTE(vic): Returns 0 and prints the reason if the image can't be used
+int LoadProgramImage(const char *FilePath, linked_program *Program)
+{
+    size_t Size = 0;
+    u8 *Base = MapEntireFile(FilePath, &Size);
+    if(!Base) {
+        fprintf(stderr, "ERROR: Could not map file %s: %s\n", FilePath, strerror(errno));
+        return 0;
+    }
+    
+    image_header *Header = (image_header *)Base;
+    if(Size < sizeof(image_header) || Header->Magic != ALA_IMAGE_MAGIC) {
+        fprintf(stderr, "ERROR: %s is not an ALA image\n", FilePath);
+        goto error;
+    }
+    if(Header->Version != ALA_IMAGE_VERSION) {
+        fprintf(stderr, "ERROR: %s is an image of version %u, expected version %u\n"
+                "NOTE: Compile the program again with '-compile'\n",
+                FilePath, Header->Version, ALA_IMAGE_VERSION);
+        goto error;
+    }
+    if(Header->CellSize != sizeof(long int) || Header->InstructionSize != sizeof(instruction)) {
+        fprintf(stderr, "ERROR: %s was compiled for a different platform\n", FilePath);
+        goto error;
+    }
+    
+    u64 CellHasDataEnd = Header->CellHasDataOffset + Header->CellCount;
+    if(Header->FilesOffset + (u64)Header->FileCount*sizeof(file_info) > Size ||
+       Header->InstructionsOffset + (u64)Header->InstructionCount*sizeof(instruction) > Size ||
+       Header->InstructionInfoOffset + (u64)Header->InstructionCount*sizeof(instruction_info) > Size ||
+       Header->CellsOffset + (u64)Header->CellCount*sizeof(long int) > Size ||
+       CellHasDataEnd > Size ||
+       Header->DebugInfoOffset + Header->DebugInfoSize > Size ||
+       Header->EntryPoint > Header->InstructionCount)
+    {
+        fprintf(stderr, "ERROR: %s is truncated or corrupted\n", FilePath);
+        goto error;
+    }
+    
+    Program->InstructionCount = Header->InstructionCount;
+    Program->CellCount = Header->CellCount;
+    Program->FileCount = Header->FileCount;
+    Program->EntryPoint = Header->EntryPoint;
+    Program->Files = (file_info *)(Base + Header->FilesOffset);
+    Program->Instructions = (instruction *)(Base + Header->InstructionsOffset);
+    Program->InstructionInfo = (instruction_info *)(Base + Header->InstructionInfoOffset);
+    Program->Cells = (long int *)(Base + Header->CellsOffset);
+    Program->CellHasData = Base + Header->CellHasDataOffset;
+    if(!CheckImageProgram(Program)) {
+        fprintf(stderr, "ERROR: %s is truncated or corrupted\n", FilePath);
+        goto error;
+    }
+    
+    Program->FileNames = malloc(Program->FileCount*sizeof(String_View));
+    Program->Lines = 0;
+    if(Header->DebugInfoOffset) {
+        image_string *DebugStrings = (image_string *)(Base + Header->DebugInfoOffset);
+        u64 StringCount = (u64)Program->FileCount + Program->CellCount;
+        const char *Strings = (const char *)(DebugStrings + StringCount);
+        u64 StringBytes = Header->DebugInfoSize - StringCount*sizeof(image_string);
+        if(StringCount*sizeof(image_string) > Header->DebugInfoSize) {
+            fprintf(stderr, "ERROR: %s has corrupted debug info\n", FilePath);
+            free(Program->FileNames);
+            goto error;
+        }
+        for(u64 i = 0; i < StringCount; i++) {
+            if((u64)DebugStrings[i].Offset + DebugStrings[i].Count > StringBytes) {
+                fprintf(stderr, "ERROR: %s has corrupted debug info\n", FilePath);
+                free(Program->FileNames);
+                goto error;
+            }
+        }
+        
+        Program->Lines = malloc(Program->CellCount*sizeof(String_View));
+        for(u32 i = 0; i < Program->FileCount; i++) {
+            Program->FileNames[i] = sv_from_parts(Strings + DebugStrings[i].Offset, DebugStrings[i].Count);
+        }
+        for(u32 i = 0; i < Program->CellCount; i++) {
+            image_string *Line = DebugStrings + Program->FileCount + i;
+            Program->Lines[i] = sv_from_parts(Strings + Line->Offset, Line->Count);
+        }
+    }
+    else {
+        // NOTE(vic): Stripped image, diagnostics point at the image itself
+        for(u32 i = 0; i < Program->FileCount; i++) {
+            Program->FileNames[i] = sv_from_cstr(FilePath);
+        }
+    }
+    
+    return 1;
+    
+    error:
+    UnmapEntireFile(Base, Size);
+    return 0;
+}
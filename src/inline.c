@@ -0,0 +1,151 @@
+// NOTE(vic): -inline, small routines that don't CALL replace the CALLs to them, a round at a time
+
+#define INLINE_MAX_INSTRUCTIONS 16
+#define INLINE_ROUNDS 4
+
+// NOTE(vic): Sorted instructions of the routine at Entry, 0 if it can't be inlined
+static u32 FindInlineBody(linked_program *Program, u32 Entry, u32 *Body)
+{
+    u32 BodyCount = 0;
+    Body[BodyCount++] = Entry;
+    for(u32 b = 0; b < BodyCount; b++)
+    {
+        instruction *Instruction = Program->Instructions + Body[b];
+        u32 Next[2];
+        int NextCount = 0;
+        switch(Instruction->Opcode)
+        {
+            case IOP_RETURN:
+            case IOP_END: break;
+            case IOP_CALL: case IOP_SPAWN: return 0;
+            
+            case IOP_JMP:
+            case IOP_JPE:
+            case IOP_JPN:
+            case IOP_JPG:
+            case IOP_JPL:
+            {
+                if(Instruction->Target == INVALID_TARGET) return 0;
+                Next[NextCount++] = Instruction->Target;
+                if(Instruction->Opcode != IOP_JMP) Next[NextCount++] = Body[b] + 1;
+            } break;
+            
+            default:
+            {
+                if(Instruction->Opcode >= IOP_COUNT) return 0;
+                Next[NextCount++] = Body[b] + 1;
+            } break;
+        }
+        
+        for(int n = 0; n < NextCount; n++)
+        {
+            if(Next[n] >= Program->InstructionCount) return 0;
+            u32 Found = 0;
+            while(Found < BodyCount && Body[Found] != Next[n]) Found++;
+            if(Found == BodyCount) {
+                if(BodyCount == INLINE_MAX_INSTRUCTIONS) return 0;
+                Body[BodyCount++] = Next[n];
+            }
+        }
+    }
+    
+    // NOTE(vic): In program order an instruction that falls through is followed by the next one
+    for(u32 i = 1; i < BodyCount; i++) {
+        for(u32 j = i; j > 0 && Body[j - 1] > Body[j]; j--) {
+            u32 Swap = Body[j];
+            Body[j] = Body[j - 1];
+            Body[j - 1] = Swap;
+        }
+    }
+    // NOTE(vic): The copy starts at Body[0], code before the entry it jumps back to would run first
+    if(Body[0] != Entry) return 0;
+    return BodyCount;
+}
+
+static u32 FindInBody(u32 *Body, u32 BodyCount, u32 Index)
+{
+    u32 Found = 0;
+    while(Found < BodyCount && Body[Found] != Index) Found++;
+    return Found;
+}
+
+// NOTE(vic): Returns 1 if some CALL was inlined
+static int InlineRound(linked_program *Program)
+{
+    u32 Count = Program->InstructionCount;
+    u32 *BodyCounts = calloc(Count + 1, sizeof(u32)); // for CALLs that are inlined
+    u32 *NewIndex = calloc(Count + 1, sizeof(u32));
+    u32 Body[INLINE_MAX_INSTRUCTIONS];
+    
+    u32 NewCount = 0;
+    for(u32 i = 0; i < Count; i++)
+    {
+        NewIndex[i] = NewCount;
+        instruction *Instruction = Program->Instructions + i;
+        if(Instruction->Opcode == IOP_CALL && Instruction->Target != INVALID_TARGET && i + 1 < Count) {
+            BodyCounts[i] = FindInlineBody(Program, Instruction->Target, Body);
+        }
+        if(BodyCounts[i]) {
+            int LastIsReturn = Program->Instructions[Body[BodyCounts[i] - 1]].Opcode == IOP_RETURN;
+            NewCount += BodyCounts[i] - LastIsReturn;
+        }
+        else {
+            NewCount++;
+        }
+    }
+    NewIndex[Count] = NewCount;
+    
+    int Inlined = 0;
+    instruction *Instructions = malloc((NewCount + 1)*sizeof(instruction));
+    instruction_info *InstructionInfo = malloc((NewCount + 1)*sizeof(instruction_info));
+    for(u32 i = 0; i < Count; i++)
+    {
+        instruction *Instruction = Program->Instructions + i;
+        if(!BodyCounts[i]) {
+            instruction *Copy = Instructions + NewIndex[i];
+            *Copy = *Instruction;
+            InstructionInfo[NewIndex[i]] = Program->InstructionInfo[i];
+            if(IsJumpInstruction(Copy->Opcode) && Copy->Target != INVALID_TARGET) {
+                Copy->Target = NewIndex[Copy->Target];
+            }
+            continue;
+        }
+        
+        Inlined = 1;
+        u32 BodyCount = FindInlineBody(Program, Instruction->Target, Body);
+        u32 Continue = NewIndex[i + 1];
+        for(u32 b = 0; b < BodyCount; b++)
+        {
+            instruction *Original = Program->Instructions + Body[b];
+            if(Original->Opcode == IOP_RETURN && b == BodyCount - 1) break;
+            
+            instruction *Copy = Instructions + NewIndex[i] + b;
+            *Copy = *Original;
+            InstructionInfo[NewIndex[i] + b] = Program->InstructionInfo[Body[b]];
+            if(Copy->Opcode == IOP_RETURN) {
+                Copy->Opcode = IOP_JMP;
+                Copy->Target = Continue;
+            }
+            else if(IsJumpInstruction(Copy->Opcode)) {
+                u32 Target = FindInBody(Body, BodyCount, Original->Target);
+                int ToLastReturn = Target == BodyCount - 1 &&
+                    Program->Instructions[Body[Target]].Opcode == IOP_RETURN;
+                Copy->Target = ToLastReturn ? Continue : NewIndex[i] + Target;
+            }
+        }
+    }
+    
+    Program->Instructions = Instructions;
+    Program->InstructionInfo = InstructionInfo;
+    Program->InstructionCount = NewCount;
+    Program->EntryPoint = NewIndex[Program->EntryPoint < Count ? Program->EntryPoint : Count];
+    
+    free(BodyCounts);
+    free(NewIndex);
+    return Inlined;
+}
+
+void InlineCalls(linked_program *Program)
+{
+    for(int Round = 0; Round < INLINE_ROUNDS && InlineRound(Program); Round++);
+}
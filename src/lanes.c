@@ -0,0 +1,743 @@
+// NOTE(vic): -inputs=<file>, one run (a lane) per line, all in lockstep with the registers and cells
+// as arrays over the lanes. A lane that would fail runs again alone with Evaluate.
+
+#ifdef __linux__
+#include <sys/wait.h>
+
+#define MAX_LANES 256
+#define LANES_MEMORY (256*1024*1024)
+
+typedef enum {
+    LANE_RUNNING,
+    LANE_DONE,
+    LANE_ALONE, // runs again with Evaluate
+} lane_status;
+
+typedef struct {
+    String_View Input;
+    size_t InputAt;
+    char *Output;
+    size_t OutputSize;
+    size_t OutputCapacity;
+    lane_status Status;
+} lane;
+
+// NOTE(vic): Fixed size so gcc vectorizes the loops over a block, a lane that stopped is at InstructionCount
+#define LANE_BLOCK 16
+typedef struct {
+    int ACC[LANE_BLOCK];
+    int IX[LANE_BLOCK];
+    int LastCompareResult[LANE_BLOCK];
+    u32 Line[LANE_BLOCK];
+    u32 CallDepth[LANE_BLOCK];
+    int Active[LANE_BLOCK]; // 1 for the lanes at the instruction being run
+    int Taken[LANE_BLOCK]; // 1 for the lanes that take the jump
+    int ActiveCount;
+    
+    // NOTE(vic): Copy on write, a cell's row is filled the first time a lane of the block writes it
+    long int *Cells; // [Cell*LANE_BLOCK + l], only the dirty rows
+    u64 *Dirty; // a bit per cell
+    u32 *DirtyCells; // the cells with their bit set, so a reset only goes through those
+    u32 DirtyCount;
+    int *JumpCounts; // [Instruction*LANE_BLOCK + l]
+    u32 *CallStack; // [Depth*LANE_BLOCK + l]
+    lane *Lanes;
+} lane_block;
+
+typedef struct {
+    linked_program *Program;
+    int Flags;
+    int Used;
+    int BlockCount; // in this batch
+    int AllocatedBlocks;
+    lane_block *Blocks;
+    run_snapshot *Snapshot; // where the lanes start, 0 for the start of the program
+    long int *Image; // cells every lane starts with, never written
+    long int Shared[LANE_BLOCK]; // row of a cell the block didn't write
+    u64 Steps; // instructions run, adding all the lanes
+    u8 *CoverageMarks; // -coverage, 0 without it
+} lanes;
+
+// NOTE(vic): Only the blocks with some lane at the instruction
+#define ForEachBlock(Block) \
+for(lane_block *Block = Lanes->Blocks; Block < Lanes->Blocks + Lanes->BlockCount; Block++) \
+if(Block->ActiveCount)
+#define ForEachLane(Block, l) ForEachBlock(Block) for(int l = 0; l < LANE_BLOCK; l++)
+
+#define IsDirty(Block, Cell) ((Block)->Dirty[(Cell)/64] & ((u64)1 << ((Cell)%64)))
+
+static long int *ReadRow(lanes *Lanes, lane_block *Block, u32 Cell)
+{
+    if(IsDirty(Block, Cell)) return Block->Cells + (size_t)Cell*LANE_BLOCK;
+    for(int l = 0; l < LANE_BLOCK; l++) Lanes->Shared[l] = Lanes->Image[Cell];
+    return Lanes->Shared;
+}
+
+static long int *WriteRow(lanes *Lanes, lane_block *Block, u32 Cell)
+{
+    long int *Row = Block->Cells + (size_t)Cell*LANE_BLOCK;
+    if(!IsDirty(Block, Cell)) {
+        Block->Dirty[Cell/64] |= (u64)1 << (Cell%64);
+        Block->DirtyCells[Block->DirtyCount++] = Cell;
+        for(int l = 0; l < LANE_BLOCK; l++) Row[l] = Lanes->Image[Cell];
+    }
+    return Row;
+}
+
+// NOTE(vic): To - or Value where the lane is active, Mask is -Active so it's all ones there
+#define Blend(To, Value) (((To) & ~Mask) | ((Value) & Mask))
+
+static void RunAlone(lanes *Lanes, lane_block *Block, int l)
+{
+    Block->Active[l] = 0;
+    Block->Line[l] = Lanes->Program->InstructionCount;
+    Block->Lanes[l].Status = LANE_ALONE;
+}
+
+static void RunActiveAlone(lanes *Lanes)
+{
+    ForEachLane(Block, l) {
+        if(Block->Active[l]) RunAlone(Lanes, Block, l);
+    }
+}
+
+static void WriteLaneOutput(lane *Lane, const char *Data, size_t Size)
+{
+    if(Lane->OutputSize + Size > Lane->OutputCapacity) {
+        Lane->OutputCapacity = 2*(Lane->OutputSize + Size) + 64;
+        Lane->Output = realloc(Lane->Output, Lane->OutputCapacity);
+    }
+    memcpy(Lane->Output + Lane->OutputSize, Data, Size);
+    Lane->OutputSize += Size;
+}
+
+// NOTE(vic): Same checks as JumpToLine for the lanes that jump, the others go on
+static void JumpLanes(lanes *Lanes, instruction *I, u32 Index)
+{
+    if(I->Target == INVALID_TARGET) {
+        ForEachLane(Block, l) {
+            if(Block->Active[l] && Block->Taken[l]) RunAlone(Lanes, Block, l);
+        }
+    }
+    else if(!IsSet(Lanes->Flags, NO_JMP_LIMIT)) {
+        ForEachLane(Block, l) Block->Taken[l] &= Block->Active[l];
+        for(lane_block *Block = Lanes->Blocks; Block < Lanes->Blocks + Lanes->BlockCount; Block++)
+        {
+            if(!Block->ActiveCount) continue;
+            // NOTE(vic): Through a copy, JumpCounts could be any int for all gcc knows
+            int Taken[LANE_BLOCK];
+            int OverLimit = 0;
+            int *JumpCounts = Block->JumpCounts + (size_t)I->Target*LANE_BLOCK;
+            memcpy(Taken, Block->Taken, sizeof(Taken));
+            for(int l = 0; l < LANE_BLOCK; l++) {
+                JumpCounts[l] += Taken[l];
+                OverLimit |= JumpCounts[l] > JMP_LIMIT;
+            }
+            if(!OverLimit) continue;
+            for(int l = 0; l < LANE_BLOCK; l++) {
+                if(Taken[l] && JumpCounts[l] > JMP_LIMIT) RunAlone(Lanes, Block, l);
+            }
+        }
+    }
+    
+    if(Lanes->CoverageMarks) {
+        int Jumped = 0;
+        int FellThrough = 0;
+        ForEachLane(Block, l) {
+            Jumped |= Block->Active[l] & Block->Taken[l];
+            FellThrough |= Block->Active[l] & !Block->Taken[l];
+        }
+        Lanes->CoverageMarks[Index] |= (Jumped ? COVERAGE_JUMPED : 0) | (FellThrough ? COVERAGE_FELL_THROUGH : 0);
+    }
+    
+    u32 Next = Index + 1;
+    ForEachLane(Block, l) {
+        u32 Mask = -(u32)Block->Active[l];
+        u32 To = Block->Taken[l] ? I->Target : Next;
+        Block->Line[l] = Blend(Block->Line[l], To);
+    }
+}
+
+// NOTE(vic): LDI, LDX, STI and STX, where every lane can have its own address
+static void AddressLanes(lanes *Lanes, instruction *I, u32 Index)
+{
+    linked_program *Program = Lanes->Program;
+    file_info *File = Program->Files + I->AddressFileIndex;
+    int Indirect = I->Opcode == IOP_LDI || I->Opcode == IOP_STI;
+    if(Indirect && I->Target == INVALID_TARGET) {
+        RunActiveAlone(Lanes);
+        return;
+    }
+    
+    ForEachLane(Block, l)
+    {
+        if(!Block->Active[l]) continue;
+        size_t Address = Indirect ? (size_t)ReadRow(Lanes, Block, I->Target)[l] : (size_t)I->Operand + Block->IX[l];
+        if(Address >= File->LineCount || !Program->CellHasData[File->FirstCell + Address]) {
+            RunAlone(Lanes, Block, l);
+            continue;
+        }
+        
+        u32 Cell = File->FirstCell + (u32)Address;
+        switch(I->Opcode)
+        {
+            case IOP_LDI:
+            case IOP_LDX: Block->ACC[l] = (int)ReadRow(Lanes, Block, Cell)[l]; break;
+            case IOP_STX: WriteRow(Lanes, Block, Cell)[l] = Block->ACC[l]; break;
+            // NOTE(vic): Same as Evaluate, STI stores into its own operand cell
+            case IOP_STI: WriteRow(Lanes, Block, I->Target)[l] = Block->ACC[l]; break;
+        }
+        Block->Line[l] = Index + 1;
+    }
+}
+
+// NOTE(vic): ACC is an int, so doing these in 32 bits gives what Evaluate's long ones truncate to
+#define ArithmeticLanes(Op) \
+if(I->Immediate) { \
+ForEachLane(B, l) { int Mask = -B->Active[l]; B->ACC[l] = Blend(B->ACC[l], (int)((u32)B->ACC[l] Op (u32)Operand)); } \
+} \
+else if(I->Target == INVALID_TARGET) { \
+RunActiveAlone(Lanes); \
+return 0; \
+} \
+else { \
+ForEachBlock(B) { \
+long int *Row = ReadRow(Lanes, B, I->Target); \
+for(int l = 0; l < LANE_BLOCK; l++) { int Mask = -B->Active[l]; B->ACC[l] = Blend(B->ACC[l], (int)((u32)B->ACC[l] Op (u32)Row[l])); } \
+} \
+}
+
+// NOTE(vic): Returns 1 if all the lanes that ran it went to the next instruction
+static int StepLanes(lanes *Lanes, u32 Index)
+{
+    linked_program *Program = Lanes->Program;
+    instruction *I = Program->Instructions + Index;
+    int Operand = I->Operand;
+    
+    switch(I->Opcode)
+    {
+        case IOP_LDM: ForEachLane(B, l) { int Mask = -B->Active[l]; B->ACC[l] = Blend(B->ACC[l], Operand); } break;
+        case IOP_LDR: ForEachLane(B, l) { int Mask = -B->Active[l]; B->IX[l] = Blend(B->IX[l], Operand); } break;
+        
+        case IOP_LDD:
+        {
+            if(I->Target == INVALID_TARGET) { RunActiveAlone(Lanes); return 0; }
+            ForEachBlock(B) {
+                long int *Row = ReadRow(Lanes, B, I->Target);
+                for(int l = 0; l < LANE_BLOCK; l++) { int Mask = -B->Active[l]; B->ACC[l] = Blend(B->ACC[l], (int)Row[l]); }
+            }
+        } break;
+        
+        case IOP_STO:
+        {
+            if(I->Target == INVALID_TARGET) { RunActiveAlone(Lanes); return 0; }
+            ForEachBlock(B) {
+                long int *Row = WriteRow(Lanes, B, I->Target);
+                for(int l = 0; l < LANE_BLOCK; l++) {
+                    long int Mask = -(long int)B->Active[l];
+                    Row[l] = Blend(Row[l], (long int)B->ACC[l]);
+                }
+            }
+        } break;
+        
+        case IOP_ADD:
+        {
+            if(I->Target == INVALID_TARGET) { RunActiveAlone(Lanes); return 0; }
+            ForEachBlock(B) {
+                long int *Row = ReadRow(Lanes, B, I->Target);
+                for(int l = 0; l < LANE_BLOCK; l++) { int Mask = -B->Active[l]; B->ACC[l] = Blend(B->ACC[l], (int)(B->ACC[l] + Row[l])); }
+            }
+        } break;
+        
+        case IOP_CMP:
+        {
+            if(I->Immediate) {
+                ForEachLane(B, l) {
+                    int Mask = -B->Active[l];
+                    B->LastCompareResult[l] = Blend(B->LastCompareResult[l], CompareValues(B->ACC[l], Operand));
+                }
+                break;
+            }
+            if(I->Target == INVALID_TARGET) { RunActiveAlone(Lanes); return 0; }
+            ForEachBlock(B) {
+                long int *Row = ReadRow(Lanes, B, I->Target);
+                for(int l = 0; l < LANE_BLOCK; l++) {
+                    int Mask = -B->Active[l];
+                    B->LastCompareResult[l] = Blend(B->LastCompareResult[l], CompareValues(B->ACC[l], Row[l]));
+                }
+            }
+        } break;
+        
+        case IOP_AND: ArithmeticLanes(&); break;
+        case IOP_XOR: ArithmeticLanes(^); break;
+        case IOP_OR: ArithmeticLanes(|); break;
+        case IOP_SUB: ArithmeticLanes(-); break;
+        case IOP_MUL: ArithmeticLanes(*); break;
+        
+        case IOP_LSL: ForEachLane(B, l) { int Mask = -B->Active[l]; B->ACC[l] = Blend(B->ACC[l], B->ACC[l] << Operand); } break;
+        case IOP_LSR: ForEachLane(B, l) { int Mask = -B->Active[l]; B->ACC[l] = Blend(B->ACC[l], B->ACC[l] >> Operand); } break;
+        
+        case IOP_ACCINC: ForEachLane(B, l) B->ACC[l] += B->Active[l]; break;
+        case IOP_ACCDEC: ForEachLane(B, l) B->ACC[l] -= B->Active[l]; break;
+        case IOP_IXINC: ForEachLane(B, l) B->IX[l] += B->Active[l]; break;
+        case IOP_IXDEC: ForEachLane(B, l) B->IX[l] -= B->Active[l]; break;
+        
+        case IOP_LDI:
+        case IOP_LDX:
+        case IOP_STI:
+        case IOP_STX:
+        {
+            AddressLanes(Lanes, I, Index);
+        } return 0;
+        
+        case IOP_JMP: ForEachLane(B, l) B->Taken[l] = 1; JumpLanes(Lanes, I, Index); return 0;
+        case IOP_JPE: ForEachLane(B, l) B->Taken[l] = (B->LastCompareResult[l] & COMPARED_EQUAL) != 0; JumpLanes(Lanes, I, Index); return 0;
+        case IOP_JPN: ForEachLane(B, l) B->Taken[l] = (B->LastCompareResult[l] & COMPARED_EQUAL) == 0; JumpLanes(Lanes, I, Index); return 0;
+        case IOP_JPG: ForEachLane(B, l) B->Taken[l] = (B->LastCompareResult[l] & COMPARED_GREATER) != 0; JumpLanes(Lanes, I, Index); return 0;
+        case IOP_JPL: ForEachLane(B, l) B->Taken[l] = (B->LastCompareResult[l] & COMPARED_LESS) != 0; JumpLanes(Lanes, I, Index); return 0;
+        
+        case IOP_CALL:
+        {
+            ForEachLane(B, l) {
+                if(B->Active[l] && B->CallDepth[l] == MAX_CALL_DEPTH) RunAlone(Lanes, B, l);
+            }
+            ForEachLane(B, l) B->Taken[l] = 1;
+            JumpLanes(Lanes, I, Index);
+            ForEachLane(B, l) {
+                if(B->Active[l]) B->CallStack[(size_t)B->CallDepth[l]++*LANE_BLOCK + l] = Index;
+            }
+        } return 0;
+        
+        case IOP_RETURN:
+        {
+            if(Lanes->CoverageMarks) Lanes->CoverageMarks[Index] |= COVERAGE_LEFT;
+            ForEachLane(B, l)
+            {
+                if(!B->Active[l]) continue;
+                if(B->CallDepth[l] == 0) {
+                    RunAlone(Lanes, B, l);
+                    continue;
+                }
+                B->Line[l] = B->CallStack[(size_t)--B->CallDepth[l]*LANE_BLOCK + l] + 1;
+            }
+        } return 0;
+        
+        case IOP_INP:
+        {
+            ForEachLane(B, l)
+            {
+                if(!B->Active[l]) continue;
+                lane *Lane = B->Lanes + l;
+                B->ACC[l] = Lane->InputAt < Lane->Input.count ? (u8)Lane->Input.data[Lane->InputAt++] : EOF;
+            }
+        } break;
+        
+        case IOP_OUT:
+        {
+            ForEachLane(B, l)
+            {
+                if(!B->Active[l]) continue;
+                if(IsSet(Lanes->Flags, PRINT_NUMBERS)) {
+                    char Number[16];
+                    WriteLaneOutput(B->Lanes + l, Number, (size_t)sprintf(Number, "%d\n", B->ACC[l]));
+                }
+                else {
+                    char Char = (char)B->ACC[l];
+                    WriteLaneOutput(B->Lanes + l, &Char, 1);
+                }
+            }
+        } break;
+        
+        case IOP_END:
+        {
+            if(Lanes->CoverageMarks) Lanes->CoverageMarks[Index] |= COVERAGE_LEFT;
+            u32 ProgramLength = Program->InstructionCount;
+            ForEachLane(B, l) { u32 Mask = -(u32)B->Active[l]; B->Line[l] = Blend(B->Line[l], ProgramLength); }
+        } return 0;
+        
+        default:
+        {
+            RunActiveAlone(Lanes);
+        } return 0;
+    }
+    
+    u32 Next = Index + 1;
+    ForEachLane(B, l) { u32 Mask = -(u32)B->Active[l]; B->Line[l] = Blend(B->Line[l], Next); }
+    return 1;
+}
+
+static void RunLanes(lanes *Lanes)
+{
+    u32 ProgramLength = Lanes->Program->InstructionCount;
+    lane_block *End = Lanes->Blocks + Lanes->BlockCount;
+    u32 Index = 0;
+    int Together = 0; // all the lanes still running are at Index
+    int ActiveCount = 0;
+    for(;;)
+    {
+        // NOTE(vic): Lanes that went ahead wait at the join for the ones that are behind
+        if(!Together)
+        {
+            Index = ProgramLength;
+            for(lane_block *Block = Lanes->Blocks; Block < End; Block++) {
+                for(int l = 0; l < LANE_BLOCK; l++) Index = Block->Line[l] < Index ? Block->Line[l] : Index;
+            }
+            if(Index >= ProgramLength) break;
+            
+            int RunningCount = 0;
+            ActiveCount = 0;
+            for(lane_block *Block = Lanes->Blocks; Block < End; Block++)
+            {
+                int BlockActiveCount = 0;
+                for(int l = 0; l < LANE_BLOCK; l++) {
+                    Block->Active[l] = Block->Line[l] == Index;
+                    BlockActiveCount += Block->Active[l];
+                    RunningCount += Block->Line[l] < ProgramLength;
+                }
+                Block->ActiveCount = BlockActiveCount;
+                ActiveCount += BlockActiveCount;
+            }
+            Together = ActiveCount == RunningCount;
+            
+            // NOTE(vic): Only here, what runs after Index without coming back here falls through to it
+            if(Lanes->CoverageMarks) Lanes->CoverageMarks[Index] |= COVERAGE_ARRIVED;
+        }
+        
+        // NOTE(vic): Straight code run by all the lanes keeps them together, Active stays the same
+        Lanes->Steps += ActiveCount;
+        Together &= StepLanes(Lanes, Index);
+        Index++;
+        Together &= Index < ProgramLength;
+    }
+}
+
+static void StartLanes(lanes *Lanes, linked_program *Program, int Flags, run_snapshot *Snapshot, coverage *Coverage,
+                       int BlockCount)
+{
+    memset(Lanes, 0, sizeof(*Lanes));
+    Lanes->Program = Program;
+    Lanes->Flags = Flags;
+    Lanes->Snapshot = Snapshot;
+    Lanes->CoverageMarks = Coverage ? Coverage->Marks : 0;
+    Lanes->Image = Snapshot ? Snapshot->Cells : Program->Cells;
+    Lanes->AllocatedBlocks = BlockCount;
+    Lanes->Blocks = calloc(BlockCount, sizeof(lane_block));
+    for(int b = 0; b < BlockCount; b++)
+    {
+        lane_block *Block = Lanes->Blocks + b;
+        Block->Cells = calloc((size_t)Program->CellCount*LANE_BLOCK, sizeof(long int));
+        Block->Dirty = calloc(Program->CellCount/64 + 1, sizeof(u64));
+        Block->DirtyCells = malloc((Program->CellCount + 1)*sizeof(u32));
+        Block->JumpCounts = malloc(((size_t)Program->InstructionCount + 1)*LANE_BLOCK*sizeof(int));
+        Block->CallStack = malloc((size_t)MAX_CALL_DEPTH*LANE_BLOCK*sizeof(u32));
+    }
+}
+
+// NOTE(vic): For the next batch of inputs
+static void ResetLanes(lanes *Lanes, lane *Inputs, int Used)
+{
+    linked_program *Program = Lanes->Program;
+    run_snapshot *Snapshot = Lanes->Snapshot;
+    Lanes->Used = Used;
+    Lanes->BlockCount = (Used + LANE_BLOCK - 1)/LANE_BLOCK;
+    Lanes->Steps = 0;
+    for(int b = 0; b < Lanes->BlockCount; b++)
+    {
+        lane_block *Block = Lanes->Blocks + b;
+        for(u32 i = 0; i < Block->DirtyCount; i++) {
+            Block->Dirty[Block->DirtyCells[i]/64] = 0;
+        }
+        Block->DirtyCount = 0;
+        Block->Lanes = Inputs + b*LANE_BLOCK;
+        
+        // NOTE(vic): Every lane gets a copy of the machine after the setup, or a new one
+        for(u32 i = 0; i <= Program->InstructionCount; i++) {
+            int Count = Snapshot ? Snapshot->JumpCounts[i] : 0;
+            for(int l = 0; l < LANE_BLOCK; l++) Block->JumpCounts[(size_t)i*LANE_BLOCK + l] = Count;
+        }
+        for(u32 Depth = 0; Snapshot && Depth < Snapshot->CallDepth; Depth++) {
+            for(int l = 0; l < LANE_BLOCK; l++) Block->CallStack[(size_t)Depth*LANE_BLOCK + l] = Snapshot->CallStack[Depth];
+        }
+        for(int l = 0; l < LANE_BLOCK; l++)
+        {
+            int Starts = b*LANE_BLOCK + l < Used;
+            Block->ACC[l] = Snapshot ? Snapshot->ACC : 0;
+            Block->IX[l] = Snapshot ? Snapshot->IX : 0;
+            Block->LastCompareResult[l] = Snapshot ? Snapshot->LastCompareResult : 0;
+            Block->CallDepth[l] = Snapshot ? Snapshot->CallDepth : 0;
+            Block->Line[l] = !Starts ? Program->InstructionCount : Snapshot ? Snapshot->Line : Program->EntryPoint;
+            if(Starts && Snapshot) WriteLaneOutput(Block->Lanes + l, Snapshot->Output, Snapshot->OutputSize);
+        }
+    }
+}
+
+static void StopLanes(lanes *Lanes)
+{
+    for(int b = 0; b < Lanes->AllocatedBlocks; b++)
+    {
+        lane_block *Block = Lanes->Blocks + b;
+        free(Block->Cells);
+        free(Block->Dirty);
+        free(Block->DirtyCells);
+        free(Block->JumpCounts);
+        free(Block->CallStack);
+    }
+    free(Lanes->Blocks);
+}
+
+static int LanesPerBatch(linked_program *Program, int InputCount)
+{
+    size_t LaneSize = (size_t)Program->CellCount*sizeof(long int) +
+        ((size_t)Program->InstructionCount + 1)*sizeof(int) + MAX_CALL_DEPTH*sizeof(u32);
+    size_t Count = LANES_MEMORY/LaneSize/LANE_BLOCK*LANE_BLOCK;
+    if(Count > MAX_LANES) Count = MAX_LANES;
+    if(Count > (size_t)InputCount) Count = InputCount;
+    return Count ? (int)Count : 1;
+}
+
+// NOTE(vic): Returns the instructions run
+static u64 RunInLockstep(linked_program *Program, int Flags, run_snapshot *Snapshot, coverage *Coverage,
+                         lane *Inputs, int InputCount)
+{
+    u64 Steps = 0;
+    int Count = LanesPerBatch(Program, InputCount);
+    lanes Lanes;
+    StartLanes(&Lanes, Program, Flags, Snapshot, Coverage, (Count + LANE_BLOCK - 1)/LANE_BLOCK);
+    for(int First = 0; First < InputCount; First += Count)
+    {
+        int Used = First + Count <= InputCount ? Count : InputCount - First;
+        ResetLanes(&Lanes, Inputs + First, Used);
+        RunLanes(&Lanes);
+        Steps += Lanes.Steps;
+        for(int i = First; i < First + Used; i++) {
+            if(Inputs[i].Status == LANE_RUNNING) Inputs[i].Status = LANE_DONE;
+        }
+    }
+    StopLanes(&Lanes);
+    return Steps;
+}
+
+// NOTE(vic): In a child process, Evaluate ends the process when the program fails
+static int RunLaneWithEvaluate(linked_program *Program, int Flags, run_snapshot *Snapshot, coverage *Coverage,
+                               lane *Lane, FILE *Output, FILE *Errors)
+{
+    FILE *Input = tmpfile();
+    if(!Input || fwrite(Lane->Input.data, 1, Lane->Input.count, Input) != Lane->Input.count) {
+        fprintf(stderr, "ERROR: Could not run the input again: %s\n", strerror(errno));
+        return 1;
+    }
+    rewind(Input);
+    
+    fflush(stdout);
+    fflush(stderr);
+    pid_t Child = fork();
+    if(Child == 0) {
+        dup2(fileno(Input), STDIN_FILENO);
+        dup2(fileno(Output), STDOUT_FILENO);
+        dup2(fileno(Errors), STDERR_FILENO);
+        ReportsAtExit = 0;
+        run_options Options = { .Snapshot = Snapshot, .Coverage = Coverage };
+        Evaluate(Program, Flags, &Options);
+        exit(0);
+    }
+    
+    int Status = 0;
+    if(Child < 0 || waitpid(Child, &Status, 0) < 0) {
+        fprintf(stderr, "ERROR: Could not run the input again: %s\n", strerror(errno));
+        Status = 1;
+    }
+    else {
+        Status = WIFEXITED(Status) ? WEXITSTATUS(Status) : 128 + WTERMSIG(Status);
+    }
+    fclose(Input);
+    return Status;
+}
+
+static void CopyFile(FILE *From, FILE *To, int *LastChar)
+{
+    char Buffer[4096];
+    size_t Size;
+    rewind(From);
+    while((Size = fread(Buffer, 1, sizeof(Buffer), From)) > 0) {
+        fwrite(Buffer, 1, Size, To);
+        *LastChar = (u8)Buffer[Size - 1];
+    }
+}
+
+// NOTE(vic): -bench, the inputs that didn't fail again one after the other with Evaluate
+static void BenchEvaluate(linked_program *Program, int Flags, run_snapshot *Snapshot, lane *Inputs, int InputCount,
+                          u64 Steps, double LockstepSeconds)
+{
+    long int *Cells = malloc(Program->CellCount*sizeof(long int));
+    memcpy(Cells, Program->Cells, Program->CellCount*sizeof(long int));
+    FILE *SavedStdin = stdin;
+    FILE *SavedStdout = stdout;
+    stdout = fopen("/dev/null", "w");
+    
+    int Runs = 0;
+    double Start = GetSeconds();
+    for(int i = 0; i < InputCount; i++)
+    {
+        if(Inputs[i].Status != LANE_DONE) continue;
+        memcpy(Program->Cells, Cells, Program->CellCount*sizeof(long int));
+        stdin = Inputs[i].Input.count ? fmemopen((void *)Inputs[i].Input.data, Inputs[i].Input.count, "r") :
+            fopen("/dev/null", "r");
+        run_options Options = { .Snapshot = Snapshot };
+        Evaluate(Program, Flags, &Options);
+        fclose(stdin);
+        Runs++;
+    }
+    double EvaluateSeconds = GetSeconds() - Start;
+    
+    fclose(stdout);
+    stdout = SavedStdout;
+    stdin = SavedStdin;
+    memcpy(Program->Cells, Cells, Program->CellCount*sizeof(long int));
+    free(Cells);
+    
+    fprintf(stderr, "NOTE: %d runs, %llu instructions\n"
+            "NOTE: Lockstep: %.3f ms, %.1f million instructions per second\n"
+            "NOTE: Evaluate: %.3f ms, %.1f million instructions per second (%.2fx)\n",
+            Runs, (unsigned long long)Steps,
+            LockstepSeconds*1000.0, Steps/LockstepSeconds*1e-6,
+            EvaluateSeconds*1000.0, Steps/EvaluateSeconds*1e-6, EvaluateSeconds/LockstepSeconds);
+    if(Snapshot) {
+        fprintf(stderr, "NOTE: Both start from the snapshot, the %llu instructions before it ran once\n",
+                (unsigned long long)Snapshot->Steps);
+    }
+}
+
+// NOTE(vic): Returns 0 if the program ended or failed before the snapshot
+static int TakeSetupSnapshot(linked_program *Program, int Flags, const char *SnapshotAt, run_snapshot *Snapshot,
+                             coverage *Coverage)
+{
+    if(!FindSnapshotStop(Program, sv_from_cstr(SnapshotAt), &Snapshot->Stop)) {
+        fflush(stdout);
+        fprintf(stderr, "ERROR: Could not find where to take the snapshot ('-snapshot=%s')\n", SnapshotAt);
+        exit(1);
+    }
+    
+    long int *Cells = malloc(Program->CellCount*sizeof(long int));
+    memcpy(Cells, Program->Cells, Program->CellCount*sizeof(long int));
+    char *Errors = 0;
+    size_t ErrorsSize = 0;
+    FILE *SavedStdout = stdout;
+    FILE *SavedStderr = stderr;
+    stdout = open_memstream(&Snapshot->Output, &Snapshot->OutputSize);
+    stderr = open_memstream(&Errors, &ErrorsSize);
+    
+    // NOTE(vic): Without -O's loops and calls in one go, a failure would leave their opcodes behind
+    PlaceSnapshotStops(Snapshot, Program);
+    jmp_buf Recover;
+    if(!setjmp(Recover)) {
+        RecoverPoint = &Recover;
+        run_options Options = { .Snapshot = Snapshot, .Coverage = Coverage };
+        Evaluate(Program, Flags & ~ALA_OPTIMIZE, &Options);
+    }
+    RecoverPoint = 0;
+    RemoveSnapshotStops(Snapshot, Program);
+    
+    fclose(stdout);
+    fclose(stderr);
+    stdout = SavedStdout;
+    stderr = SavedStderr;
+    if(Snapshot->Taken) {
+        fwrite(Errors, 1, ErrorsSize, stderr);
+    }
+    else {
+        FreeSnapshot(Snapshot);
+    }
+    memcpy(Program->Cells, Cells, Program->CellCount*sizeof(long int));
+    free(Cells);
+    free(Errors);
+    return Snapshot->Taken;
+}
+
+void RunInputs(linked_program *Program, int Flags, const char *InputsPath, const char *SnapshotAt, coverage *Coverage)
+{
+    if(Flags & (ALA_DEBUG | ALA_RECORD | ALA_REPLAY)) {
+        fprintf(stderr, "ERROR: '-inputs' can't be used with '-debug', '-record' or '-replay'\n");
+        exit(1);
+    }
+    String_View Content = sv_ReadEntireFile(InputsPath);
+    if(!Content.data) {
+        fprintf(stderr, "ERROR: Could not read file %s: %s\n", InputsPath, strerror(errno));
+        exit(1);
+    }
+    
+    // NOTE(vic): One run per line, the newline belongs to the line before it
+    int InputCount = 0;
+    for(size_t i = 0; i < Content.count; i++) InputCount += Content.data[i] == '\n';
+    InputCount += Content.count && Content.data[Content.count - 1] != '\n';
+    lane *Inputs = calloc(InputCount ? InputCount : 1, sizeof(lane));
+    size_t LineStart = 0;
+    for(int i = 0; i < InputCount; i++)
+    {
+        size_t LineEnd = LineStart;
+        while(LineEnd < Content.count && Content.data[LineEnd++] != '\n');
+        Inputs[i].Input = sv_from_parts(Content.data + LineStart, LineEnd - LineStart);
+        LineStart = LineEnd;
+    }
+    
+    run_snapshot SetupSnapshot = {0};
+    run_snapshot *Snapshot = SnapshotAt && TakeSetupSnapshot(Program, Flags, SnapshotAt, &SetupSnapshot, Coverage) ?
+        &SetupSnapshot : 0;
+    
+    double Start = GetSeconds();
+    u64 Steps = RunInLockstep(Program, Flags, Snapshot, Coverage, Inputs, InputCount);
+    double LockstepSeconds = GetSeconds() - Start;
+    
+    int LastChar = '\n';
+    for(int i = 0; i < InputCount; i++)
+    {
+        lane *Lane = Inputs + i;
+        FILE *Output = 0;
+        FILE *Errors = 0;
+        int Status = 0;
+        if(Lane->Status == LANE_ALONE) {
+            Output = tmpfile();
+            Errors = tmpfile();
+            if(!Output || !Errors) {
+                fprintf(stderr, "ERROR: Could not run input %d again: %s\n", i + 1, strerror(errno));
+                exit(1);
+            }
+            Status = RunLaneWithEvaluate(Program, Flags, Snapshot, Coverage, Lane, Output, Errors);
+        }
+        
+        if(LastChar != '\n') putchar('\n');
+        printf("=== Input %d: exit status %d ===\n", i + 1, Status);
+        LastChar = '\n';
+        if(Output) {
+            CopyFile(Output, stdout, &LastChar);
+            fflush(stdout);
+            int ErrorsLastChar = '\n';
+            CopyFile(Errors, stderr, &ErrorsLastChar);
+            // NOTE(vic): Errors don't end their line, the next header goes on one of its own
+            if(ErrorsLastChar != '\n') fputc('\n', stderr);
+            fclose(Output);
+            fclose(Errors);
+        }
+        else if(Lane->OutputSize) {
+            fwrite(Lane->Output, 1, Lane->OutputSize, stdout);
+            LastChar = (u8)Lane->Output[Lane->OutputSize - 1];
+        }
+    }
+    if(LastChar != '\n') putchar('\n');
+    fflush(stdout);
+    
+    if(IsSet(Flags, ALA_BENCH)) {
+        BenchEvaluate(Program, Flags, Snapshot, Inputs, InputCount, Steps, LockstepSeconds);
+    }
+    
+    for(int i = 0; i < InputCount; i++) free(Inputs[i].Output);
+    free(Inputs);
+    FreeSnapshot(&SetupSnapshot);
+    free((char *)Content.data);
+}
+#else
+void RunInputs(linked_program *Program, int Flags, const char *InputsPath, const char *SnapshotAt, coverage *Coverage)
+{
+    fprintf(stderr, "ERROR: '-inputs' is only supported on linux\n");
+    exit(1);
+}
+#endif
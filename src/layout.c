@@ -0,0 +1,360 @@
+// NOTE(vic): -profile adds where control went to first.alp, -layout reads it and orders the blocks
+// so the hottest paths fall through
+
+#define ALA_PROFILE_MAGIC 0x504C4123 // "#ALP"
+#define ALA_PROFILE_VERSION 1
+
+typedef struct {
+    u32 Magic;
+    u32 Version;
+    u32 ProgramHash;
+    u32 InstructionCount;
+} profile_header;
+
+typedef struct {
+    char *Path; // .alp
+    u32 ProgramHash; // before it runs, -O writes to the instructions while it runs
+    u32 InstructionCount;
+    
+    // NOTE(vic): By coverage mark, one per instruction and one past the end
+    u64 *Counts[COVERAGE_FELL_THROUGH + 1];
+} branch_profile;
+
+static branch_profile *RunProfile;
+
+// NOTE(vic): The three arrays of Counts one after the other
+#define PROFILE_ARRAYS 3
+static u64 *ProfileArray(u64 *Counts, u32 InstructionCount, int Mark)
+{
+    int Index = Mark == COVERAGE_ARRIVED ? 0 : Mark == COVERAGE_JUMPED ? 1 : 2;
+    return Counts + (size_t)Index*(InstructionCount + 1);
+}
+
+// NOTE(vic): Returns 1 if Path has the counts of this program, they are added to Counts
+static int AddProfile(const char *Path, u32 ProgramHash, u32 InstructionCount, u64 *Counts)
+{
+    String_View Content = sv_ReadEntireFile(Path);
+    if(!Content.data) return 0;
+    
+    size_t CountsSize = (size_t)PROFILE_ARRAYS*(InstructionCount + 1)*sizeof(u64);
+    profile_header *Header = (profile_header *)Content.data;
+    int Matches = Content.count == sizeof(profile_header) + CountsSize && Header->Magic == ALA_PROFILE_MAGIC &&
+        Header->Version == ALA_PROFILE_VERSION && Header->ProgramHash == ProgramHash &&
+        Header->InstructionCount == InstructionCount;
+    if(Matches) {
+        u64 *Earlier = (u64 *)(Content.data + sizeof(profile_header));
+        for(size_t i = 0; i < (size_t)PROFILE_ARRAYS*(InstructionCount + 1); i++) Counts[i] += Earlier[i];
+    }
+    free((char *)Content.data);
+    return Matches;
+}
+
+static void WriteProfile(void)
+{
+    branch_profile *Profile = RunProfile;
+    if(!Profile || !ReportsAtExit) return;
+    
+    u64 *Counts = Profile->Counts[COVERAGE_ARRIVED];
+    FILE *Existing = fopen(Profile->Path, "rb");
+    if(Existing) {
+        fclose(Existing);
+        if(!AddProfile(Profile->Path, Profile->ProgramHash, Profile->InstructionCount, Counts)) {
+            fprintf(stderr, "NOTE: %s is from another version of the program, profiling starts again\n",
+                    Profile->Path);
+        }
+    }
+    
+    FILE *Out = fopen(Profile->Path, "wb");
+    if(!Out) {
+        fprintf(stderr, "ERROR: Could not write %s: %s\n", Profile->Path, strerror(errno));
+        return;
+    }
+    profile_header Header = {
+        .Magic = ALA_PROFILE_MAGIC,
+        .Version = ALA_PROFILE_VERSION,
+        .ProgramHash = Profile->ProgramHash,
+        .InstructionCount = Profile->InstructionCount,
+    };
+    fwrite(&Header, sizeof(Header), 1, Out);
+    fwrite(Counts, sizeof(u64), (size_t)PROFILE_ARRAYS*(Profile->InstructionCount + 1), Out);
+    fclose(Out);
+}
+
+branch_profile *StartProfile(String_View FirstFile, const char *Extension, linked_program *Program)
+{
+    branch_profile *Profile = calloc(1, sizeof(branch_profile));
+    Profile->Path = ReplaceExtension(FirstFile, Extension, ".alp");
+    Profile->ProgramHash = HashProgram(Program);
+    Profile->InstructionCount = Program->InstructionCount;
+    u64 *Counts = calloc((size_t)PROFILE_ARRAYS*(Program->InstructionCount + 1), sizeof(u64));
+    Profile->Counts[COVERAGE_ARRIVED] = ProfileArray(Counts, Program->InstructionCount, COVERAGE_ARRIVED);
+    Profile->Counts[COVERAGE_JUMPED] = ProfileArray(Counts, Program->InstructionCount, COVERAGE_JUMPED);
+    Profile->Counts[COVERAGE_FELL_THROUGH] = ProfileArray(Counts, Program->InstructionCount, COVERAGE_FELL_THROUGH);
+    RunProfile = Profile;
+    atexit(WriteProfile);
+    return Profile;
+}
+
+typedef enum {
+    EDGE_CALL, // to the instruction a RETURN comes back to, has to stay right after it
+    EDGE_FALL, // falls through to a block something jumps to, needs a JMP when it's apart
+    EDGE_JUMP, // JMP, goes away when it's together
+    EDGE_BRANCH, // either way of a JPE, JPN, JPG or JPL
+} edge_kind;
+
+typedef struct {
+    u32 From;
+    u32 To;
+    u64 Weight;
+    edge_kind Kind;
+} layout_edge;
+
+// NOTE(vic): The edges that can't be apart first, then the ones taken more often
+static int CompareEdges(const void *a, const void *b)
+{
+    const layout_edge *A = a;
+    const layout_edge *B = b;
+    if((A->Kind == EDGE_CALL) != (B->Kind == EDGE_CALL)) return A->Kind == EDGE_CALL ? -1 : 1;
+    if(A->Weight != B->Weight) return A->Weight > B->Weight ? -1 : 1;
+    if((A->Kind == EDGE_BRANCH) != (B->Kind == EDGE_BRANCH)) return A->Kind == EDGE_BRANCH ? 1 : -1;
+    if((A->To == A->From + 1) != (B->To == B->From + 1)) return A->To == A->From + 1 ? -1 : 1;
+    return A->From < B->From ? -1 : A->From > B->From ? 1 : 0;
+}
+
+typedef struct {
+    u32 Head;
+    int Rank; // 0 for the entry point, 2 for falling off the end
+    u64 Heat; // runs of its hottest block
+} layout_chain;
+
+static int CompareChains(const void *a, const void *b)
+{
+    const layout_chain *A = a;
+    const layout_chain *B = b;
+    if(A->Rank != B->Rank) return A->Rank - B->Rank;
+    if(A->Heat != B->Heat) return A->Heat > B->Heat ? -1 : 1;
+    return A->Head < B->Head ? -1 : A->Head > B->Head ? 1 : 0;
+}
+
+static int EndsBlock(int Opcode)
+{
+    return Opcode == IOP_JMP || IsBranchInstruction(Opcode) || Opcode == IOP_END || Opcode == IOP_RETURN;
+}
+
+// NOTE(vic): Returns 0 and prints the reason if there's no profile for this program
+static int LayoutProgram(linked_program *Program, String_View FirstFile, const char *Extension)
+{
+    char *Path = ReplaceExtension(FirstFile, Extension, ".alp");
+    u32 Count = Program->InstructionCount;
+    u64 *Counts = calloc((size_t)PROFILE_ARRAYS*(Count + 1), sizeof(u64));
+    FILE *Existing = fopen(Path, "rb");
+    if(!Existing) {
+        fprintf(stderr, "ERROR: Could not read file %s: %s\n"
+                "NOTE: Make a profile first with '-profile'\n", Path, strerror(errno));
+        return 0;
+    }
+    fclose(Existing);
+    if(!AddProfile(Path, HashProgram(Program), Count, Counts)) {
+        fprintf(stderr, "ERROR: %s was made with a different program, or different flags\n"
+                "NOTE: Make it again with '-profile'\n", Path);
+        return 0;
+    }
+    u64 *Arrived = ProfileArray(Counts, Count, COVERAGE_ARRIVED);
+    u64 *Jumped = ProfileArray(Counts, Count, COVERAGE_JUMPED);
+    u64 *FellThrough = ProfileArray(Counts, Count, COVERAGE_FELL_THROUGH);
+    instruction *Instructions = Program->Instructions;
+    
+    // NOTE(vic): How many times each instruction ran, from where control went (as -stats does)
+    u64 *Ran = calloc(Count + 1, sizeof(u64));
+    u8 *Leader = calloc(Count + 1, 1);
+    Leader[0] = 1;
+    Leader[Program->EntryPoint < Count ? Program->EntryPoint : Count] = 1;
+    for(u32 i = 0; i < Count; i++)
+    {
+        instruction *Instruction = Instructions + i;
+        Ran[i] += Arrived[i];
+        Ran[i + 1] += FellThrough[i];
+        if(IsJumpInstruction(Instruction->Opcode) && Instruction->Target != INVALID_TARGET) {
+            Ran[Instruction->Target] += Jumped[i];
+            Leader[Instruction->Target] = 1;
+        }
+        if(EndsBlock(Instruction->Opcode)) Leader[i + 1] = 1;
+    }
+    for(u32 i = 1; i < Count; i++) {
+        if(FallsThrough(Instructions[i - 1].Opcode)) Ran[i] += Ran[i - 1];
+    }
+    
+    // NOTE(vic): The blocks, with what they go to
+    u32 BlockCount = 0;
+    for(u32 i = 0; i < Count; i++) BlockCount += Leader[i];
+    u32 *BlockStart = malloc((BlockCount + 1)*sizeof(u32));
+    u32 *BlockOf = malloc((Count + 1)*sizeof(u32));
+    BlockCount = 0;
+    for(u32 i = 0; i < Count; i++) {
+        if(Leader[i]) BlockStart[BlockCount++] = i;
+        BlockOf[i] = BlockCount - 1;
+    }
+    BlockStart[BlockCount] = Count;
+    BlockOf[Count] = BlockCount;
+    
+    layout_edge *Edges = malloc((2*BlockCount + 1)*sizeof(layout_edge));
+    u32 EdgeCount = 0;
+    u32 LastBlock = BlockCount; // falls off the end of the program, so it has to stay last
+    for(u32 b = 0; b < BlockCount; b++)
+    {
+        u32 End = BlockStart[b + 1] - 1;
+        instruction *Instruction = Instructions + End;
+        int Opcode = Instruction->Opcode;
+        int HasTarget = Instruction->Target != INVALID_TARGET;
+        if(Opcode == IOP_JMP && HasTarget) {
+            Edges[EdgeCount++] = (layout_edge){ b, BlockOf[Instruction->Target], Jumped[End], EDGE_JUMP };
+        }
+        else if(IsBranchInstruction(Opcode)) {
+            if(HasTarget) Edges[EdgeCount++] = (layout_edge){ b, BlockOf[Instruction->Target], Jumped[End], EDGE_BRANCH };
+            if(End + 1 < Count) Edges[EdgeCount++] = (layout_edge){ b, b + 1, FellThrough[End], EDGE_BRANCH };
+        }
+        else if(Opcode != IOP_JMP && Opcode != IOP_END && Opcode != IOP_RETURN && End + 1 < Count) {
+            Edges[EdgeCount++] = (layout_edge){ b, b + 1, Ran[End], Opcode == IOP_CALL ? EDGE_CALL : EDGE_FALL };
+        }
+        if(End + 1 == Count && Opcode != IOP_JMP && Opcode != IOP_END && Opcode != IOP_RETURN) {
+            LastBlock = b;
+        }
+    }
+    qsort(Edges, EdgeCount, sizeof(layout_edge), CompareEdges);
+    
+    // NOTE(vic): Chains of blocks, an edge joins the end of one to the start of another
+    u32 *Next = malloc(BlockCount*sizeof(u32));
+    u32 *Previous = malloc(BlockCount*sizeof(u32));
+    u32 *OtherEnd = malloc(BlockCount*sizeof(u32));
+    for(u32 b = 0; b < BlockCount; b++)
+    {
+        Next[b] = Previous[b] = BlockCount;
+        OtherEnd[b] = b;
+    }
+    for(u32 e = 0; e < EdgeCount; e++)
+    {
+        layout_edge *Edge = Edges + e;
+        if(Edge->From == LastBlock || Next[Edge->From] != BlockCount || Previous[Edge->To] != BlockCount) continue;
+        u32 Head = OtherEnd[Edge->From];
+        u32 Tail = OtherEnd[Edge->To];
+        if(Head == Edge->To) continue;
+        Next[Edge->From] = Edge->To;
+        Previous[Edge->To] = Edge->From;
+        OtherEnd[Head] = Tail;
+        OtherEnd[Tail] = Head;
+    }
+    
+    // NOTE(vic): The entry point's chain first, then the hottest, the one that falls off the end last
+    u32 EntryBlock = Program->EntryPoint < Count ? BlockOf[Program->EntryPoint] : BlockCount;
+    layout_chain *Chains = malloc(BlockCount*sizeof(layout_chain));
+    u32 ChainCount = 0;
+    for(u32 b = 0; b < BlockCount; b++)
+    {
+        if(Previous[b] != BlockCount) continue;
+        layout_chain *Chain = Chains + ChainCount++;
+        Chain->Head = b;
+        Chain->Heat = 0;
+        Chain->Rank = 1;
+        for(u32 c = b; c != BlockCount; c = Next[c])
+        {
+            if(Ran[BlockStart[c]] > Chain->Heat) Chain->Heat = Ran[BlockStart[c]];
+            if(c == EntryBlock && Chain->Rank == 1) Chain->Rank = 0;
+            if(c == LastBlock) Chain->Rank = 2;
+        }
+    }
+    qsort(Chains, ChainCount, sizeof(layout_chain), CompareChains);
+    u32 *Order = malloc(BlockCount*sizeof(u32));
+    u32 OrderCount = 0;
+    for(u32 c = 0; c < ChainCount; c++) {
+        for(u32 b = Chains[c].Head; b != BlockCount; b = Next[b]) Order[OrderCount++] = b;
+    }
+    
+    // NOTE(vic): Where every instruction goes, a JMP that was removed goes to where its target does
+    u32 *NewIndex = calloc(Count + 1, sizeof(u32));
+    u8 *Removed = calloc(Count + 1, 1);
+    u8 *Inverted = calloc(Count + 1, 1);
+    u8 *JumpAfter = calloc(Count + 1, 1); // to the next block of the source
+    u32 NewCount = 0;
+    for(u32 o = 0; o < OrderCount; o++)
+    {
+        u32 b = Order[o];
+        u32 After = o + 1 < OrderCount ? Order[o + 1] : BlockCount;
+        u32 End = BlockStart[b + 1] - 1;
+        instruction *Instruction = Instructions + End;
+        int Opcode = Instruction->Opcode;
+        int HasTarget = Instruction->Target != INVALID_TARGET;
+        if(Opcode == IOP_JMP) {
+            Removed[End] = HasTarget && BlockOf[Instruction->Target] == After;
+        }
+        else if(IsBranchInstruction(Opcode) && End + 1 < Count && After != b + 1) {
+            // NOTE(vic): JPG and JPL have no opposite, they get a JMP after them like the others
+            Inverted[End] = HasTarget && BlockOf[Instruction->Target] == After &&
+                (Opcode == IOP_JPE || Opcode == IOP_JPN);
+            JumpAfter[End] = !Inverted[End];
+        }
+        else if(Opcode != IOP_END && Opcode != IOP_RETURN && End + 1 < Count && After != b + 1) {
+            JumpAfter[End] = 1;
+        }
+        
+        for(u32 i = BlockStart[b]; i <= End; i++) {
+            NewIndex[i] = NewCount;
+            NewCount += !Removed[i];
+        }
+        NewCount += JumpAfter[End];
+    }
+    NewIndex[Count] = NewCount;
+    
+    instruction *NewInstructions = malloc((NewCount + 1)*sizeof(instruction));
+    instruction_info *NewInfo = malloc((NewCount + 1)*sizeof(instruction_info));
+    for(u32 o = 0; o < OrderCount; o++)
+    {
+        u32 b = Order[o];
+        for(u32 i = BlockStart[b]; i < BlockStart[b + 1]; i++)
+        {
+            if(Removed[i]) continue;
+            instruction *Copy = NewInstructions + NewIndex[i];
+            *Copy = Instructions[i];
+            NewInfo[NewIndex[i]] = Program->InstructionInfo[i];
+            if(IsJumpInstruction(Copy->Opcode) && Copy->Target != INVALID_TARGET) {
+                Copy->Target = NewIndex[Copy->Target];
+            }
+            if(Inverted[i]) {
+                Copy->Opcode = Copy->Opcode == IOP_JPE ? IOP_JPN : IOP_JPE;
+                Copy->Target = NewIndex[i + 1];
+            }
+            if(JumpAfter[i]) {
+                // NOTE(vic): It's on the line that used to fall through
+                instruction *Jump = Copy + 1;
+                memset(Jump, 0, sizeof(instruction));
+                Jump->Opcode = IOP_JMP;
+                Jump->AddressFileIndex = Program->InstructionInfo[i + 1].FileIndex;
+                Jump->Target = NewIndex[i + 1];
+                NewInfo[NewIndex[i] + 1] = Program->InstructionInfo[i];
+                NewInfo[NewIndex[i] + 1].Operand = Program->InstructionInfo[i + 1].LineInFile;
+            }
+        }
+    }
+    
+    Program->Instructions = NewInstructions;
+    Program->InstructionInfo = NewInfo;
+    Program->InstructionCount = NewCount;
+    Program->EntryPoint = NewIndex[Program->EntryPoint < Count ? Program->EntryPoint : Count];
+    
+    free(Counts);
+    free(Ran);
+    free(Leader);
+    free(BlockStart);
+    free(BlockOf);
+    free(Edges);
+    free(Next);
+    free(Previous);
+    free(OtherEnd);
+    free(Chains);
+    free(Order);
+    free(NewIndex);
+    free(Removed);
+    free(Inverted);
+    free(JumpAfter);
+    free(Path);
+    return 1;
+}
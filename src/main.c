@@ -11,12 +11,42 @@ Name: ALA (A Level Assembler)
 #include <stdlib.h>
 #include <string.h>
 #include <assert.h>
+#include <errno.h>
+#include <setjmp.h>
 
 #include "ala.h"
 #include "file.c"
+#include "image.c"
+#include "thread.c"
 
 #define PROGRAM_NAME "ala.exe"
 
+// NOTE(vic): Errors end the program, unless something (-watch) set a point to recover from
+thread_local jmp_buf *RecoverPoint;
+void Fail(void)
+{
+    if(RecoverPoint) {
+        longjmp(*RecoverPoint, 1);
+    }
+    exit(1);
+}
+
+// NOTE(vic): 0 in the children of -inputs, the parent writes the reports
+int ReportsAtExit = 1;
+
+// NOTE(vic): first.ala -> first.alb, the new extension is appended if Path doesn't end in From
+char *ReplaceExtension(String_View Path, const char *From, const char *To)
+{
+    if(sv_ends_with(Path, sv_from_cstr(From))) {
+        Path.count -= strlen(From);
+    }
+    size_t ToLength = strlen(To);
+    char *Result = malloc(Path.count + ToLength + 1);
+    memcpy(Result, Path.data, Path.count);
+    memcpy(Result + Path.count, To, ToLength + 1);
+    return Result;
+}
+
 void PrintAscii(void)
 {
     for(unsigned char c = 32; c != 0; c++)
@@ -91,11 +121,70 @@ void Usage(void)
         printf("Flags:\n"
                "no-jmp-limits: Removes the jump limits, in case you want infinite loops\n"
                "print-numbers: OUT instruction will print integers instead of characters\n"
-               "debug: Stop in each instruction and show ACC and IX register values by typing 'registers' or 'r'\n"
-               "extra: Adds in a couple extra instructions to make using this assembly easier\n\n"
+               "debug: Stop in each instruction and show ACC and IX register values by typing 'registers' or 'r',\n"
+               "       'break' and 'watch' stop at a line or label or when data changes, type 'help' for more\n"
+               "extra: Adds in a couple extra instructions to make using this assembly easier\n"
+               "compile: Write the program to a .alb image instead of running it, run it with "PROGRAM_NAME" <file>.alb\n"
+               "strip: Leave the debug info (file names and source lines) out of the .alb image\n"
+               "watch: Keep running, parse again the files that change and run the program again\n"
+               "O: Optimize the program before running or compiling it (constants are computed once, code\n"
+               "   that can't run or doesn't change the result is removed), errors still show the right lines.\n"
+               "   Multiplication and division loops and loops printing data run in one go, and the results\n"
+               "   of routines that only compute with registers and a few cells are cached (with 'extra')\n"
+               "memo-stats: With 'O', show which routines are cached and how often the cache was hit\n"
+               "inline: Copy small routines that don't CALL into the places that CALL them, the program\n"
+               "        takes fewer steps (not with 'debug')\n"
+               "record: Run the program and save its input to <file>.alr to replay it later\n"
+               "replay: Run the program again with the input saved by 'record' instead of reading it,\n"
+               "        with 'debug' it can also go back with 'reverse-step' and 'reverse-continue'\n"
+               "trace[=N]: Save the last N instructions run (65536 by default) to <file>.alt when the program\n"
+               "           ends or fails, show them with "PROGRAM_NAME" <file>.alt <file> [other files]\n"
+               "threads=N: Parse the input files with N threads (defaults to the number of processors)\n"
+               "object: Write each .ala file to a .alo object without linking, pass .alo files instead of\n"
+               "        their .ala files to link them (also works with 'compile')\n"
+               "server[=path]: Keep running and run the programs clients send, programs stay parsed between\n"
+               "               runs until their files change (linux only, the socket is $XDG_RUNTIME_DIR/ala.sock\n"
+               "               or /tmp/ala-<uid>/ala.sock)\n"
+               "client[=path]: Send the rest of the command line to a server and run it there, with the\n"
+               "               same input, output, errors and exit status as running it here\n"
+               "inputs=<file>: Run the program once for each line of the file (the line is its input) and show\n"
+               "               each run's output and exit status, the runs go together in lockstep (linux only)\n"
+               "snapshot[=where]: With 'inputs', run what comes before the first INP (or <where>, a label\n"
+               "                  or line) once and start every input from there\n"
+               "bench: With 'inputs', also time the same runs one after the other and compare. Without it,\n"
+               "       run the program and then time it with and without the checks for 'debug', 'record'\n"
+               "       and 'trace' in the loop (reads all the input first, linux only)\n"
+               "stats[=file]: When the program exits, write how long loading, parsing, resolving symbols,\n"
+               "              linking and running took, how many of each instruction ran, the jumps taken,\n"
+               "              the memory used by the arena and the peak memory, one 'name value' per line\n"
+               "              (to stderr or <file>)\n"
+               "cycles[=costs]: When the program exits, show the cycles it would take on a simple machine\n"
+               "                where accessing memory costs more (and more for LDI, STI, LDX and STX), the\n"
+               "                lines that cost the most, and every line's cycles in <file>.cyc. The <costs>\n"
+               "                file changes them, one '<instruction> <cycles>' (or MEMORY, INDIRECT, INDEXED)\n"
+               "                per line\n"
+               "expect=<file>: Compare the output with the file as it's printed and stop with an error at\n"
+               "               the first byte that differs or goes past its end, or if the output is shorter\n"
+               "coverage: When the program exits, add the lines that ran and the ways each JPE and JPN went to\n"
+               "          <file>.alc and write them as an annotated listing to <file>.cov and for lcov to\n"
+               "          <file>.info, runs add up until the program changes (also with 'inputs')\n"
+               "profile: When the program exits, add how often each jump was taken and each JPE and JPN fell\n"
+               "         through to <file>.alp, runs add up until the program changes\n"
+               "layout: Use <file>.alp (from 'profile' with the same flags) to move the code around so the\n"
+               "        jumps taken most often fall through instead, needs 'no-jmp-limits'\n"
+               "deterministic: Run the threads SPAWN starts in turns on one OS thread instead of each on\n"
+               "               its own, so every run goes the same way (also lets 'debug', 'trace', 'stats',\n"
+               "               'expect', 'coverage' and 'profile' see them)\n\n"
                "Extra instructions:\n"
                "CALL <label>: Records the current address and jumps to label\n"
-               "RETURN: Returns to the last recorded address (by a CALL instruction)");
+               "RETURN: Returns to the last recorded address (by a CALL instruction)\n"
+               "SPAWN <label>: Starts another thread at label with a copy of ACC and IX, its number goes to ACC\n"
+               "JOIN: Waits for the threads this one started to end (END waits for them too)\n"
+               "CAS <address>: If <address> has ACC, store IX there. ACC gets what it had, JPE jumps if it was stored\n"
+               "SUB, MUL, DIV, MOD #n/<address>: Subtract from, multiply, divide ACC or take the remainder\n"
+               "JPG/JPL <address>: Following a compare instruction, jump if ACC was greater/less\n"
+               "COPY <address>: Copies IX cells from the address in ACC on to the ones from <address> on\n"
+               "FILL <address>: Stores ACC in the IX cells from <address> on");
     }
     else if(*Option.data == 'I') {
         sv_chop_by_delim(&Option, ' ');
@@ -126,7 +215,7 @@ symbol *AddSymbol(memory_arena **Arena, symbol_table **SymbolTable, symbol Symbo
     symbol_table *Table = *SymbolTable;
     if(Table->Used == 1024) {
         Table->Next = PushStruct(Arena, symbol_table);
-        SymbolTable = &Table->Next;
+        *SymbolTable = Table->Next;
     }
     
     symbol *NewSymbol = &(*SymbolTable)->Symbols[(*SymbolTable)->Used++];
@@ -173,21 +262,51 @@ bool sv_strtol(String_View sv, tmp_cstr *tc, long int *out)
     return endptr != ptr && *endptr == '\0';
 }
 
-symbol *IsInSymbolTable(symbol_table *SymbolTable, String_View Symbol)
+u32 HashName(String_View Name)
 {
-    for(symbol_table *Table = SymbolTable;
-        Table;
-        Table = Table->Next)
-    {
-        for(int i = 0; i < Table->Used; i++)
-        {
-            if(sv_eq(Table->Symbols[i].Name, Symbol)) {
-                return &Table->Symbols[i];
-            }
+    u32 Hash = 2166136261u;
+    for(size_t i = 0; i < Name.count; i++) {
+        Hash = (Hash ^ (u8)Name.data[i])*16777619u;
+    }
+    return Hash;
+}
+
+// NOTE(vic): The lexer keeps a hash of the file's labels next to the symbol table
+symbol **FindSymbolBucket(lexer *Lexer, String_View Name)
+{
+    size_t Mask = Lexer->SymbolBucketCount - 1;
+    size_t Bucket = HashName(Name) & Mask;
+    while(Lexer->SymbolBuckets[Bucket] && !sv_eq(Lexer->SymbolBuckets[Bucket]->Name, Name)) {
+        Bucket = (Bucket + 1) & Mask;
+    }
+    return Lexer->SymbolBuckets + Bucket;
+}
+
+symbol *IsInSymbolTable(lexer *Lexer, String_View Name)
+{
+    if(!Lexer->SymbolBucketCount) {
+        return 0;
+    }
+    return *FindSymbolBucket(Lexer, Name);
+}
+
+symbol *AddLexerSymbol(lexer *Lexer, symbol Symbol)
+{
+    if(2*(Lexer->SymbolCount + 1) > Lexer->SymbolBucketCount) {
+        symbol **OldBuckets = Lexer->SymbolBuckets;
+        size_t OldBucketCount = Lexer->SymbolBucketCount;
+        Lexer->SymbolBucketCount = OldBucketCount ? 2*OldBucketCount : 64;
+        Lexer->SymbolBuckets = PushArray(Lexer->Arena, Lexer->SymbolBucketCount, symbol *);
+        memset(Lexer->SymbolBuckets, 0, Lexer->SymbolBucketCount*sizeof(symbol *));
+        for(size_t i = 0; i < OldBucketCount; i++) {
+            if(OldBuckets[i]) *FindSymbolBucket(Lexer, OldBuckets[i]->Name) = OldBuckets[i];
         }
     }
     
-    return 0;
+    symbol *NewSymbol = AddSymbol(Lexer->Arena, Lexer->CurrentSymbolTable, Symbol);
+    *FindSymbolBucket(Lexer, NewSymbol->Name) = NewSymbol;
+    Lexer->SymbolCount++;
+    return NewSymbol;
 }
 
 void ParseGeneralOperand(lexer *Lexer, size_t CurrentLine, String_View OperandToken, line_of_code *LOC)
@@ -195,13 +314,13 @@ void ParseGeneralOperand(lexer *Lexer, size_t CurrentLine, String_View OperandTo
     if(!sv_strtol(OperandToken, Lexer->tc, &LOC->Operand)) {
         // It's a label
         if(GetInstructionCode(OperandToken) != -1) {
-            fprintf(stderr, SV_Fmt"(%zu): ERROR: Invalid operand using reserved keyword\n",
+            fprintf(Lexer->Errors, SV_Fmt"(%zu): ERROR: Invalid operand using reserved keyword\n",
                     SV_Arg(*Lexer->File), CurrentLine);
-            exit(1);
+            Fail();
         }
         
         // Add an unevaluated symbol
-        symbol *TempSymbol = IsInSymbolTable(Lexer->SymbolTable, OperandToken);
+        symbol *TempSymbol = IsInSymbolTable(Lexer, OperandToken);
         if(TempSymbol) {
             LOC->Label = TempSymbol;
         }
@@ -210,39 +329,56 @@ void ParseGeneralOperand(lexer *Lexer, size_t CurrentLine, String_View OperandTo
             Symbol.Name = OperandToken;
             Symbol.LineRef = CurrentLine;
             Symbol.FileIndex = Lexer->FileIndex;
-            LOC->Label = AddSymbol(Lexer->Arena, Lexer->CurrentSymbolTable, Symbol);
+            LOC->Label = AddLexerSymbol(Lexer, Symbol);
         }
     }
 }
 
+// NOTE(vic): Immediates and the addresses of LDX, STX, COPY and FILL are linked in 32 bits. Where only the
+// bits matter they go up to &FFFFFFFF, where the value does they have to fit in an int. 0 if it isn't linked
+long long MaxLinkedOperand(line_of_code *LOC)
+{
+    if(LOC->Label) return 0;
+    switch(LOC->Opcode)
+    {
+        case IOP_LDM: case IOP_LDR: case IOP_LSL: case IOP_LSR: return UINT32_MAX;
+        case IOP_AND: case IOP_XOR: case IOP_OR: case IOP_SUB: case IOP_MUL: return LOC->Immediate ? UINT32_MAX : 0;
+        case IOP_CMP: case IOP_DIV: case IOP_MOD: return LOC->Immediate ? INT32_MAX : 0;
+        case IOP_LDX: case IOP_STX: case IOP_COPY: case IOP_FILL: return INT32_MAX;
+        default: return 0;
+    }
+}
+
 line_of_code ParseInstruction(lexer *Lexer, int Flags, size_t CurrentLine, String_View Line, int Opcode)
 {
     line_of_code LOC = {0};
     LOC.LineInFile = CurrentLine;
     LOC.Opcode = Opcode;
+    LOC.FileIndex = Lexer->FileIndex;
     
-    if(Opcode == IOP_INP || Opcode == IOP_OUT || Opcode == IOP_END || Opcode == IOP_RETURN) {
-        if(Opcode == IOP_RETURN && !IsSet(Flags, ALA_EXTRA)) {
-            fprintf(stderr,
-                    "\n"SV_Fmt"(%zu): ERROR: This instruction doesn't exist in A level assembly\n"
-                    "NOTE: To use this instruction, use the flag '-extra' to use this instruction",
-                    SV_Arg(*Lexer->File), CurrentLine);
-            exit(1);
-        }
-        
+    // NOTE(vic): Everything from CALL on is an extra
+    if(Opcode >= IOP_CALL && !IsSet(Flags, ALA_EXTRA)) {
+        fprintf(Lexer->Errors,
+                "\n"SV_Fmt"(%zu): ERROR: This instruction doesn't exist in A level assembly\n"
+                "NOTE: To use this instruction, use the flag '-extra' to use this instruction",
+                SV_Arg(*Lexer->File), CurrentLine);
+        Fail();
+    }
+    
+    if(Opcode == IOP_INP || Opcode == IOP_OUT || Opcode == IOP_END || Opcode == IOP_RETURN || Opcode == IOP_JOIN) {
         if(Line.count > 0 && (*Line.data != '/' || *(Line.data + 1) != '/'))
         {
-            fprintf(stderr, SV_Fmt"(%zu): ERROR: The operand '"SV_Fmt"' doesn't take an opcode\n", 
+            fprintf(Lexer->Errors, SV_Fmt"(%zu): ERROR: The operand '"SV_Fmt"' doesn't take an opcode\n", 
                     SV_Arg(*Lexer->File), CurrentLine, SV_Arg(InstructionList[Opcode]));
-            exit(1);
+            Fail();
         }
     }
     else
     {
         if(Line.count == 0) {
-            fprintf(stderr, SV_Fmt"(%zu): ERROR: The operand '"SV_Fmt"'Is missing an opcode\n", 
+            fprintf(Lexer->Errors, SV_Fmt"(%zu): ERROR: The operand '"SV_Fmt"'Is missing an opcode\n", 
                     SV_Arg(*Lexer->File), CurrentLine, SV_Arg(InstructionList[Opcode]));
-            exit(1);
+            Fail();
         }
         
         String_View OperandToken = sv_chop_by_delim(&Line, ' ');
@@ -250,10 +386,10 @@ line_of_code ParseInstruction(lexer *Lexer, int Flags, size_t CurrentLine, Strin
             if(Line.count == 1 || 
                (*Line.data != '/' && *(Line.data + 1) != '/'))
             {
-                fprintf(stderr, 
+                fprintf(Lexer->Errors, 
                         SV_Fmt"(%zu): ERROR: Unkown token(s) '"SV_Fmt"' after operand '"SV_Fmt"'\n",
                         SV_Arg(*Lexer->File), CurrentLine, SV_Arg(Line), SV_Arg(OperandToken));
-                exit(1);
+                Fail();
             }
         }
         
@@ -266,9 +402,9 @@ line_of_code ParseInstruction(lexer *Lexer, int Flags, size_t CurrentLine, Strin
                     LOC.Opcode = IOP_IXINC;
                 }
                 else if(!sv_eq(OperandToken, SV("ACC"))) {
-                    fprintf(stderr, SV_Fmt"(%zu): ERROR: The operand '"SV_Fmt"' doesn't take a register\n", 
+                    fprintf(Lexer->Errors, SV_Fmt"(%zu): ERROR: The operand '"SV_Fmt"' doesn't take a register\n", 
                             SV_Arg(*Lexer->File), CurrentLine, SV_Arg(InstructionList[Opcode]));
-                    exit(1);
+                    Fail();
                 }
             } break;
             // registers
@@ -278,9 +414,9 @@ line_of_code ParseInstruction(lexer *Lexer, int Flags, size_t CurrentLine, Strin
                     LOC.Opcode = IOP_IXDEC;
                 }
                 else if(!sv_eq(OperandToken, SV("ACC"))) {
-                    fprintf(stderr, SV_Fmt"(%zu): ERROR: The operand '"SV_Fmt"' doesn't take a register\n", 
+                    fprintf(Lexer->Errors, SV_Fmt"(%zu): ERROR: The operand '"SV_Fmt"' doesn't take a register\n", 
                             SV_Arg(*Lexer->File), CurrentLine, SV_Arg(InstructionList[Opcode]));
-                    exit(1);
+                    Fail();
                 }
             } break;
             
@@ -294,19 +430,19 @@ line_of_code ParseInstruction(lexer *Lexer, int Flags, size_t CurrentLine, Strin
                     sv_chop_left(&OperandToken, 1);
                 }
                 else {
-                    fprintf(stderr, SV_Fmt"(%zu): ERROR: Invalid operand for "SV_Fmt".\n"
+                    fprintf(Lexer->Errors, SV_Fmt"(%zu): ERROR: Invalid operand for "SV_Fmt".\n"
                             SV_Fmt" operands start with a '#'.\n", SV_Arg(*Lexer->File), CurrentLine, 
                             SV_Arg(InstructionList[Opcode]), SV_Arg(InstructionList[Opcode]));
-                    exit(1);
+                    Fail();
                 }
                 
                 if(!sv_strtol(OperandToken, Lexer->tc, &LOC.Operand)) {
-                    fprintf(stderr, SV_Fmt"(%zu): ERROR: Invalid operand for "SV_Fmt".\n"
+                    fprintf(Lexer->Errors, SV_Fmt"(%zu): ERROR: Invalid operand for "SV_Fmt".\n"
                             "Immediate addressing has opcodes that only contain numbers starting with '#':.\n"
                             "#<number>\n"
                             "#5\n", SV_Arg(*Lexer->File), 
                             CurrentLine, SV_Arg(InstructionList[Opcode]));
-                    exit(1);
+                    Fail();
                 }
             } break;
             
@@ -321,43 +457,41 @@ line_of_code ParseInstruction(lexer *Lexer, int Flags, size_t CurrentLine, Strin
             case IOP_JMP:
             case IOP_JPE:
             case IOP_JPN:
+            case IOP_CAS:
+            case IOP_JPG:
+            case IOP_JPL:
+            case IOP_COPY:
+            case IOP_FILL:
             {
                 if(*OperandToken.data == '#') {
-                    fprintf(stderr, SV_Fmt"(%zu): ERROR: Invalid operand for "SV_Fmt"\n"
+                    fprintf(Lexer->Errors, SV_Fmt"(%zu): ERROR: Invalid operand for "SV_Fmt"\n"
                             SV_Fmt" doesn't have immediate addressing\n", 
                             SV_Arg(*Lexer->File), CurrentLine,
                             SV_Arg(InstructionList[Opcode]), SV_Arg(InstructionList[Opcode]));
-                    exit(1);
+                    Fail();
                 }
                 
                 ParseGeneralOperand(Lexer, CurrentLine, OperandToken, &LOC);
             } break;
             
             case IOP_CALL:
+            case IOP_SPAWN:
             {
-                if(!IsSet(Flags, ALA_EXTRA)) {
-                    fprintf(stderr,
-                            "\n"SV_Fmt"(%zu): ERROR: This instruction doesn't exist in A level assembly\n"
-                            "NOTE: To use this instruction, use the flag '-extra' to use this instruction",
-                            SV_Arg(*Lexer->File), CurrentLine);
-                    exit(1);
-                }
-                
                 // only takes labels
                 if(*OperandToken.data == '#') {
-                    fprintf(stderr, SV_Fmt"(%zu): ERROR: Invalid operand for "SV_Fmt"\n"
+                    fprintf(Lexer->Errors, SV_Fmt"(%zu): ERROR: Invalid operand for "SV_Fmt"\n"
                             SV_Fmt" Only takes labels\n", SV_Arg(*Lexer->File), CurrentLine,
                             SV_Arg(InstructionList[Opcode]), SV_Arg(InstructionList[Opcode]));
-                    exit(1);
+                    Fail();
                 }
                 
                 if(sv_strtol(OperandToken, Lexer->tc, &LOC.Operand)) {
-                    fprintf(stderr, SV_Fmt"(%zu): ERROR: Invalid operand for "SV_Fmt".\n"
+                    fprintf(Lexer->Errors, SV_Fmt"(%zu): ERROR: Invalid operand for "SV_Fmt".\n"
                             SV_Fmt" Only takes labels\n", SV_Arg(*Lexer->File), CurrentLine, SV_Arg(InstructionList[Opcode]), SV_Arg(InstructionList[Opcode]));
-                    exit(1);
+                    Fail();
                 }
                 
-                symbol *TempSymbol = IsInSymbolTable(Lexer->SymbolTable, OperandToken);
+                symbol *TempSymbol = IsInSymbolTable(Lexer, OperandToken);
                 if(TempSymbol) {
                     LOC.Label = TempSymbol;
                 }
@@ -366,7 +500,7 @@ line_of_code ParseInstruction(lexer *Lexer, int Flags, size_t CurrentLine, Strin
                     Symbol.Name = OperandToken;
                     Symbol.LineRef = CurrentLine;
                     Symbol.FileIndex = Lexer->FileIndex;
-                    LOC.Label = AddSymbol(Lexer->Arena, Lexer->CurrentSymbolTable, Symbol);
+                    LOC.Label = AddLexerSymbol(Lexer, Symbol);
                 }
             } break;
             
@@ -383,16 +517,24 @@ line_of_code ParseInstruction(lexer *Lexer, int Flags, size_t CurrentLine, Strin
         }
     }
     
+    long long MaxOperand = MaxLinkedOperand(&LOC);
+    if(MaxOperand && (LOC.Operand < INT32_MIN || LOC.Operand > MaxOperand)) {
+        fprintf(Lexer->Errors, SV_Fmt"(%zu): ERROR: The operand %ld is out of range for "SV_Fmt"\n"
+                "NOTE: Its operand is kept in 32 bits, from %d to %lld\n", SV_Arg(*Lexer->File), CurrentLine,
+                LOC.Operand, SV_Arg(InstructionList[LOC.Opcode]), INT32_MIN, MaxOperand);
+        Fail();
+    }
+    
     return LOC;
 }
 
 size_t ParseCode(String_View Content, lexer *Lexer, int Flags,
-                 line_map *LineMappings, size_t CurrentLOC)
+                 line_map *LineMappings, size_t FirstLine, size_t CurrentLOC)
 {
-    for(size_t CurrentLine = 0; Content.count > 0; CurrentLine++)
+    for(size_t CurrentLine = FirstLine; Content.count > 0; CurrentLine++)
     {
         String_View Line = sv_trim(sv_chop_by_delim(&Content, '\n'));
-        Lexer->ProgramLines[Lexer->FileIndex][CurrentLine] = Line;
+        Lexer->ProgramLines[CurrentLine] = Line;
         LineMappings[CurrentLine].LOC = CurrentLOC;
         if(Line.count == 0) {
             LineMappings[CurrentLine].Data = PushStruct(Lexer->Arena, long int);
@@ -413,14 +555,14 @@ size_t ParseCode(String_View Content, lexer *Lexer, int Flags,
             int Opcode = GetInstructionCode(OpcodeToken);
             if(Opcode == -1) {
                 if(OpcodeToken.data[OpcodeToken.count - 1] != ':') {
-                    fprintf(stderr, 
+                    fprintf(Lexer->Errors, 
                             SV_Fmt"(%zu): ERROR: Unknown token '"SV_Fmt"'.\n"
                             "Make labels with an identifier followed by a colon:\n"
                             SV_Fmt": \n"
                             "Make sure to add a space after the colon.\n", 
                             SV_Arg(*Lexer->File), CurrentLine, 
                             SV_Arg(OpcodeToken), SV_Arg(OpcodeToken));
-                    exit(1);
+                    Fail();
                 }
                 
                 int ShouldIncLOC = 0;
@@ -438,9 +580,9 @@ size_t ParseCode(String_View Content, lexer *Lexer, int Flags,
                             LineMappings[CurrentLine].Data = PushStruct(Lexer->Arena, long int);
                             *LineMappings[CurrentLine].Data = SymbolValue;
                         } else {
-                            fprintf(stderr, SV_Fmt"(%zu): ERROR: Invalid value for label "SV_Fmt"\n", 
+                            fprintf(Lexer->Errors, SV_Fmt"(%zu): ERROR: Invalid value for label "SV_Fmt"\n", 
                                     SV_Arg(*Lexer->File), CurrentLine, SV_Arg(OpcodeToken));
-                            exit(1);
+                            Fail();
                         }
                     }
                 }
@@ -453,23 +595,23 @@ size_t ParseCode(String_View Content, lexer *Lexer, int Flags,
                 }
                 
                 OpcodeToken.count--; // delete ':'
-                symbol *Symbol = IsInSymbolTable(Lexer->SymbolTable, OpcodeToken);
+                symbol *Symbol = IsInSymbolTable(Lexer, OpcodeToken);
                 if(Symbol) {
                     if(Symbol->Evaluated) {
-                        fprintf(stderr, SV_Fmt"(%zu): ERROR: Label already declared.\n"
+                        fprintf(Lexer->Errors, SV_Fmt"(%zu): ERROR: Label already declared.\n"
                                 SV_Fmt"(%zu): NOTE: See initial declaration of label\n",
                                 SV_Arg(*Lexer->File), CurrentLine, SV_Arg(*Lexer->File), Symbol->LineRef);
-                        exit(1);
+                        Fail();
                     }
                 }
                 else {
                     symbol NewSymbol = {
                         .Name = OpcodeToken,
                     };
-                    Symbol = AddSymbol(Lexer->Arena, Lexer->CurrentSymbolTable, NewSymbol);
+                    Symbol = AddLexerSymbol(Lexer, NewSymbol);
                     
                     if(Lexer->StartSymbol && sv_eq(Symbol->Name, SV("START"))) {
-                        fprintf(stderr, SV_Fmt"(%zu): ERROR: There can only be one START label\n"
+                        fprintf(Lexer->Errors, SV_Fmt"(%zu): ERROR: There can only be one START label\n"
                                 SV_Fmt"(%zu): NOTE: See first definition of the START label\n",
                                 SV_Arg(*Lexer->File), CurrentLine, SV_Arg(*Lexer->File), Symbol->LineRef);
                     }
@@ -500,435 +642,1030 @@ size_t ParseCode(String_View Content, lexer *Lexer, int Flags,
     return CurrentLOC;
 }
 
-#define CheckAddress(Line, Address, Message, ...) \
-if(Address > LineCounts[AddressFileIndex] || Address < 0) { \
-fprintf(stderr, \
-"\n"SV_Fmt"(%zu): ERROR: Incorrect address for operand, not in program" \
-Message, SV_Arg(FileNames[CurrentFileIndex]), Line, ##__VA_ARGS__); \
-exit(1); \
+size_t CountLines(String_View Content)
+{
+    size_t LineCount = 1;
+    for(size_t i = 0; i < Content.count; i++) {
+        if(Content.data[i] == '\n') LineCount++;
+    }
+    return LineCount;
 }
 
-#define CheckDataInAddress(Line, Address, Message, ...) \
-if(!LineMappings[AddressFileIndex][Address].Data) { \
-fprintf(stderr, "\n"SV_Fmt"(%zu): ERROR: No data in address %zd in file "SV_Fmt Message, \
-SV_Arg(FileNames[CurrentFileIndex]), Line, Address, \
-SV_Arg(FileNames[AddressFileIndex]), ##__VA_ARGS__); \
-exit(1); \
+// NOTE(vic): File->Name and File->Content must be set
+void ParseSourceFile(memory_arena **Arena, tmp_cstr *tc, source_file *File, int FileIndex, int Flags,
+                     FILE *Errors)
+{
+    File->LineCount = CountLines(File->Content);
+    File->Lines = PushArray(Arena, File->LineCount, String_View);
+    File->LineMappings = PushArray(Arena, File->LineCount, line_map);
+    File->Program = PushArray(Arena, File->LineCount, line_of_code);
+    File->SymbolTable = PushStruct(Arena, symbol_table);
+    symbol_table *CurrentSymbolTable = File->SymbolTable;
+    
+    lexer Lexer = {
+        .Arena = Arena,
+        .tc = tc,
+        .Errors = Errors,
+        .File = &File->Name,
+        .ProgramLines = File->Lines,
+        .FileIndex = FileIndex,
+        .Program = File->Program,
+        .StartSymbol = 0,
+        .StartLOC = 0,
+        .SymbolTable = File->SymbolTable,
+        .CurrentSymbolTable = &CurrentSymbolTable,
+    };
+    
+    File->LOCCount = ParseCode(File->Content, &Lexer, Flags, File->LineMappings, 0, 0);
+    File->StartSymbol = Lexer.StartSymbol;
+    File->StartLOC = Lexer.StartLOC;
 }
 
-#define CheckStoreDataInAddress(Line, Address, Message, ...) \
-if(!LineMappings[AddressFileIndex][Address].Data) { \
-fprintf(stderr, "\n"SV_Fmt"(%zu): ERROR: Invalid address %zd in file "SV_Fmt Message, \
-SV_Arg(FileNames[CurrentFileIndex]), Line, Address, \
-SV_Arg(FileNames[AddressFileIndex]), ##__VA_ARGS__); \
-exit(1); \
+// NOTE(vic): Returns 0 if the file had errors instead of ending the program
+int TryParseSourceFile(memory_arena **Arena, tmp_cstr *tc, source_file *File, int FileIndex, int Flags,
+                       FILE *Errors)
+{
+    jmp_buf Recover;
+    if(setjmp(Recover)) {
+        RecoverPoint = 0;
+        return 0;
+    }
+    RecoverPoint = &Recover;
+    ParseSourceFile(Arena, tc, File, FileIndex, Flags, Errors);
+    RecoverPoint = 0;
+    return 1;
 }
 
-#define CheckJumpToAddress(Line, Address, Message, ...) \
-if(LineMappings[AddressFileIndex][Address].Data) { \
-fprintf(stderr, \
-"\n"SV_Fmt"(%zu): ERROR: Invalid jump address %zd in file "SV_Fmt", it contains data"Message, \
-SV_Arg(FileNames[CurrentFileIndex]), Line, Address, \
-SV_Arg(FileNames[AddressFileIndex]), ##__VA_ARGS__); \
-exit(1); \
+typedef struct {
+    source_file *Files;
+    int FileCount;
+    int FirstFile;
+    int Stride;
+    int Flags;
+    FILE **Errors;
+    int *Failed;
+    int *Skip; // objects and files that were parsed in chunks
+} parse_job;
+
+void *ParseFilesJob(void *Data)
+{
+    parse_job *Job = (parse_job *)Data;
+    
+    size_t ArenaSize = 64*1024;
+    for(int i = Job->FirstFile; i < Job->FileCount; i += Job->Stride) {
+        ArenaSize += 16*Job->Files[i].Content.count;
+    }
+    memory_arena *Arena = CreateArena(ArenaSize);
+    tmp_cstr tc;
+    tc.Capacity = 1024;
+    tc.Cstr = (char *)malloc(1024);
+    
+    for(int i = Job->FirstFile; i < Job->FileCount; i += Job->Stride)
+    {
+        if(Job->Skip[i]) continue;
+        
+        // NOTE(vic): Diagnostics wait in a temporary file so they come out in file order
+        Job->Errors[i] = tmpfile();
+        FILE *Errors = Job->Errors[i] ? Job->Errors[i] : stderr;
+        Job->Failed[i] = !TryParseSourceFile(&Arena, &tc, Job->Files + i, i, Job->Flags, Errors);
+    }
+    
+    free(tc.Cstr);
+    return 0;
 }
 
-#define JMP_LIMIT 100000
-#define CheckJumpLimit(Address) \
-LineMappings[AddressFileIndex][Address].nJumps++; \
-if(LineMappings[AddressFileIndex][Address].nJumps > JMP_LIMIT && !IsSet(Flags, NO_JMP_LIMIT)) { \
-fprintf(stderr, "\n"SV_Fmt"(%zu): ERROR: Maximum jump limit reached\n" \
-"NOTE: If you want to disable this error use the '-no-jmp-limits' flag", \
-SV_Arg(FileNames[CurrentFileIndex]), Address); \
-exit(1); \
+void CopyErrors(FILE *From, FILE *To)
+{
+    char Buffer[4096];
+    size_t Read;
+    rewind(From);
+    while((Read = fread(Buffer, 1, sizeof(Buffer), From)) > 0) {
+        fwrite(Buffer, 1, Read, To);
+    }
 }
 
-#define JumpToLine() \
-if(LOC->Label) { \
-AddressFileIndex = LOC->Label->FileIndex; \
-CheckJumpToAddress(LOC->LineInFile, LOC->Label->LineRef, ""); \
-line = LineMappings[AddressFileIndex][LOC->Label->LineRef].LOC - 1; \
-} else { \
-CheckAddress(LOC->LineInFile, LOC->Operand, ""); \
-CheckJumpToAddress(LOC->LineInFile, (size_t)LOC->Operand, ""); \
-line = LineMappings[AddressFileIndex][LOC->Operand].LOC - 1; \
-} \
-CheckJumpLimit(Lexer->Program[line].LineInFile); \
-CurrentFileIndex = AddressFileIndex;
+// NOTE(vic): Files at least this big are split in chunks that are parsed in parallel
+#define CHUNKED_PARSE_MIN_SIZE (1024*1024)
+
+typedef struct {
+    source_file *File;
+    int FileIndex;
+    int Flags;
+    String_View Content;
+    size_t FirstLine;
+    size_t LineCount; // lines ParseCode goes through
+    FILE *Errors;
+    
+    line_of_code *Program; // LOC relative to the chunk
+    size_t LOCCount;
+    symbol_table *SymbolTable; // only this chunk's labels, merged in ParseSourceFileChunked
+    symbol *StartSymbol;
+    size_t StartLOC;
+    int Failed;
+} parse_chunk;
 
-void ShowStepCommands()
+void ParseChunk(parse_chunk *Chunk)
 {
-    printf("Commands:\n"
-           "help (h): Show commands\n"
-           "next (n/[enter]): Go to the next instruction\n"
-           "registers (r): Show the values in the ACC and IX registers\n"
-           "continue (c): Continue the execution (won't print executed instructions)\n"
-           "quit (q): Quit ALA debugger\n");
+    memory_arena *Arena = CreateArena(64*1024 + 16*Chunk->Content.count);
+    tmp_cstr tc;
+    tc.Capacity = 1024;
+    tc.Cstr = (char *)malloc(1024);
+    
+    Chunk->Program = PushArray(&Arena, Chunk->LineCount + 1, line_of_code);
+    Chunk->SymbolTable = PushStruct(&Arena, symbol_table);
+    symbol_table *CurrentSymbolTable = Chunk->SymbolTable;
+    
+    // NOTE(vic): Lines and line maps belong to the file, every chunk writes its own range
+    lexer Lexer = {
+        .Arena = &Arena,
+        .tc = &tc,
+        .Errors = Chunk->Errors,
+        .File = &Chunk->File->Name,
+        .ProgramLines = Chunk->File->Lines,
+        .FileIndex = Chunk->FileIndex,
+        .Program = Chunk->Program,
+        .SymbolTable = Chunk->SymbolTable,
+        .CurrentSymbolTable = &CurrentSymbolTable,
+    };
+    
+    Chunk->LOCCount = ParseCode(Chunk->Content, &Lexer, Chunk->Flags, Chunk->File->LineMappings,
+                                Chunk->FirstLine, 0);
+    Chunk->StartSymbol = Lexer.StartSymbol;
+    Chunk->StartLOC = Lexer.StartLOC;
+    free(tc.Cstr);
 }
 
-void Evaluate(String_View *FileNames, lexer *Lexer, 
-              line_map **LineMappings, size_t *LineCounts, size_t ProgramLength, int Flags) {
-    int ACC = 0; // accumulator
-    int IX = 0; // index register
-    int LastCompareResult = 0;
-    size_t ReturnAddress = 0;
-    int CurrentFileIndex = Lexer->StartSymbol->FileIndex;
-    int PreviousFileIndex = Lexer->StartSymbol->FileIndex;
-    
-    int StepThroughCode = IsSet(Flags, ALA_DEBUG);
-    if(StepThroughCode) {
-        ShowStepCommands();
+void *ParseChunkJob(void *Data)
+{
+    parse_chunk *Chunk = (parse_chunk *)Data;
+    jmp_buf Recover;
+    if(setjmp(Recover)) {
+        Chunk->Failed = 1;
+    }
+    else {
+        RecoverPoint = &Recover;
+        ParseChunk(Chunk);
     }
+    RecoverPoint = 0;
+    return 0;
+}
+
+// NOTE(vic): Returns 0 if the file has errors, written like ParseSourceFile would
+int ParseSourceFileChunked(memory_arena **Arena, source_file *File, int FileIndex, int Flags,
+                           int ChunkCount, FILE *Errors)
+{
+    File->LineCount = CountLines(File->Content);
+    File->Lines = PushArray(Arena, File->LineCount, String_View);
+    File->LineMappings = PushArray(Arena, File->LineCount, line_map);
+    File->Program = PushArray(Arena, File->LineCount, line_of_code);
+    File->SymbolTable = PushStruct(Arena, symbol_table);
+    File->StartSymbol = 0;
+    File->StartLOC = 0;
     
-    for(size_t line = Lexer->StartLOC;
-        line < ProgramLength;
-        line++)
+    parse_chunk *Chunks = PushArray(Arena, ChunkCount, parse_chunk);
+    thread *Threads = PushArray(Arena, ChunkCount, thread);
+    String_View Rest = File->Content;
+    size_t FirstLine = 0;
+    for(int i = 0; i < ChunkCount; i++)
     {
-        line_of_code *LOC = Lexer->Program + line;
-        int AddressFileIndex = CurrentFileIndex;
+        size_t Size = Rest.count/(ChunkCount - i);
+        while(Size < Rest.count && (Size == 0 || Rest.data[Size - 1] != '\n')) Size++;
+        
+        parse_chunk *Chunk = Chunks + i;
+        Chunk->File = File;
+        Chunk->FileIndex = FileIndex;
+        Chunk->Flags = Flags;
+        Chunk->Content = sv_chop_left(&Rest, Size);
+        Chunk->FirstLine = FirstLine;
+        Chunk->LineCount = CountLines(Chunk->Content) - 1;
+        if(Size > 0 && Chunk->Content.data[Size - 1] != '\n') Chunk->LineCount++;
+        Chunk->Errors = tmpfile();
+        if(!Chunk->Errors) Chunk->Errors = Errors;
+        FirstLine += Chunk->LineCount;
         
-        if(StepThroughCode) {
-            size_t LineInFile = LOC->LineInFile;
-            printf("%zu: "SV_Fmt"\n", LineInFile, SV_Arg(Lexer->ProgramLines[CurrentFileIndex][LineInFile]));
+        Threads[i] = StartThread(ParseChunkJob, Chunk);
+    }
+    for(int i = 0; i < ChunkCount; i++) {
+        JoinThread(Threads[i]);
+    }
+    
+    size_t SymbolCount = 0;
+    for(int i = 0; i < ChunkCount; i++) {
+        for(symbol_table *Table = Chunks[i].SymbolTable; Table; Table = Table->Next) {
+            SymbolCount += Table->Used;
         }
+    }
+    size_t BucketCount = 16;
+    while(BucketCount < 2*SymbolCount) BucketCount *= 2;
+    symbol **Buckets = PushArray(Arena, BucketCount, symbol *);
+    memset(Buckets, 0, BucketCount*sizeof(symbol *));
+    symbol_table *CurrentSymbolTable = File->SymbolTable;
+    
+    size_t FirstLOC = 0;
+    for(int i = 0; i < ChunkCount; i++)
+    {
+        parse_chunk *Chunk = Chunks + i;
         
-        switch(LOC->Opcode)
+        // NOTE(vic): Definition points at the merged symbol until ResolveSymbols
+        symbol *Duplicate = 0;
+        symbol *FirstDeclaration = 0;
+        for(symbol_table *Table = Chunk->SymbolTable; Table; Table = Table->Next)
         {
-            case IOP_LDM:
-            {
-                ACC = LOC->Operand;
-            } break;
-            
-            case IOP_LDD:
+            for(int SymbolIndex = 0; SymbolIndex < Table->Used; SymbolIndex++)
             {
-                if(LOC->Label) {
-                    AddressFileIndex = LOC->Label->FileIndex;
-                    CheckDataInAddress(LOC->LineInFile, LOC->Label->LineRef, "");
-                    ACC = *LineMappings[AddressFileIndex][LOC->Label->LineRef].Data;
-                }
-                else {
-                    CheckAddress(LOC->LineInFile, LOC->Operand, "");
-                    CheckDataInAddress(LOC->LineInFile, (size_t)LOC->Operand, "");
-                    
-                    ACC = *LineMappings[AddressFileIndex][LOC->Operand].Data;
+                symbol *Symbol = Table->Symbols + SymbolIndex;
+                size_t Bucket = HashName(Symbol->Name) & (BucketCount - 1);
+                while(Buckets[Bucket] && !sv_eq(Buckets[Bucket]->Name, Symbol->Name)) {
+                    Bucket = (Bucket + 1) & (BucketCount - 1);
                 }
-            } break;
-            
-            case IOP_LDI:
-            {
-                size_t AddressToAddress;
-                if(LOC->Label) {
-                    AddressToAddress = LOC->Label->LineRef;
-                    AddressFileIndex = LOC->Label->FileIndex;
+                
+                symbol *Merged = Buckets[Bucket];
+                if(!Merged) {
+                    Merged = AddSymbol(Arena, &CurrentSymbolTable, *Symbol);
+                    Buckets[Bucket] = Merged;
                 }
-                else {
-                    AddressToAddress = LOC->Operand;
-                    CheckAddress(LOC->LineInFile, AddressToAddress, "");
+                else if(Symbol->Evaluated) {
+                    if(Merged->Evaluated) {
+                        if(!Duplicate || Symbol->LineRef < Duplicate->LineRef) {
+                            Duplicate = Symbol;
+                            FirstDeclaration = Merged;
+                        }
+                    }
+                    else {
+                        Merged->Evaluated = 1;
+                        Merged->LineRef = Symbol->LineRef;
+                    }
                 }
-                CheckDataInAddress(LOC->LineInFile, AddressToAddress, "");
-                
-                size_t Address = *LineMappings[AddressFileIndex][AddressToAddress].Data;
-                CheckAddress(LOC->LineInFile, Address, 
-                             "\nAddress %zd (from data in address %zd in file "SV_Fmt") not in program",
-                             Address, AddressToAddress, SV_Arg(FileNames[AddressFileIndex]));
-                CheckDataInAddress(LOC->LineInFile, Address,
-                                   "\nNOTE: Remember LDI is for indirect addressing");
-                
-                ACC = *LineMappings[AddressFileIndex][Address].Data;
-            } break;
-            
-            case IOP_LDX:
+                Symbol->Definition = Merged;
+            }
+        }
+        
+        if(Duplicate) {
+            fprintf(Errors, SV_Fmt"(%zu): ERROR: Label already declared.\n"
+                    SV_Fmt"(%zu): NOTE: See initial declaration of label\n",
+                    SV_Arg(File->Name), Duplicate->LineRef, SV_Arg(File->Name), FirstDeclaration->LineRef);
+            return 0;
+        }
+        if(Chunk->Errors != Errors) {
+            CopyErrors(Chunk->Errors, Errors);
+            fclose(Chunk->Errors);
+        }
+        if(Chunk->Failed) {
+            return 0;
+        }
+        
+        line_of_code *Program = File->Program + FirstLOC;
+        memcpy(Program, Chunk->Program, Chunk->LOCCount*sizeof(line_of_code));
+        for(size_t LOC = 0; LOC < Chunk->LOCCount; LOC++) {
+            if(Program[LOC].Label) Program[LOC].Label = Program[LOC].Label->Definition;
+        }
+        for(size_t Line = Chunk->FirstLine; Line < Chunk->FirstLine + Chunk->LineCount; Line++) {
+            line_map *Map = File->LineMappings + Line;
+            Map->LOC += FirstLOC;
+            if(Map->Symbol) Map->Symbol = Map->Symbol->Definition;
+        }
+        if(Chunk->StartSymbol) {
+            File->StartSymbol = Chunk->StartSymbol->Definition;
+            File->StartLOC = FirstLOC + Chunk->StartLOC;
+        }
+        
+        FirstLOC += Chunk->LOCCount;
+    }
+    
+    File->LOCCount = FirstLOC;
+    return 1;
+}
+
+// NOTE(vic): Errors come out as if the files had been parsed one after the other
+void ParseSourceFiles(memory_arena **Arena, tmp_cstr *tc, source_file *Files, int FileCount,
+                      int Flags, int ThreadCount)
+{
+    if(ThreadCount <= 1) {
+        for(int FileIndex = 0; FileIndex < FileCount; FileIndex++)
+        {
+            if(!Files[FileIndex].IsObject) {
+                ParseSourceFile(Arena, tc, Files + FileIndex, FileIndex, Flags, stderr);
+            }
+        }
+        return;
+    }
+    
+    FILE **Errors = PushArray(Arena, FileCount, FILE *);
+    int *Failed = PushArray(Arena, FileCount, int);
+    int *Skip = PushArray(Arena, FileCount, int);
+    int FilesLeft = 0;
+    for(int FileIndex = 0; FileIndex < FileCount; FileIndex++)
+    {
+        source_file *File = Files + FileIndex;
+        Skip[FileIndex] = File->IsObject;
+        if(!File->IsObject && File->Content.count >= CHUNKED_PARSE_MIN_SIZE) {
+            Errors[FileIndex] = tmpfile();
+            Failed[FileIndex] = !ParseSourceFileChunked(Arena, File, FileIndex, Flags, ThreadCount,
+                                                        Errors[FileIndex] ? Errors[FileIndex] : stderr);
+            Skip[FileIndex] = 1;
+        }
+        FilesLeft += !Skip[FileIndex];
+    }
+    
+    if(ThreadCount > FilesLeft) ThreadCount = FilesLeft;
+    parse_job *Jobs = PushArray(Arena, ThreadCount, parse_job);
+    thread *Threads = PushArray(Arena, ThreadCount, thread);
+    for(int i = 0; i < ThreadCount; i++)
+    {
+        parse_job Job = {
+            .Files = Files,
+            .FileCount = FileCount,
+            .FirstFile = i,
+            .Stride = ThreadCount,
+            .Flags = Flags,
+            .Errors = Errors,
+            .Failed = Failed,
+            .Skip = Skip,
+        };
+        Jobs[i] = Job;
+        Threads[i] = StartThread(ParseFilesJob, Jobs + i);
+    }
+    for(int i = 0; i < ThreadCount; i++) {
+        JoinThread(Threads[i]);
+    }
+    
+    for(int FileIndex = 0; FileIndex < FileCount; FileIndex++)
+    {
+        if(Errors[FileIndex]) {
+            CopyErrors(Errors[FileIndex], stderr);
+            fclose(Errors[FileIndex]);
+        }
+        if(Failed[FileIndex]) {
+            Fail();
+        }
+    }
+}
+
+// NOTE(vic): Returns the index of the file START is declared in
+int ResolveSymbols(memory_arena **Arena, source_file *Files, int FileCount)
+{
+    size_t DeclarationCount = 0;
+    for(int FileIndex = 0; FileIndex < FileCount; FileIndex++) {
+        for(symbol_table *Table = Files[FileIndex].SymbolTable; Table; Table = Table->Next) {
+            DeclarationCount += Table->Used;
+        }
+    }
+    
+    size_t BucketCount = 16;
+    while(BucketCount < 2*DeclarationCount) BucketCount *= 2;
+    symbol **Buckets = PushArray(Arena, BucketCount, symbol *);
+    memset(Buckets, 0, BucketCount*sizeof(symbol *));
+    
+    int StartFileIndex = -1;
+    for(int FileIndex = 0; FileIndex < FileCount; FileIndex++)
+    {
+        source_file *File = Files + FileIndex;
+        for(symbol_table *Table = File->SymbolTable; Table; Table = Table->Next)
+        {
+            for(int i = 0; i < Table->Used; i++)
             {
-                size_t Address = IX;
-                if(LOC->Label) {
-                    Address += LOC->Label->LineRef;
-                    AddressFileIndex = LOC->Label->FileIndex;
+                symbol *Symbol = Table->Symbols + i;
+                if(!Symbol->Evaluated) continue;
+                
+                size_t Bucket = HashName(Symbol->Name) & (BucketCount - 1);
+                while(Buckets[Bucket] && !sv_eq(Buckets[Bucket]->Name, Symbol->Name)) {
+                    Bucket = (Bucket + 1) & (BucketCount - 1);
                 }
-                else {
-                    Address += LOC->Operand;
+                if(Buckets[Bucket]) {
+                    symbol *First = Buckets[Bucket];
+                    fprintf(stderr, SV_Fmt"(%zu): ERROR: Label already declared.\n"
+                            SV_Fmt"(%zu): NOTE: See initial declaration of label\n",
+                            SV_Arg(File->Name), Symbol->LineRef,
+                            SV_Arg(Files[First->FileIndex].Name), First->LineRef);
+                    Fail();
                 }
+                Buckets[Bucket] = Symbol;
                 
-                CheckAddress(LOC->LineInFile, Address, 
-                             "\nNOTE: Address is %zd (%zd + IX) in file "SV_Fmt, Address, Address - IX,
-                             SV_Arg(FileNames[AddressFileIndex]));
-                CheckDataInAddress(LOC->LineInFile, Address, 
-                                   "\nNOTE: Remember LDX is for indexed addressing.\n"
-                                   "So the address is %zd + IX", Address - IX);
-                
-                ACC = *LineMappings[AddressFileIndex][Address].Data;
-            } break;
-            
-            case IOP_LDR:
-            {
-                IX = LOC->Operand;
-            } break;
-            
-            case IOP_STO:
-            {
-                if(LOC->Label) {
-                    AddressFileIndex = LOC->Label->FileIndex;
-                    CheckStoreDataInAddress(LOC->LineInFile, LOC->Label->LineRef, "");
-                    *LineMappings[AddressFileIndex][LOC->Label->LineRef].Data = ACC;
-                }
-                else {
-                    CheckAddress(LOC->LineInFile, LOC->Operand, "");
-                    CheckStoreDataInAddress(LOC->LineInFile, (size_t)LOC->Operand, "");
-                    
-                    *LineMappings[AddressFileIndex][LOC->Operand].Data = ACC;
+                if(File->StartSymbol == Symbol) {
+                    StartFileIndex = FileIndex;
                 }
-            } break;
-            
-            case IOP_STX:
+            }
+        }
+    }
+    
+    if(StartFileIndex == -1) {
+        fprintf(stderr, "ERROR: Start label not found\n");
+        Fail();
+    }
+    
+    for(int FileIndex = 0; FileIndex < FileCount; FileIndex++)
+    {
+        source_file *File = Files + FileIndex;
+        for(symbol_table *Table = File->SymbolTable; Table; Table = Table->Next)
+        {
+            for(int i = 0; i < Table->Used; i++)
             {
-                size_t Address = IX;
-                if(LOC->Label) {
-                    Address += LOC->Label->LineRef;
-                    AddressFileIndex = LOC->Label->FileIndex;
-                }
-                else {
-                    Address += LOC->Operand;
+                symbol *Symbol = Table->Symbols + i;
+                size_t Bucket = HashName(Symbol->Name) & (BucketCount - 1);
+                while(Buckets[Bucket] && !sv_eq(Buckets[Bucket]->Name, Symbol->Name)) {
+                    Bucket = (Bucket + 1) & (BucketCount - 1);
                 }
                 
-                CheckAddress(LOC->LineInFile, Address, 
-                             "\nNOTE: Address is %zd (%zd + IX) in file "SV_Fmt, 
-                             Address, Address - IX, SV_Arg(FileNames[AddressFileIndex]));
-                CheckStoreDataInAddress(LOC->LineInFile, Address, 
-                                        "\nNOTE: Remember STX is for indexed addressing.\n"
-                                        "So the address is %zd + IX", Address - IX);
-                
-                *LineMappings[AddressFileIndex][Address].Data = ACC;
-            } break;
-            
-            case IOP_STI:
-            {
-                size_t AddressToAddress;
-                if(LOC->Label) {
-                    AddressFileIndex = LOC->Label->FileIndex;
-                    AddressToAddress = LOC->Label->LineRef;
-                }
-                else {
-                    AddressToAddress = LOC->Operand;
+                Symbol->Definition = Buckets[Bucket];
+                if(!Symbol->Definition) {
+                    fprintf(stderr, SV_Fmt"(%zu): ERROR: Undefined label '"SV_Fmt"'\n",
+                            SV_Arg(File->Name), Symbol->LineRef, SV_Arg(Symbol->Name));
+                    Fail();
                 }
-                CheckAddress(LOC->LineInFile, AddressToAddress, "");
-                CheckDataInAddress(LOC->LineInFile, AddressToAddress, "");
-                
-                size_t Address = *LineMappings[AddressFileIndex][AddressToAddress].Data;
-                CheckAddress(LOC->LineInFile, Address, 
-                             "\nAddress %zd (from data in address %zd) not in program",
-                             Address, AddressToAddress);
-                CheckStoreDataInAddress(LOC->LineInFile, Address,
-                                        "\nNOTE: Remember LDI is for indirect addressing");
-                
-                *LineMappings[AddressFileIndex][AddressToAddress].Data = ACC;
-            } break;
+            }
+        }
+    }
+    
+    return StartFileIndex;
+}
+
+int IsJumpInstruction(int Opcode)
+{
+    return (Opcode == IOP_JMP || Opcode == IOP_JPE || Opcode == IOP_JPN || Opcode == IOP_CALL || Opcode == IOP_SPAWN ||
+            Opcode == IOP_JPG || Opcode == IOP_JPL);
+}
+
+// NOTE(vic): The jumps that go by the last compare
+int IsBranchInstruction(int Opcode)
+{
+    return (Opcode == IOP_JPE || Opcode == IOP_JPN || Opcode == IOP_JPG || Opcode == IOP_JPL);
+}
+
+int TakesBranch(int Opcode, int LastCompareResult)
+{
+    switch(Opcode)
+    {
+        case IOP_JPE: return (LastCompareResult & COMPARED_EQUAL) != 0;
+        case IOP_JPN: return (LastCompareResult & COMPARED_EQUAL) == 0;
+        case IOP_JPG: return (LastCompareResult & COMPARED_GREATER) != 0;
+        case IOP_JPL: return (LastCompareResult & COMPARED_LESS) != 0;
+        default: return 0;
+    }
+}
+
+int IsAddressInstruction(line_of_code *LOC)
+{
+    switch(LOC->Opcode)
+    {
+        // NOTE(vic): A label always wins over '#', same as it did when evaluating
+        case IOP_CMP:
+        case IOP_AND:
+        case IOP_XOR:
+        case IOP_OR:
+        case IOP_SUB:
+        case IOP_MUL:
+        case IOP_DIV:
+        case IOP_MOD:
+        return LOC->Label || !LOC->Immediate;
+        
+        case IOP_LDD:
+        case IOP_LDI:
+        case IOP_LDX:
+        case IOP_STO:
+        case IOP_STX:
+        case IOP_STI:
+        case IOP_ADD:
+        case IOP_JMP:
+        case IOP_JPE:
+        case IOP_JPN:
+        case IOP_CALL:
+        case IOP_SPAWN:
+        case IOP_CAS:
+        case IOP_JPG:
+        case IOP_JPL:
+        case IOP_COPY:
+        case IOP_FILL:
+        return 1;
+        
+        default: return 0;
+    }
+}
+
+// NOTE(vic): One cell per source line, what can't be resolved gets INVALID_TARGET and fails when it runs
+void LinkProgram(memory_arena **Arena, source_file *Files, int FileCount, int StartFileIndex,
+                 linked_program *Program)
+{
+    Program->FileCount = FileCount;
+    Program->FileNames = PushArray(Arena, FileCount, String_View);
+    Program->Files = PushArray(Arena, FileCount, file_info);
+    size_t *FirstLOC = PushArray(Arena, FileCount, size_t);
+    u32 CellCount = 0;
+    size_t ProgramLength = 0;
+    for(int FileIndex = 0; FileIndex < FileCount; FileIndex++)
+    {
+        Program->FileNames[FileIndex] = Files[FileIndex].Name;
+        Program->Files[FileIndex].FirstCell = CellCount;
+        Program->Files[FileIndex].LineCount = (u32)Files[FileIndex].LineCount;
+        FirstLOC[FileIndex] = ProgramLength;
+        CellCount += (u32)Files[FileIndex].LineCount;
+        ProgramLength += Files[FileIndex].LOCCount;
+    }
+    Program->CellCount = CellCount;
+    Program->InstructionCount = (u32)ProgramLength;
+    Program->EntryPoint = (u32)(FirstLOC[StartFileIndex] + Files[StartFileIndex].StartLOC);
+    
+    Program->Cells = PushArray(Arena, CellCount, long int);
+    Program->CellHasData = PushArray(Arena, CellCount, u8);
+    Program->Lines = PushArray(Arena, CellCount, String_View);
+    for(int FileIndex = 0; FileIndex < FileCount; FileIndex++)
+    {
+        u32 FirstCell = Program->Files[FileIndex].FirstCell;
+        for(size_t Line = 0; Line < Files[FileIndex].LineCount; Line++)
+        {
+            line_map *Map = &Files[FileIndex].LineMappings[Line];
+            Program->Cells[FirstCell + Line] = Map->Data ? *Map->Data : 0;
+            Program->CellHasData[FirstCell + Line] = Map->Data != 0;
+            Program->Lines[FirstCell + Line] = Files[FileIndex].Lines[Line];
+        }
+    }
+    
+    Program->Instructions = PushArray(Arena, ProgramLength, instruction);
+    Program->InstructionInfo = PushArray(Arena, ProgramLength, instruction_info);
+    for(int FileIndex = 0; FileIndex < FileCount; FileIndex++)
+    {
+        for(size_t i = 0; i < Files[FileIndex].LOCCount; i++)
+        {
+            line_of_code *LOC = Files[FileIndex].Program + i;
+            instruction *Instruction = Program->Instructions + FirstLOC[FileIndex] + i;
+            instruction_info *Info = Program->InstructionInfo + FirstLOC[FileIndex] + i;
+            Instruction->Opcode = (u8)LOC->Opcode;
+            Instruction->AddressFileIndex = (u16)FileIndex;
+            Info->FileIndex = (u16)FileIndex;
+            Info->LineInFile = (u32)LOC->LineInFile;
+            Info->Operand = LOC->Operand;
             
-            case IOP_ADD:
-            {
-                if(LOC->Label) {
-                    AddressFileIndex = LOC->Label->FileIndex;
-                    CheckDataInAddress(LOC->LineInFile, LOC->Label->LineRef, "");
-                    ACC += *LineMappings[AddressFileIndex][LOC->Label->LineRef].Data;
-                }
-                else {
-                    CheckAddress(LOC->LineInFile, LOC->Operand, "");
-                    CheckDataInAddress(LOC->LineInFile, (size_t)LOC->Operand, "");
-                    
-                    ACC += *LineMappings[AddressFileIndex][LOC->Operand].Data;
-                }
-            } break;
+            if(!IsAddressInstruction(LOC)) {
+                Instruction->Immediate = (u8)LOC->Immediate;
+                Instruction->Operand = (s32)LOC->Operand;
+                continue;
+            }
             
-            case IOP_JMP:
-            {
-                JumpToLine();
-            } break;
+            if(LOC->Label) {
+                symbol *Definition = LOC->Label->Definition;
+                Instruction->AddressFileIndex = (u16)Definition->FileIndex;
+                Info->Operand = (long int)Definition->LineRef;
+            }
             
-            case IOP_CMP: // immediate + direct
-            {
-                if(LOC->Label) {
-                    AddressFileIndex = LOC->Label->FileIndex;
-                    CheckDataInAddress(LOC->LineInFile, LOC->Label->LineRef, "");
-                    
-                    LastCompareResult = ACC == *LineMappings[AddressFileIndex][LOC->Label->LineRef].Data;
-                }
-                else if(LOC->Immediate) {
-                    LastCompareResult = ACC == LOC->Operand;
-                }
-                else {
-                    CheckAddress(LOC->LineInFile, LOC->Operand, "");
-                    CheckDataInAddress(LOC->LineInFile, (size_t)LOC->Operand, "");
-                    
-                    LastCompareResult = ACC == *LineMappings[AddressFileIndex][LOC->Operand].Data;
-                }
-            } break;
-            
-            case IOP_JPE:
-            {
-                if(LastCompareResult) JumpToLine();
-            } break;
-            
-            case IOP_JPN:
-            {
-                if(!LastCompareResult) JumpToLine();
-            } break;
-            
-            case IOP_INP:
-            {
-                ACC = (int)getchar();
-            } break;
-            
-            case IOP_OUT:
-            {
-                if(IsSet(Flags, PRINT_NUMBERS)) {
-                    printf("%d\n", ACC);
-                }
-                else {
-                    putchar((char)ACC);
-                }
-            } break;
-            
-            case IOP_AND: // immediate + direct
-            {
-                if(LOC->Label) {
-                    AddressFileIndex = LOC->Label->FileIndex;
-                    CheckDataInAddress(LOC->LineInFile, LOC->Label->LineRef, "");
-                    
-                    ACC = ACC & *LineMappings[AddressFileIndex][LOC->Label->LineRef].Data;
-                }
-                else if(LOC->Immediate) {
-                    ACC = ACC & LOC->Operand;
-                }
-                else {
-                    CheckAddress(LOC->LineInFile, LOC->Operand, "");
-                    CheckDataInAddress(LOC->LineInFile, (size_t)LOC->Operand, "");
-                    
-                    ACC = ACC & *LineMappings[AddressFileIndex][LOC->Operand].Data;
-                }
-            } break;
-            
-            case IOP_XOR: // immediate + direct
-            {
-                if(LOC->Label) {
-                    AddressFileIndex = LOC->Label->FileIndex;
-                    CheckDataInAddress(LOC->LineInFile, LOC->Label->LineRef, "");
-                    
-                    ACC = ACC ^ *LineMappings[AddressFileIndex][LOC->Label->LineRef].Data;
-                }
-                else if(LOC->Immediate) {
-                    ACC = ACC ^ LOC->Operand;
-                }
-                else {
-                    CheckAddress(LOC->LineInFile, LOC->Operand, "");
-                    CheckDataInAddress(LOC->LineInFile, (size_t)LOC->Operand, "");
-                    
-                    ACC = ACC ^ *LineMappings[AddressFileIndex][LOC->Operand].Data;
-                }
-            } break;
-            
-            case IOP_OR: // immediate + direct
-            {
-                if(LOC->Label) {
-                    AddressFileIndex = LOC->Label->FileIndex;
-                    CheckDataInAddress(LOC->LineInFile, LOC->Label->LineRef, "");
-                    
-                    ACC = ACC | *LineMappings[AddressFileIndex][LOC->Label->LineRef].Data;
-                }
-                else if(LOC->Immediate) {
-                    ACC = ACC | LOC->Operand;
-                }
-                else {
-                    CheckAddress(LOC->LineInFile, LOC->Operand, "");
-                    CheckDataInAddress(LOC->LineInFile, (size_t)LOC->Operand, "");
-                    
-                    ACC = ACC | *LineMappings[AddressFileIndex][LOC->Operand].Data;
-                }
-            } break;
-            
-            case IOP_LSL:
-            {
-                ACC = ACC << LOC->Operand;
-            } break;
-            
-            case IOP_LSR:
-            {
-                ACC = ACC >> LOC->Operand;
-            } break;
-            
-            // NOTE(vic): Exit loop
-            case IOP_END: line = ProgramLength; break;
-            
-            case IOP_ACCINC: ACC++; break;
-            case IOP_ACCDEC: ACC--; break;
-            case IOP_IXINC: IX++; break;
-            case IOP_IXDEC: IX--; break;
-            
-            case IOP_CALL:
-            {
-                AddressFileIndex = LOC->Label->FileIndex;
-                
-                CheckJumpToAddress(LOC->LineInFile, LOC->Label->LineRef, "");
-                ReturnAddress = line;
-                line = LineMappings[AddressFileIndex][LOC->Label->LineRef].LOC - 1;
-                PreviousFileIndex = CurrentFileIndex;
-                CurrentFileIndex = AddressFileIndex;
-                
-                CheckJumpLimit(Lexer->Program[line].LineInFile);
-            } break;
-            
-            case IOP_RETURN:
-            {
-                line = ReturnAddress;
-                CurrentFileIndex = PreviousFileIndex;
-            } break;
-            
-            // case IOP_JMI: // indirect jump
-            
-            case IOP_COUNT:
-            default:
-            {
-                assert(0 && "This shouldn't happen");
-            } break;
-        }
-        
-        if(StepThroughCode) {
-            char buf[30];
-            int NeedToChoose = 1;
-            while(NeedToChoose)
-            {
-                String_View Option = sv_get_str(buf, 30);
-                NeedToChoose = 0;
-                if(sv_eq_ignorecase(Option, SV("help")) || sv_eq_ignorecase(Option, SV("h"))) {
-                    ShowStepCommands();
-                    NeedToChoose = 1;
-                }
-                else if(sv_eq_ignorecase(Option, SV("registers")) || sv_eq_ignorecase(Option, SV("r"))) {
-                    printf("ACC = %d, IX = %d\n", ACC, IX);
-                }
-                else if(sv_eq_ignorecase(Option, SV("continue")) || sv_eq_ignorecase(Option, SV("c"))) {
-                    StepThroughCode = 0;
-                }
-                else if(sv_eq_ignorecase(Option, SV("quit")) || sv_eq_ignorecase(Option, SV("q"))) {
-                    exit(0);
+            int AddressFileIndex = Instruction->AddressFileIndex;
+            file_info *File = Program->Files + AddressFileIndex;
+            long int Line = Info->Operand;
+            Instruction->Target = INVALID_TARGET;
+            if(LOC->Opcode == IOP_LDX || LOC->Opcode == IOP_STX || LOC->Opcode == IOP_COPY || LOC->Opcode == IOP_FILL) {
+                // NOTE(vic): Checked against the file when IX is known
+                Instruction->Operand = (s32)Line;
+            }
+            else if(Line >= 0 && Line < (long int)File->LineCount) {
+                u32 Cell = File->FirstCell + (u32)Line;
+                if(IsJumpInstruction(LOC->Opcode)) {
+                    if(!Program->CellHasData[Cell]) {
+                        Instruction->Target = (u32)(FirstLOC[AddressFileIndex] +
+                                                    Files[AddressFileIndex].LineMappings[Line].LOC);
+                    }
                 }
-                else if(!sv_eq(Option, SV_NULL) && sv_eq_ignorecase(Option, SV("next")) && sv_eq_ignorecase(Option, SV("n"))) {
-                    printf("Unkown command\n");
-                    NeedToChoose = 1;
+                else if(Program->CellHasData[Cell]) {
+                    Instruction->Target = Cell;
                 }
             }
         }
     }
 }
 
-int main(int argc, char **args)
+instruction_info *InfoOf(linked_program *Program, instruction *Instruction)
 {
-    if(argc == 1) {
-        Usage();
-        return 0;
+    return Program->InstructionInfo + (Instruction - Program->Instructions);
+}
+
+void StopStatsAt(u32 Index); // stats.c
+void StopCoverageAt(u32 Index); // coverage.c
+
+// NOTE(vic): Errors at an instruction while it runs, -stats and -coverage count the run up to it and no further
+void FailAt(linked_program *Program, instruction *Instruction)
+{
+    u32 Index = (u32)(Instruction - Program->Instructions);
+    StopStatsAt(Index);
+    StopCoverageAt(Index);
+    Fail();
+}
+
+// NOTE(vic): Cold path for instructions that were linked with INVALID_TARGET
+void ReportInvalidTarget(linked_program *Program, instruction *Instruction)
+{
+    instruction_info *Info = InfoOf(Program, (Instruction));
+    String_View FileName = Program->FileNames[Info->FileIndex];
+    String_View AddressFileName = Program->FileNames[Instruction->AddressFileIndex];
+    long int Address = Info->Operand;
+    
+    if(Address < 0 || Address >= (long int)Program->Files[Instruction->AddressFileIndex].LineCount) {
+        fprintf(stderr, "\n"SV_Fmt"(%u): ERROR: Incorrect address for operand, not in program",
+                SV_Arg(FileName), Info->LineInFile);
+    }
+    else if(IsJumpInstruction(Instruction->Opcode)) {
+        fprintf(stderr, "\n"SV_Fmt"(%u): ERROR: Invalid jump address %ld in file "SV_Fmt", it contains data",
+                SV_Arg(FileName), Info->LineInFile, Address, SV_Arg(AddressFileName));
+    }
+    else if(Instruction->Opcode == IOP_STO) {
+        fprintf(stderr, "\n"SV_Fmt"(%u): ERROR: Invalid address %ld in file "SV_Fmt,
+                SV_Arg(FileName), Info->LineInFile, Address, SV_Arg(AddressFileName));
+    }
+    else {
+        fprintf(stderr, "\n"SV_Fmt"(%u): ERROR: No data in address %ld in file "SV_Fmt,
+                SV_Arg(FileName), Info->LineInFile, Address, SV_Arg(AddressFileName));
+    }
+    FailAt(Program, Instruction);
+}
+
+// NOTE(vic): Out of Evaluate like COPY and FILL, inline they make the compiler lay out the rest worse
+int DivideValues(linked_program *Program, instruction *Instruction, int Opcode, int ACC)
+{
+    long long Divisor = Instruction->Operand; // INT_MIN/-1 fits
+    if(!Instruction->Immediate) {
+        if(Instruction->Target == INVALID_TARGET) ReportInvalidTarget(Program, Instruction);
+        Divisor = Program->Cells[Instruction->Target];
+    }
+    if(Divisor == 0) {
+        instruction_info *Info = InfoOf(Program, Instruction);
+        fprintf(stderr, "\n"SV_Fmt"(%u): ERROR: Division by zero",
+                SV_Arg(Program->FileNames[Info->FileIndex]), Info->LineInFile);
+        FailAt(Program, Instruction);
+    }
+    return (int)(Opcode == IOP_DIV ? ACC/Divisor : ACC%Divisor);
+}
+
+// NOTE(vic): Every address has to be in the program and have data, as for LDX and STX
+static void CheckBlock(linked_program *Program, instruction *Instruction, long int First, int Count, const char *What)
+{
+    instruction_info *Info = InfoOf(Program, Instruction);
+    file_info *File = Program->Files + Instruction->AddressFileIndex;
+    String_View AddressFileName = Program->FileNames[Instruction->AddressFileIndex];
+    long int Last = First + Count - 1;
+    if(First < 0 || Last >= (long int)File->LineCount) {
+        fprintf(stderr, "\n"SV_Fmt"(%u): ERROR: Incorrect address for operand, not in program\n"
+                "NOTE: The %s is addresses %ld to %ld (IX = %d) in file "SV_Fmt,
+                SV_Arg(Program->FileNames[Info->FileIndex]), Info->LineInFile, What, First, Last, Count,
+                SV_Arg(AddressFileName));
+        FailAt(Program, Instruction);
+    }
+    for(long int Address = First; Address <= Last; Address++)
+    {
+        if(Program->CellHasData[File->FirstCell + Address]) continue;
+        fprintf(stderr, "\n"SV_Fmt"(%u): ERROR: No data in address %ld in file "SV_Fmt"\n"
+                "NOTE: The %s is addresses %ld to %ld (IX = %d)",
+                SV_Arg(Program->FileNames[Info->FileIndex]), Info->LineInFile, Address, SV_Arg(AddressFileName),
+                What, First, Last, Count);
+        FailAt(Program, Instruction);
+    }
+}
+
+void CopyBlock(linked_program *Program, instruction *Instruction, int From, int Count)
+{
+    if(Count <= 0) return;
+    CheckBlock(Program, Instruction, From, Count, "source");
+    CheckBlock(Program, Instruction, Instruction->Operand, Count, "destination");
+    long int *Cells = Program->Cells + Program->Files[Instruction->AddressFileIndex].FirstCell;
+    memmove(Cells + Instruction->Operand, Cells + From, (size_t)Count*sizeof(long int));
+}
+
+void FillBlock(linked_program *Program, instruction *Instruction, int Value, int Count)
+{
+    if(Count <= 0) return;
+    CheckBlock(Program, Instruction, Instruction->Operand, Count, "block");
+    long int *Cells = Program->Cells + Program->Files[Instruction->AddressFileIndex].FirstCell;
+    for(int i = 0; i < Count; i++) Cells[Instruction->Operand + i] = Value;
+}
+
+#define CheckTarget(Instruction) \
+if((Instruction)->Target == INVALID_TARGET) { \
+ReportInvalidTarget(Program, Instruction); \
+}
+
+#define CheckAddress(Instruction, Address, Message, ...) \
+if((Address) >= Program->Files[(Instruction)->AddressFileIndex].LineCount) { \
+fprintf(stderr, \
+"\n"SV_Fmt"(%u): ERROR: Incorrect address for operand, not in program" \
+Message, SV_Arg(Program->FileNames[InfoOf(Program, (Instruction))->FileIndex]), InfoOf(Program, (Instruction))->LineInFile, ##__VA_ARGS__); \
+FailAt(Program, (Instruction)); \
+}
+
+#define CheckDataInAddress(Instruction, Address, Message, ...) \
+if(!Program->CellHasData[Program->Files[(Instruction)->AddressFileIndex].FirstCell + (Address)]) { \
+fprintf(stderr, "\n"SV_Fmt"(%u): ERROR: No data in address %zd in file "SV_Fmt Message, \
+SV_Arg(Program->FileNames[InfoOf(Program, (Instruction))->FileIndex]), InfoOf(Program, (Instruction))->LineInFile, (Address), \
+SV_Arg(Program->FileNames[(Instruction)->AddressFileIndex]), ##__VA_ARGS__); \
+FailAt(Program, (Instruction)); \
+}
+
+#define CheckStoreDataInAddress(Instruction, Address, Message, ...) \
+if(!Program->CellHasData[Program->Files[(Instruction)->AddressFileIndex].FirstCell + (Address)]) { \
+fprintf(stderr, "\n"SV_Fmt"(%u): ERROR: Invalid address %zd in file "SV_Fmt Message, \
+SV_Arg(Program->FileNames[InfoOf(Program, (Instruction))->FileIndex]), InfoOf(Program, (Instruction))->LineInFile, (Address), \
+SV_Arg(Program->FileNames[(Instruction)->AddressFileIndex]), ##__VA_ARGS__); \
+FailAt(Program, (Instruction)); \
+}
+
+#define CellAt(Instruction, Address) \
+Cells[Program->Files[(Instruction)->AddressFileIndex].FirstCell + (Address)]
+
+#define JMP_LIMIT 100000
+#define CheckJumpLimit(Instruction) \
+if(CountsJumps && ++JumpCounts[(Instruction)->Target] > JMP_LIMIT && !IsSet(Flags, NO_JMP_LIMIT)) { \
+fprintf(stderr, "\n"SV_Fmt"(%u): ERROR: Maximum jump limit reached\n" \
+"NOTE: If you want to disable this error use the '-no-jmp-limits' flag", \
+SV_Arg(Program->FileNames[InfoOf(Program, (Instruction))->FileIndex]), InfoOf(Program, (Instruction))->LineInFile); \
+FailAt(Program, (Instruction)); \
+}
+
+#define CheckSnapshot() \
+if(Recording && Steps >= NextSnapshotStep) { \
+machine_state State = { ACC, IX, LastCompareResult, CallStack, CallDepth, line, Steps }; \
+NextSnapshotStep = RecordSnapshot(Recording, &State); \
+}
+
+#define MAX_CALL_DEPTH 1024
+#define PushCall() \
+if(CallDepth == MAX_CALL_DEPTH) { \
+fprintf(stderr, "\n"SV_Fmt"(%u): ERROR: Call stack overflow, more than %d nested CALLs\n" \
+"NOTE: Is there a recursion that never stops?", \
+SV_Arg(Program->FileNames[InfoOf(Program, I)->FileIndex]), InfoOf(Program, I)->LineInFile, MAX_CALL_DEPTH); \
+FailAt(Program, I); \
+} \
+CallStack[CallDepth++] = (u32)line;
+
+#define PopCall() \
+if(CallDepth == 0) { \
+fprintf(stderr, "\n"SV_Fmt"(%u): ERROR: RETURN without a CALL", \
+SV_Arg(Program->FileNames[InfoOf(Program, I)->FileIndex]), InfoOf(Program, I)->LineInFile); \
+FailAt(Program, I); \
+} \
+line = CallStack[--CallDepth];
+
+// NOTE(vic): Counting, Covering, Profiling and Switching come from the evaluator variant
+#define CountBlock(Line) \
+if(Counting) BlockCounts[Line]++;
+
+#define CountJump(Line) \
+if(Counting) { \
+Stats->Jumps++; \
+BlockCounts[Line]++; \
+}
+
+#define CountCellAccesses(Count) \
+if(Counting && Cycles && IX > 0) Cycles->CellAccesses[line] += (u64)(Count);
+
+#define MarkFlow(Line, Mark) \
+if(Covering) CoverageMarks[Line] |= (Mark); \
+if(Profiling) Profile->Counts[Mark][Line]++;
+
+// NOTE(vic): Next is where the hart that stops goes on from on its next turn
+#define SwitchHartAt(Next) \
+{ \
+machine_state State = { ACC, IX, LastCompareResult, CallStack, CallDepth, (Next), Steps }; \
+Hart = SwitchHart(Hart, &State, &JumpCounts); \
+GoOnAsHart(); \
+line = State.Line - 1; \
+}
+
+#define CheckHartSwitch() \
+if(Switching && Steps >= SwitchAt) SwitchHartAt(line + 1)
+
+#define GoOnAsHart() \
+ACC = State.ACC; \
+IX = State.IX; \
+LastCompareResult = State.LastCompareResult; \
+CallDepth = State.CallDepth; \
+SwitchAt = Steps + HART_SLICE;
+
+#define JumpToLine() \
+CheckSnapshot(); \
+CheckTarget(I); \
+CheckJumpLimit(I); \
+CountJump(I->Target); \
+MarkFlow(line, COVERAGE_JUMPED); \
+line = (size_t)I->Target - 1; \
+CheckHartSwitch();
+
+#include "record.c"
+#include "trace.c"
+#include "debugger.c"
+#include "idiom.c"
+#include "memo.c"
+#include "snapshot.c"
+#include "stats.c"
+#include "cycles.c"
+#include "expect.c"
+#include "coverage.c"
+#include "layout.c"
+
+typedef struct {
+    recording *Recording; // -record, -replay
+    trace *Trace; // -trace
+    run_snapshot *Snapshot; // -snapshot, taken by this run or started from
+    run_stats *Stats; // -stats, -cycles
+    expectation *Expect; // -expect
+    coverage *Coverage; // -coverage
+    branch_profile *Profile; // -profile
+    cycle_model *Cycles; // -cycles
+    struct hart *Hart; // the hart a SPAWN started on its own thread, 0 for the first one (spawn.c)
+} run_options;
+
+typedef void evaluator(linked_program *Program, int Flags, run_options *Options);
+
+#include "spawn.c"
+
+#define EVALUATE_NAME EvaluateWatched
+#define EVALUATE_WATCHED 1
+#include "evaluate.c"
+
+#define EVALUATE_NAME EvaluateCounted
+#define EVALUATE_COUNTED 1
+#include "evaluate.c"
+
+#define EVALUATE_NAME EvaluateCharacters
+#define EVALUATE_JMP_LIMIT 1
+#define EVALUATE_PRINT_NUMBERS 0
+#include "evaluate.c"
+
+#define EVALUATE_NAME EvaluateNumbers
+#define EVALUATE_JMP_LIMIT 1
+#define EVALUATE_PRINT_NUMBERS 1
+#include "evaluate.c"
+
+#define EVALUATE_NAME EvaluateCharactersNoLimit
+#define EVALUATE_JMP_LIMIT 0
+#define EVALUATE_PRINT_NUMBERS 0
+#include "evaluate.c"
+
+#define EVALUATE_NAME EvaluateNumbersNoLimit
+#define EVALUATE_JMP_LIMIT 0
+#define EVALUATE_PRINT_NUMBERS 1
+#include "evaluate.c"
+
+evaluator *PickEvaluator(int Flags, run_options *Options)
+{
+    if(IsSet(Flags, ALA_DEBUG) || IsSet(Flags, ALA_DETERMINISTIC) || Options->Recording || Options->Trace) {
+        return EvaluateWatched;
+    }
+    if(Options->Stats || Options->Coverage || Options->Profile) {
+        return EvaluateCounted;
+    }
+    if(IsSet(Flags, NO_JMP_LIMIT)) {
+        return IsSet(Flags, PRINT_NUMBERS) ? EvaluateNumbersNoLimit : EvaluateCharactersNoLimit;
+    }
+    return IsSet(Flags, PRINT_NUMBERS) ? EvaluateNumbers : EvaluateCharacters;
+}
+
+void Evaluate(linked_program *Program, int Flags, run_options *Options) {
+    if(Options->Stats) BeginStatsRun(Options->Stats, Program);
+    PickEvaluator(Flags, Options)(Program, Flags, Options);
+    if(Options->Stats) EndStatsRun(Options->Stats);
+    if(Options->Expect) EndExpectation(Options->Expect);
+}
+
+#include "object.c"
+#include "optimize.c"
+#include "inline.c"
+
+// NOTE(vic): Inlined copies would confuse breakpoints, so -inline does nothing in the debugger
+void TransformProgram(linked_program *Program, int Flags)
+{
+    if(IsSet(Flags, ALA_INLINE) && !IsSet(Flags, ALA_DEBUG)) {
+        InlineCalls(Program);
+    }
+    if(IsSet(Flags, ALA_OPTIMIZE)) {
+        OptimizeProgram(Program, Flags);
+    }
+}
+
+#include "watch.c"
+
+#include "lanes.c"
+#include "bench.c"
+
+static const char *ExtensionOf(String_View FirstFile)
+{
+    return sv_ends_with(FirstFile, SV(".alb")) ? ".alb" : sv_ends_with(FirstFile, SV(".alo")) ? ".alo" : ".ala";
+}
+
+run_options OpenRunOptions(String_View FirstFile, linked_program *Program, int Flags, u32 TraceSize,
+                           const char *ExpectPath)
+{
+    run_options Options = {0};
+    const char *Extension = ExtensionOf(FirstFile);
+    
+    if(IsSet(Flags, ALA_RECORD) && IsSet(Flags, ALA_REPLAY)) {
+        fprintf(stderr, "ERROR: '-record' and '-replay' can't be used together\n");
+        exit(1);
+    }
+    if(IsSet(Flags, ALA_RECORD)) {
+        Options.Recording = StartRecording(ReplaceExtension(FirstFile, Extension, ".alr"), Program);
+    }
+    if(IsSet(Flags, ALA_REPLAY)) {
+        Options.Recording = StartReplay(ReplaceExtension(FirstFile, Extension, ".alr"), Program);
+        if(!Options.Recording) {
+            exit(1);
+        }
+    }
+    if(TraceSize) {
+        Options.Trace = StartTrace(ReplaceExtension(FirstFile, Extension, ".alt"), Program, TraceSize);
+    }
+    if(IsSet(Flags, ALA_STATS) || IsSet(Flags, ALA_CYCLES)) {
+        Options.Stats = &RunStats;
+    }
+    if(IsSet(Flags, ALA_CYCLES)) {
+        Options.Cycles = BeginCycles(FirstFile, Extension, Program);
+    }
+    if(ExpectPath) {
+        Options.Expect = StartExpectation(ExpectPath);
+    }
+    if(IsSet(Flags, ALA_PROFILE)) {
+        Options.Profile = StartProfile(FirstFile, Extension, Program);
+    }
+    return Options;
+}
+
+// NOTE(vic): "ala first.alt first.ala ..." decodes the trace instead of running the program
+void RunProgram(linked_program *Program, int Flags, const char *TracePath, String_View FirstFile, u32 TraceSize,
+                const char *InputsPath, const char *SnapshotAt, const char *ExpectPath)
+{
+    // NOTE(vic): A trace of a run with -layout is of the program laid out
+    if(IsSet(Flags, ALA_LAYOUT)) {
+        if(IsSet(Flags, ALA_PROFILE)) {
+            fprintf(stderr, "ERROR: '-profile' and '-layout' can't be used together\n");
+            exit(1);
+        }
+        if(!IsSet(Flags, NO_JMP_LIMIT)) {
+            fprintf(stderr, "ERROR: '-layout' needs '-no-jmp-limits'\n"
+                    "NOTE: The jumps the program takes aren't the ones the jump limit counts anymore\n");
+            exit(1);
+        }
+        if(!LayoutProgram(Program, FirstFile, ExtensionOf(FirstFile))) {
+            exit(1);
+        }
+    }
+    
+    if(TracePath) {
+        if(!DecodeTrace(TracePath, Program)) {
+            exit(1);
+        }
+        return;
+    }
+    coverage *Coverage = 0;
+    if(IsSet(Flags, ALA_COVERAGE) && (InputsPath || !IsSet(Flags, ALA_BENCH))) {
+        Coverage = StartCoverage(FirstFile, ExtensionOf(FirstFile), Program);
+    }
+    if(InputsPath) {
+        if(TraceSize || ExpectPath || IsSet(Flags, ALA_PROFILE) || IsSet(Flags, ALA_CYCLES)) {
+            fprintf(stderr, "ERROR: '-inputs' can't be used with '-trace', '-expect', '-profile' or '-cycles'\n");
+            exit(1);
+        }
+        RunInputs(Program, Flags, InputsPath, SnapshotAt, Coverage);
+        return;
+    }
+    if(IsSet(Flags, ALA_BENCH)) {
+        if(TraceSize || IsSet(Flags, ALA_COVERAGE) || IsSet(Flags, ALA_PROFILE) || IsSet(Flags, ALA_CYCLES)) {
+            fprintf(stderr, "ERROR: '-bench' can't be used with '-trace', '-coverage', '-profile' or '-cycles'\n");
+            exit(1);
+        }
+        BenchProgram(Program, Flags);
+        return;
+    }
+    
+    run_options Options = OpenRunOptions(FirstFile, Program, Flags, TraceSize, ExpectPath);
+    Options.Coverage = Coverage;
+    Evaluate(Program, Flags, &Options);
+}
+
+typedef struct {
+    char **Files;
+    int FileCount;
+    int Flags;
+    int ThreadCount;
+    u32 TraceSize;
+    int Server; // -server
+    int Client; // where -client is in the command line, 0 if it isn't
+    const char *SocketPath; // 0 for the default one
+    const char *InputsPath; // -inputs
+    const char *SnapshotAt; // -snapshot, "" for the first INP
+    const char *StatsPath; // -stats, 0 for stderr
+    const char *ExpectPath; // -expect
+    const char *CostsPath; // -cycles, 0 for the default costs
+} command_line;
+
+// NOTE(vic): Returns 0 if the command line can't be used, the reason is already printed
+int ParseCommandLine(int argc, char **args, command_line *CommandLine)
+{
+    CommandLine->Files = malloc(argc*sizeof(char *));
+    memset(CommandLine->Files, 0, argc*sizeof(char *));
+    CommandLine->ThreadCount = GetProcessorCount();
+    for(int i = 1; i < argc; i++)
+    {
+        String_View flag = sv_from_cstr(&args[i][1]);
+        if(args[i][0] == '-' && (sv_eq_ignorecase(flag, SV("client")) || sv_starts_with(flag, SV("client=")))) {
+            CommandLine->Client = i;
+            if(flag.count > 6) CommandLine->SocketPath = &args[i][8];
+            return 1;
+        }
     }
     
-    // NOTE(vic): Parse command line options
-    char **Files = malloc(argc*sizeof(char *));
-    memset(Files, 0, argc*sizeof(char *));
-    int FileCount = 0;
     int Flags = 0;
     for(int i = 1; i < argc; i++)
     {
@@ -947,30 +1684,178 @@ int main(int argc, char **args)
             else if(sv_eq_ignorecase(flag, SV("debug"))) {
                 Flags |= ALA_DEBUG;
             }
+            else if(sv_eq_ignorecase(flag, SV("compile"))) {
+                Flags |= ALA_COMPILE;
+            }
+            else if(sv_eq_ignorecase(flag, SV("strip"))) {
+                Flags |= ALA_STRIP;
+            }
+            else if(sv_eq_ignorecase(flag, SV("watch"))) {
+                Flags |= ALA_WATCH;
+            }
+            else if(sv_eq_ignorecase(flag, SV("object"))) {
+                Flags |= ALA_OBJECT;
+            }
+            else if(sv_eq(flag, SV("O"))) {
+                Flags |= ALA_OPTIMIZE;
+            }
+            else if(sv_eq_ignorecase(flag, SV("memo-stats"))) {
+                Flags |= ALA_MEMO_STATS;
+            }
+            else if(sv_eq_ignorecase(flag, SV("inline"))) {
+                Flags |= ALA_INLINE;
+            }
+            else if(sv_eq_ignorecase(flag, SV("record"))) {
+                Flags |= ALA_RECORD;
+            }
+            else if(sv_eq_ignorecase(flag, SV("replay"))) {
+                Flags |= ALA_REPLAY;
+            }
+            else if(sv_eq_ignorecase(flag, SV("trace"))) {
+                CommandLine->TraceSize = DEFAULT_TRACE_SIZE;
+            }
+            else if(sv_starts_with(flag, SV("trace="))) {
+                int TraceSize = atoi(&args[i][7]);
+                CommandLine->TraceSize = (u32)TraceSize;
+                if(TraceSize <= 0) {
+                    fprintf(stderr, "ERROR: '-trace=N' needs a number of instructions bigger than 0\n");
+                    return 0;
+                }
+            }
+            else if(sv_starts_with(flag, SV("inputs="))) {
+                CommandLine->InputsPath = &args[i][8];
+            }
+            else if(sv_eq_ignorecase(flag, SV("snapshot"))) {
+                CommandLine->SnapshotAt = "";
+            }
+            else if(sv_starts_with(flag, SV("snapshot="))) {
+                CommandLine->SnapshotAt = &args[i][10];
+            }
+            else if(sv_eq_ignorecase(flag, SV("bench"))) {
+                Flags |= ALA_BENCH;
+            }
+            else if(sv_starts_with(flag, SV("expect="))) {
+                CommandLine->ExpectPath = &args[i][8];
+            }
+            else if(sv_eq_ignorecase(flag, SV("coverage"))) {
+                Flags |= ALA_COVERAGE;
+            }
+            else if(sv_eq_ignorecase(flag, SV("profile"))) {
+                Flags |= ALA_PROFILE;
+            }
+            else if(sv_eq_ignorecase(flag, SV("layout"))) {
+                Flags |= ALA_LAYOUT;
+            }
+            else if(sv_eq_ignorecase(flag, SV("deterministic"))) {
+                Flags |= ALA_DETERMINISTIC;
+            }
+            else if(sv_eq_ignorecase(flag, SV("stats"))) {
+                Flags |= ALA_STATS;
+            }
+            else if(sv_starts_with(flag, SV("stats="))) {
+                Flags |= ALA_STATS;
+                CommandLine->StatsPath = &args[i][7];
+            }
+            else if(sv_eq_ignorecase(flag, SV("cycles"))) {
+                Flags |= ALA_CYCLES;
+            }
+            else if(sv_starts_with(flag, SV("cycles="))) {
+                Flags |= ALA_CYCLES;
+                CommandLine->CostsPath = &args[i][8];
+            }
+            else if(sv_starts_with(flag, SV("threads="))) {
+                CommandLine->ThreadCount = atoi(&args[i][9]);
+            }
+            else if(sv_eq_ignorecase(flag, SV("server"))) {
+                CommandLine->Server = 1;
+            }
+            else if(sv_starts_with(flag, SV("server="))) {
+                CommandLine->Server = 1;
+                CommandLine->SocketPath = &args[i][8];
+            }
             else {
                 fprintf(stderr, "WARNING: Unknown flag '%s' ignored\n", args[i] + 1);
             }
         }
         else if(access(args[i], F_OK) == 0) {
-            Files[FileCount++] = args[i];
+            CommandLine->Files[CommandLine->FileCount++] = args[i];
         }
         else {
             fprintf(stderr, "ERROR: Could not open file '%s'\n", args[i]);
         }
     }
+    CommandLine->Flags = Flags;
+    
+    if(CommandLine->SnapshotAt && !CommandLine->InputsPath) {
+        fprintf(stderr, "ERROR: '-snapshot' only works with '-inputs'\n");
+        return 0;
+    }
     
     // TODO(vic): Handle no accessable files
-    if(FileCount == 0) {
+    if(CommandLine->FileCount == 0 && !CommandLine->Server) {
         fprintf(stderr, "ERROR: No input files found\n");
-        exit(1);
+        return 0;
+    }
+    return 1;
+}
+
+// NOTE(vic): The server runs this too, for the runs it doesn't cache
+int RunCommandLine(command_line *CommandLine)
+{
+    char **Files = CommandLine->Files;
+    int FileCount = CommandLine->FileCount;
+    int Flags = CommandLine->Flags;
+    int ThreadCount = CommandLine->ThreadCount;
+    u32 TraceSize = CommandLine->TraceSize;
+    if(IsSet(Flags, ALA_STATS)) {
+        StartStats(CommandLine->StatsPath);
+    }
+    if(IsSet(Flags, ALA_CYCLES)) {
+        StartCycles(CommandLine->CostsPath);
     }
     
 #if 0
-    for(int i = 0; i < argc; i++) printf("%s\n", args[i]);
     for(int i = 0; i < FileCount; i++) printf("%s\n", Files[i]);
     printf("%d", FileCount);
 #endif
     
+    // NOTE(vic): A trace goes first, the rest of the files are the program it was made with
+    const char *TracePath = 0;
+    if(sv_ends_with(sv_from_cstr(Files[0]), SV(".alt"))) {
+        TracePath = Files[0];
+        Files++;
+        FileCount--;
+        if(FileCount == 0) {
+            fprintf(stderr, "ERROR: To decode %s pass the program it was made with after it\n", TracePath);
+            exit(1);
+        }
+    }
+    
+    if(sv_ends_with(sv_from_cstr(Files[0]), SV(".alb"))) {
+        if(FileCount > 1) {
+            fprintf(stderr, "ERROR: A compiled image (%s) can't be combined with other files\n", Files[0]);
+            exit(1);
+        }
+        if(IsSet(Flags, ALA_COMPILE)) {
+            fprintf(stderr, "ERROR: %s is already compiled\n", Files[0]);
+            exit(1);
+        }
+        
+        double Start = GetSeconds();
+        linked_program Image = {0};
+        if(!LoadProgramImage(Files[0], &Image)) {
+            exit(1);
+        }
+        RunStats.LoadSeconds = GetSeconds() - Start;
+        
+        Start = GetSeconds();
+        TransformProgram(&Image, Flags);
+        RunStats.TransformSeconds = GetSeconds() - Start;
+        RunProgram(&Image, Flags, TracePath, sv_from_cstr(Files[0]), TraceSize, CommandLine->InputsPath,
+                   CommandLine->SnapshotAt, CommandLine->ExpectPath);
+        return 0;
+    }
+    
     memory_arena _Arena;
     memory_arena *Arena = &_Arena;
     size_t MemorySize = ARENA_MEMORY_SIZE;
@@ -978,91 +1863,109 @@ int main(int argc, char **args)
     memset(Memory, 0, MemorySize);
     InitializeArena(Arena, MemorySize, (u8 *)Memory);
     
-    String_View *InputData = PushArray(&Arena, FileCount, String_View);
-    int InputDataCount = 0;
-    String_View *ValidFiles = PushArray(&Arena, FileCount, String_View);
+    double Start = GetSeconds();
+    source_file *SourceFiles = PushArray(&Arena, FileCount, source_file);
+    int SourceFileCount = 0;
     for(int i = 0; i < FileCount; i++)
     {
-        String_View *FileData = InputData + InputDataCount;
-        *FileData = sv_ReadEntireFile(Files[i]);
-        if(FileData->data) {
-            ValidFiles[InputDataCount] = sv_from_cstr(Files[i]);
-            InputDataCount++;
+        source_file *File = SourceFiles + SourceFileCount;
+        if(sv_ends_with(sv_from_cstr(Files[i]), SV(".alo"))) {
+            if(!LoadObjectFile(&Arena, Files[i], File, SourceFileCount)) {
+                exit(1);
+            }
+            SourceFileCount++;
+            continue;
+        }
+        
+        File->Content = sv_ReadEntireFile(Files[i]);
+        if(File->Content.data) {
+            File->Name = sv_from_cstr(Files[i]);
+            SourceFileCount++;
         }
         else {
             fprintf(stderr, "ERROR: Could not read file %s: %s\n", Files[i], strerror(errno));
         }
     }
-    
-    size_t TotalLineCount = 0;
-    size_t *LineCount = PushArray(&Arena, InputDataCount, size_t);
-    for(int FileIndex = 0; FileIndex < InputDataCount; FileIndex++)
-    {
-        LineCount[FileIndex] = 1;
-        for(size_t i = 0; i < InputData[FileIndex].count; i++) {
-            if(InputData[FileIndex].data[i] == '\n') LineCount[FileIndex]++;
-        }
-        TotalLineCount += LineCount[FileIndex];
-    }
-    
-    String_View **Lines = PushArray(&Arena, InputDataCount, String_View *);
-    for(int i = 0; i < InputDataCount; i++)
-        Lines[i] = PushArray(&Arena, LineCount[i], String_View);
-    
-    line_map **LineMappings = PushArray(&Arena, InputDataCount, line_map *);
-    for(int i = 0; i < InputDataCount; i++)
-        LineMappings[i] = PushArray(&Arena, LineCount[i], line_map);
-    
-    line_of_code *Program = PushArray(&Arena, TotalLineCount, line_of_code);
-    symbol_table *SymbolTable = PushStruct(&Arena, symbol_table);
+    RunStats.LoadSeconds = GetSeconds() - Start;
     
     tmp_cstr tc;
     tc.Capacity = 1024,
     tc.Cstr = (char *)malloc(1024);
     
-    lexer Lexer = {
-        .Arena = &Arena,
-        .tc = &tc,
-        .ProgramLines = Lines,
-        .Program = Program,
-        .StartSymbol = 0,
-        .StartLOC = 0,
-        .SymbolTable = SymbolTable,
-        .CurrentSymbolTable = &SymbolTable,
-    };
-    
-    size_t LOCCount = 0;
-    for(int FileIndex = 0; FileIndex < InputDataCount; FileIndex++)
-    {
-        Lexer.FileIndex = FileIndex;
-        Lexer.File = ValidFiles + FileIndex;
-        LOCCount = ParseCode(InputData[FileIndex], &Lexer, Flags,
-                             LineMappings[FileIndex], LOCCount);
+    if(IsSet(Flags, ALA_WATCH)) {
+        Watch(&Arena, &tc, SourceFiles, SourceFileCount, Flags);
+        return 0;
     }
     
-    if(Lexer.StartLOC == -1) {
-        fprintf(stderr, "ERROR: Start label not found\n");
-        exit(1);
-    }
+    Start = GetSeconds();
+    ParseSourceFiles(&Arena, &tc, SourceFiles, SourceFileCount, Flags, ThreadCount);
+    RunStats.ParseSeconds = GetSeconds() - Start;
     
-    for(symbol_table *Table = Lexer.SymbolTable;
-        Table;
-        Table = Table->Next)
-    {
-        for(int i = 0; i < Table->Used; i++)
+    if(IsSet(Flags, ALA_OBJECT)) {
+        for(int FileIndex = 0; FileIndex < SourceFileCount; FileIndex++)
         {
-            symbol *Symbol = Table->Symbols + i;
-            if(!Table->Symbols[i].Evaluated) {
-                fprintf(stderr, "%s(%zu): ERROR: Undefined label '"SV_Fmt"'\n",
-                        Files[0], Symbol->LineRef, SV_Arg(Symbol->Name));
+            source_file *File = SourceFiles + FileIndex;
+            if(File->IsObject) continue;
+            
+            char *OutputPath = ReplaceExtension(File->Name, ".ala", ".alo");
+            if(!WriteObjectFile(OutputPath, File)) {
+                fprintf(stderr, "ERROR: Could not write %s: %s\n", OutputPath, strerror(errno));
                 exit(1);
             }
         }
+        return 0;
     }
     
-    //printf("Program starting point: %zu", Lexer.Program[Lexer.StartLOC].LineInFile);
+    Start = GetSeconds();
+    int StartFileIndex = ResolveSymbols(&Arena, SourceFiles, SourceFileCount);
+    RunStats.ResolveSeconds = GetSeconds() - Start;
+    
+    Start = GetSeconds();
+    linked_program LinkedProgram = {0};
+    LinkProgram(&Arena, SourceFiles, SourceFileCount, StartFileIndex, &LinkedProgram);
+    RunStats.LinkSeconds = GetSeconds() - Start;
+    RecordArenaStats(&_Arena);
+    
+    Start = GetSeconds();
+    TransformProgram(&LinkedProgram, Flags);
+    RunStats.TransformSeconds = GetSeconds() - Start;
+    
+    if(IsSet(Flags, ALA_COMPILE)) {
+        String_View FirstFile = sv_from_cstr(Files[0]);
+        char *OutputPath = ReplaceExtension(FirstFile, sv_ends_with(FirstFile, SV(".alo")) ? ".alo" : ".ala", ".alb");
+        
+        if(!WriteProgramImage(OutputPath, &LinkedProgram, !IsSet(Flags, ALA_STRIP))) {
+            fprintf(stderr, "ERROR: Could not write %s: %s\n", OutputPath, strerror(errno));
+            exit(1);
+        }
+        return 0;
+    }
     
-    Evaluate(ValidFiles, &Lexer, LineMappings, LineCount, LOCCount, Flags);
+    RunProgram(&LinkedProgram, Flags, TracePath, sv_from_cstr(Files[0]), TraceSize, CommandLine->InputsPath,
+                   CommandLine->SnapshotAt, CommandLine->ExpectPath);
     
     return 0;
-}
\ No newline at end of file
+}
+#include "server.c"
+
+int main(int argc, char **args)
+{
+    if(argc == 1) {
+        Usage();
+        return 0;
+    }
+    
+    command_line CommandLine = {0};
+    if(!ParseCommandLine(argc, args, &CommandLine)) {
+        exit(1);
+    }
+    if(CommandLine.Client) {
+        return RunClient(CommandLine.SocketPath, argc, args, CommandLine.Client);
+    }
+    if(CommandLine.Server) {
+        Serve(CommandLine.SocketPath);
+        return 0;
+    }
+    
+    return RunCommandLine(&CommandLine);
+}
@@ -0,0 +1,418 @@
+// NOTE(vic): -O -extra caches the results of pure routines (no INP/OUT/END/CALL, no indexed or
+// indirect addressing, a few cells) by the values they read, in IOP_MEMO_CALL/IOP_MEMO_RETURN
+
+#define MEMO_MAX_INSTRUCTIONS 256
+#define MEMO_MAX_CELLS 8
+#define MEMO_MAX_TARGETS 8
+#define MEMO_MAX_VALUES (3 + MEMO_MAX_CELLS)
+#define MEMO_CACHE_SIZE 4096 // entries, shared by all routines, a new result replaces the old one
+
+// NOTE(vic): Values a routine can read or write, one bit each
+#define MEMO_ACC 1
+#define MEMO_IX 2
+#define MEMO_FLAG 4
+#define MEMO_CELL(Index) (8u << (Index))
+
+typedef enum {
+    ROUTINE_PURE,
+    ROUTINE_IO,
+    ROUTINE_CALLS,
+    ROUTINE_INDIRECT,
+    ROUTINE_ENDS,
+    ROUTINE_TOO_BIG,
+    ROUTINE_INVALID,
+} routine_kind;
+
+static const char *RoutineKindNames[] = {
+    [ROUTINE_PURE] = "pure",
+    [ROUTINE_IO] = "not memoized, does INP or OUT",
+    [ROUTINE_CALLS] = "not memoized, calls other routines",
+    [ROUTINE_INDIRECT] = "not memoized, uses indexed or indirect addressing",
+    [ROUTINE_ENDS] = "not memoized, can end the program",
+    [ROUTINE_TOO_BIG] = "not memoized, too many instructions, cells or jumps",
+    [ROUTINE_INVALID] = "not memoized, has an invalid address",
+};
+
+typedef struct {
+    u32 Entry;
+    routine_kind Kind;
+    u32 Inputs;
+    u32 Outputs;
+    int CellCount;
+    u32 Cells[MEMO_MAX_CELLS];
+    int TargetCount;
+    u32 Targets[MEMO_MAX_TARGETS]; // jumps it can take, for the jump limit
+    
+    u64 Calls;
+    u64 Hits;
+} routine;
+
+typedef struct {
+    u32 Routine; // + 1, 0 if the entry is empty
+    u32 Hash;
+    long int Inputs[MEMO_MAX_VALUES];
+    long int Outputs[MEMO_MAX_VALUES];
+    u64 Steps;
+    int Jumps[MEMO_MAX_TARGETS];
+} memo_entry;
+
+typedef struct {
+    linked_program *Program;
+    routine *Routines;
+    u32 RoutineCount;
+    u32 *RoutineAt; // routine + 1 for CALL targets
+    u8 *OriginalOpcodes;
+    u8 *PureReturn; // RETURNs a pure routine can reach
+    memo_entry *Cache;
+    
+    // NOTE(vic): Call that missed, its RETURN fills the cache
+    routine *Running;
+    memo_entry Result;
+    u64 StartSteps;
+} memo_table;
+
+static int FindRoutineCell(routine *Routine, u32 Cell)
+{
+    for(int i = 0; i < Routine->CellCount; i++) {
+        if(Routine->Cells[i] == Cell) return i;
+    }
+    if(Routine->CellCount == MEMO_MAX_CELLS) return -1;
+    Routine->Cells[Routine->CellCount] = Cell;
+    return Routine->CellCount++;
+}
+
+static int AddRoutineTarget(routine *Routine, u32 Target)
+{
+    for(int i = 0; i < Routine->TargetCount; i++) {
+        if(Routine->Targets[i] == Target) return 1;
+    }
+    if(Routine->TargetCount == MEMO_MAX_TARGETS) return 0;
+    Routine->Targets[Routine->TargetCount++] = Target;
+    return 1;
+}
+
+// NOTE(vic): What one instruction reads and writes, or why it can't be in a pure routine
+static routine_kind InstructionUses(routine *Routine, instruction *Instruction, u32 *Use, u32 *Def)
+{
+    u32 Cell = 0;
+    int Opcode = Instruction->Opcode;
+    int UsesCell = (Opcode == IOP_LDD || Opcode == IOP_STO || Opcode == IOP_ADD ||
+                    ((Opcode == IOP_CMP || Opcode == IOP_AND || Opcode == IOP_XOR || Opcode == IOP_OR ||
+                      Opcode == IOP_SUB || Opcode == IOP_MUL || Opcode == IOP_DIV || Opcode == IOP_MOD) &&
+                     !Instruction->Immediate));
+    if(UsesCell || IsJumpInstruction(Opcode)) {
+        if(Instruction->Target == INVALID_TARGET) return ROUTINE_INVALID;
+    }
+    if(UsesCell) {
+        int Index = FindRoutineCell(Routine, Instruction->Target);
+        if(Index < 0) return ROUTINE_TOO_BIG;
+        Cell = MEMO_CELL(Index);
+    }
+    
+    *Use = *Def = 0;
+    switch(Opcode)
+    {
+        case IOP_LDM: *Def = MEMO_ACC; break;
+        case IOP_LDD: *Use = Cell; *Def = MEMO_ACC; break;
+        case IOP_LDR: *Def = MEMO_IX; break;
+        case IOP_STO: *Use = MEMO_ACC; *Def = Cell; break;
+        case IOP_ADD: *Use = MEMO_ACC | Cell; *Def = MEMO_ACC; break;
+        case IOP_CMP: *Use = MEMO_ACC | Cell; *Def = MEMO_FLAG; break;
+        case IOP_JPE:
+        case IOP_JPN:
+        case IOP_JPG:
+        case IOP_JPL: *Use = MEMO_FLAG; break;
+        case IOP_JMP:
+        case IOP_RETURN: break;
+        
+        case IOP_AND:
+        case IOP_XOR:
+        case IOP_OR:
+        case IOP_SUB:
+        case IOP_MUL:
+        case IOP_DIV:
+        case IOP_MOD: *Use = MEMO_ACC | Cell; *Def = MEMO_ACC; break;
+        
+        case IOP_LSL:
+        case IOP_LSR:
+        case IOP_ACCINC:
+        case IOP_ACCDEC: *Use = *Def = MEMO_ACC; break;
+        case IOP_IXINC:
+        case IOP_IXDEC: *Use = *Def = MEMO_IX; break;
+        
+        case IOP_INP:
+        case IOP_OUT: return ROUTINE_IO;
+        case IOP_CALL: return ROUTINE_CALLS;
+        case IOP_END: return ROUTINE_ENDS;
+        default: return ROUTINE_INDIRECT;
+    }
+    return ROUTINE_PURE;
+}
+
+static int RoutineSuccessors(instruction *Instruction, u32 Index, u32 *Successors)
+{
+    switch(Instruction->Opcode)
+    {
+        case IOP_RETURN: return 0;
+        case IOP_JMP: Successors[0] = Instruction->Target; return 1;
+        case IOP_JPE:
+        case IOP_JPN:
+        case IOP_JPG:
+        case IOP_JPL: Successors[0] = Index + 1; Successors[1] = Instruction->Target; return 2;
+        default: Successors[0] = Index + 1; return 1;
+    }
+}
+
+static void AnalyzeRoutine(memo_table *Memo, routine *Routine)
+{
+    linked_program *Program = Memo->Program;
+    u32 Body[MEMO_MAX_INSTRUCTIONS];
+    u32 Use[MEMO_MAX_INSTRUCTIONS];
+    u32 Def[MEMO_MAX_INSTRUCTIONS];
+    u32 BodyCount = 0;
+    
+    // NOTE(vic): Everything reachable from the entry before a RETURN
+    Body[BodyCount++] = Routine->Entry;
+    for(u32 b = 0; b < BodyCount; b++)
+    {
+        instruction *Instruction = Program->Instructions + Body[b];
+        Routine->Kind = InstructionUses(Routine, Instruction, Use + b, Def + b);
+        if(Routine->Kind != ROUTINE_PURE) return;
+        if(IsJumpInstruction(Instruction->Opcode) && !AddRoutineTarget(Routine, Instruction->Target)) {
+            Routine->Kind = ROUTINE_TOO_BIG;
+            return;
+        }
+        
+        u32 Successors[2];
+        int SuccessorCount = RoutineSuccessors(Instruction, Body[b], Successors);
+        for(int s = 0; s < SuccessorCount; s++)
+        {
+            if(Successors[s] >= Program->InstructionCount) {
+                Routine->Kind = ROUTINE_ENDS;
+                return;
+            }
+            u32 Found = 0;
+            while(Found < BodyCount && Body[Found] != Successors[s]) Found++;
+            if(Found == BodyCount) {
+                if(BodyCount == MEMO_MAX_INSTRUCTIONS) {
+                    Routine->Kind = ROUTINE_TOO_BIG;
+                    return;
+                }
+                Body[BodyCount++] = Successors[s];
+            }
+        }
+    }
+    
+    // NOTE(vic): An output not written on every path to a RETURN is an input too
+    u32 LiveIn[MEMO_MAX_INSTRUCTIONS] = {0};
+    u32 Written[MEMO_MAX_INSTRUCTIONS];
+    for(u32 b = 0; b < BodyCount; b++) {
+        Written[b] = b ? ~0u : 0;
+        Routine->Outputs |= Def[b];
+    }
+    
+    for(int Changed = 1; Changed;)
+    {
+        Changed = 0;
+        for(u32 b = BodyCount; b-- > 0;)
+        {
+            instruction *Instruction = Program->Instructions + Body[b];
+            u32 Successors[2];
+            int SuccessorCount = RoutineSuccessors(Instruction, Body[b], Successors);
+            u32 LiveOut = 0;
+            for(int s = 0; s < SuccessorCount; s++) {
+                for(u32 Other = 0; Other < BodyCount; Other++) {
+                    if(Body[Other] != Successors[s]) continue;
+                    LiveOut |= LiveIn[Other];
+                    u32 WrittenOut = Written[b] | Def[b];
+                    if((Written[Other] & WrittenOut) != Written[Other]) {
+                        Written[Other] &= WrittenOut;
+                        Changed = 1;
+                    }
+                }
+            }
+            u32 NewLiveIn = Use[b] | (LiveOut & ~Def[b]);
+            if(NewLiveIn != LiveIn[b]) {
+                LiveIn[b] = NewLiveIn;
+                Changed = 1;
+            }
+        }
+    }
+    
+    u32 AlwaysWritten = ~0u;
+    for(u32 b = 0; b < BodyCount; b++) {
+        if(Program->Instructions[Body[b]].Opcode == IOP_RETURN) {
+            AlwaysWritten &= Written[b];
+        }
+    }
+    Routine->Inputs = LiveIn[0] | (Routine->Outputs & ~AlwaysWritten);
+    
+    for(u32 b = 0; b < BodyCount; b++) {
+        if(Program->Instructions[Body[b]].Opcode == IOP_RETURN) {
+            Memo->PureReturn[Body[b]] = 1;
+        }
+    }
+}
+
+memo_table *StartMemo(linked_program *Program)
+{
+    u32 Count = Program->InstructionCount;
+    memo_table *Memo = calloc(1, sizeof(memo_table));
+    Memo->Program = Program;
+    Memo->RoutineAt = calloc(Count + 1, sizeof(u32));
+    for(u32 i = 0; i < Count; i++) {
+        instruction *Instruction = Program->Instructions + i;
+        if(Instruction->Opcode == IOP_CALL && Instruction->Target != INVALID_TARGET &&
+           !Memo->RoutineAt[Instruction->Target])
+        {
+            Memo->RoutineAt[Instruction->Target] = ++Memo->RoutineCount;
+        }
+    }
+    if(!Memo->RoutineCount) {
+        free(Memo->RoutineAt);
+        free(Memo);
+        return 0;
+    }
+    
+    Memo->Routines = calloc(Memo->RoutineCount, sizeof(routine));
+    Memo->PureReturn = calloc(Count + 1, 1);
+    for(u32 i = 0; i < Count; i++) {
+        if(Memo->RoutineAt[i]) {
+            routine *Routine = Memo->Routines + Memo->RoutineAt[i] - 1;
+            Routine->Entry = i;
+            AnalyzeRoutine(Memo, Routine);
+        }
+    }
+    
+    Memo->OriginalOpcodes = malloc(Count + 1);
+    Memo->Cache = calloc(MEMO_CACHE_SIZE, sizeof(memo_entry));
+    for(u32 i = 0; i < Count; i++)
+    {
+        instruction *Instruction = Program->Instructions + i;
+        Memo->OriginalOpcodes[i] = Instruction->Opcode;
+        if(Instruction->Opcode == IOP_CALL && Instruction->Target != INVALID_TARGET &&
+           Memo->Routines[Memo->RoutineAt[Instruction->Target] - 1].Kind == ROUTINE_PURE)
+        {
+            Instruction->Opcode = IOP_MEMO_CALL;
+        }
+        else if(Memo->PureReturn[i]) {
+            Instruction->Opcode = IOP_MEMO_RETURN;
+        }
+    }
+    return Memo;
+}
+
+// NOTE(vic): file(line): pure, 10 calls, 8 hits
+void PrintMemoStats(memo_table *Memo)
+{
+    linked_program *Program = Memo->Program;
+    for(u32 r = 0; r < Memo->RoutineCount; r++)
+    {
+        routine *Routine = Memo->Routines + r;
+        instruction_info *Entry = Program->InstructionInfo + Routine->Entry;
+        fprintf(stderr, SV_Fmt"(%u): %s", SV_Arg(Program->FileNames[Entry->FileIndex]), Entry->LineInFile,
+                RoutineKindNames[Routine->Kind]);
+        if(Routine->Kind == ROUTINE_PURE) {
+            fprintf(stderr, ", %llu calls, %llu hits, %llu misses", (unsigned long long)Routine->Calls,
+                    (unsigned long long)Routine->Hits, (unsigned long long)(Routine->Calls - Routine->Hits));
+        }
+        fprintf(stderr, "\n");
+    }
+}
+
+void StopMemo(memo_table *Memo)
+{
+    if(!Memo) return;
+    
+    for(u32 i = 0; i < Memo->Program->InstructionCount; i++) {
+        Memo->Program->Instructions[i].Opcode = Memo->OriginalOpcodes[i];
+    }
+    free(Memo->OriginalOpcodes);
+    free(Memo->RoutineAt);
+    free(Memo->PureReturn);
+    free(Memo->Routines);
+    free(Memo->Cache);
+    free(Memo);
+}
+
+// NOTE(vic): The values in a set of bits, in bit order
+static int GatherValues(memo_table *Memo, routine *Routine, machine_state *State, u32 Set, long int *Values)
+{
+    int Count = 0;
+    if(Set & MEMO_ACC) Values[Count++] = State->ACC;
+    if(Set & MEMO_IX) Values[Count++] = State->IX;
+    if(Set & MEMO_FLAG) Values[Count++] = State->LastCompareResult;
+    for(int i = 0; i < Routine->CellCount; i++) {
+        if(Set & MEMO_CELL(i)) Values[Count++] = Memo->Program->Cells[Routine->Cells[i]];
+    }
+    return Count;
+}
+
+static void ScatterValues(memo_table *Memo, routine *Routine, machine_state *State, u32 Set, long int *Values)
+{
+    int Count = 0;
+    if(Set & MEMO_ACC) State->ACC = (int)Values[Count++];
+    if(Set & MEMO_IX) State->IX = (int)Values[Count++];
+    if(Set & MEMO_FLAG) State->LastCompareResult = (int)Values[Count++];
+    for(int i = 0; i < Routine->CellCount; i++) {
+        if(Set & MEMO_CELL(i)) Memo->Program->Cells[Routine->Cells[i]] = Values[Count++];
+    }
+}
+
+// NOTE(vic): Returns 1 on a hit, State is then at the RETURN
+int CallMemoized(memo_table *Memo, machine_state *State, int *JumpCounts, int Flags)
+{
+    linked_program *Program = Memo->Program;
+    u32 Entry = Program->Instructions[State->Line].Target;
+    u32 Index = Memo->RoutineAt[Entry] - 1;
+    routine *Routine = Memo->Routines + Index;
+    Routine->Calls++;
+    
+    memo_entry *Result = &Memo->Result;
+    Result->Routine = Index + 1;
+    int InputCount = GatherValues(Memo, Routine, State, Routine->Inputs, Result->Inputs);
+    String_View Key = { InputCount*sizeof(long int), (const char *)Result->Inputs };
+    Result->Hash = HashName(Key) ^ (Index*2654435761u);
+    
+    memo_entry *Cached = Memo->Cache + (Result->Hash & (MEMO_CACHE_SIZE - 1));
+    int Hit = Cached->Routine == Result->Routine && Cached->Hash == Result->Hash &&
+        memcmp(Cached->Inputs, Result->Inputs, InputCount*sizeof(long int)) == 0;
+    for(int t = 0; Hit && t < Routine->TargetCount; t++) {
+        if(JumpCounts[Routine->Targets[t]] + Cached->Jumps[t] > JMP_LIMIT && !IsSet(Flags, NO_JMP_LIMIT)) {
+            Hit = 0;
+        }
+    }
+    
+    if(Hit) {
+        Routine->Hits++;
+        ScatterValues(Memo, Routine, State, Routine->Outputs, Cached->Outputs);
+        for(int t = 0; t < Routine->TargetCount; t++) {
+            JumpCounts[Routine->Targets[t]] += Cached->Jumps[t];
+        }
+        State->Steps += Cached->Steps;
+        return 1;
+    }
+    
+    Memo->Running = Routine;
+    Memo->StartSteps = State->Steps;
+    for(int t = 0; t < Routine->TargetCount; t++) {
+        Result->Jumps[t] = JumpCounts[Routine->Targets[t]];
+    }
+    return 0;
+}
+
+// NOTE(vic): Called by Evaluate before a RETURN some pure routine can reach
+void ReturnMemoized(memo_table *Memo, machine_state *State, int *JumpCounts)
+{
+    routine *Routine = Memo->Running;
+    if(!Routine) return;
+    
+    memo_entry *Result = &Memo->Result;
+    GatherValues(Memo, Routine, State, Routine->Outputs, Result->Outputs);
+    for(int t = 0; t < Routine->TargetCount; t++) {
+        Result->Jumps[t] = JumpCounts[Routine->Targets[t]] - Result->Jumps[t];
+    }
+    Result->Steps = State->Steps - Memo->StartSteps;
+    Memo->Cache[Result->Hash & (MEMO_CACHE_SIZE - 1)] = *Result;
+    Memo->Running = 0;
+}
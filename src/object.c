@@ -0,0 +1,300 @@
+// NOTE(vic): .alo object, one parsed file with a relocation for every instruction that uses a label
+
+#define ALA_OBJECT_MAGIC 0x4F4C4123 // "#ALO"
+#define ALA_OBJECT_VERSION 1
+
+typedef struct {
+    u32 Magic;
+    u32 Version;
+    u32 CellSize; // sizeof(long int) where it was compiled
+    u32 LineCount;
+    u32 InstructionCount;
+    u32 SymbolCount;
+    u32 RelocationCount;
+    u32 StartSymbol; // INVALID_TARGET if START isn't declared in this file
+    u32 StartLOC;
+    u32 Reserved;
+    image_string Name;
+    u64 LinesOffset;
+    u64 InstructionsOffset;
+    u64 SymbolsOffset;
+    u64 RelocationsOffset;
+    u64 StringsOffset;
+    u64 StringsSize;
+} object_header;
+
+typedef struct {
+    long int Data;
+    u32 HasData;
+    u32 LOC;
+    image_string Text;
+} object_line;
+
+typedef struct {
+    u8 Opcode;
+    u8 Immediate;
+    u16 Reserved;
+    u32 LineInFile;
+    long int Operand;
+} object_instruction;
+
+typedef struct {
+    image_string Name;
+    u32 LineRef;
+    u32 Declared; // exported by this file, otherwise imported
+} object_symbol;
+
+typedef struct {
+    u32 Instruction;
+    u32 Symbol;
+} object_relocation;
+
+u32 SymbolIndex(symbol_table *SymbolTable, symbol *Symbol)
+{
+    u32 FirstIndex = 0;
+    for(symbol_table *Table = SymbolTable; Table; Table = Table->Next)
+    {
+        if(Symbol >= Table->Symbols && Symbol < Table->Symbols + Table->Used) {
+            return FirstIndex + (u32)(Symbol - Table->Symbols);
+        }
+        FirstIndex += Table->Used;
+    }
+    
+    assert(0 && "Symbol is not in the table");
+    return INVALID_TARGET;
+}
+
+int WriteObjectFile(const char *FilePath, source_file *File)
+{
+    object_header Header = {0};
+    Header.Magic = ALA_OBJECT_MAGIC;
+    Header.Version = ALA_OBJECT_VERSION;
+    Header.CellSize = sizeof(long int);
+    Header.LineCount = (u32)File->LineCount;
+    Header.InstructionCount = (u32)File->LOCCount;
+    Header.StartSymbol = File->StartSymbol ? SymbolIndex(File->SymbolTable, File->StartSymbol) : INVALID_TARGET;
+    Header.StartLOC = (u32)File->StartLOC;
+    
+    for(symbol_table *Table = File->SymbolTable; Table; Table = Table->Next) {
+        Header.SymbolCount += Table->Used;
+    }
+    for(size_t i = 0; i < File->LOCCount; i++) {
+        if(File->Program[i].Label) Header.RelocationCount++;
+    }
+    
+    object_line *Lines = malloc(Header.LineCount*sizeof(object_line));
+    object_instruction *Instructions = malloc(Header.InstructionCount*sizeof(object_instruction));
+    object_symbol *Symbols = malloc(Header.SymbolCount*sizeof(object_symbol));
+    object_relocation *Relocations = malloc(Header.RelocationCount*sizeof(object_relocation));
+    
+    // NOTE(vic): Strings go in the same order they are written at the end
+    u64 StringsSize = 0;
+    Header.Name.Offset = 0;
+    Header.Name.Count = (u32)File->Name.count;
+    StringsSize += File->Name.count;
+    for(u32 i = 0; i < Header.LineCount; i++)
+    {
+        line_map *Map = File->LineMappings + i;
+        Lines[i].Data = Map->Data ? *Map->Data : 0;
+        Lines[i].HasData = Map->Data != 0;
+        Lines[i].LOC = (u32)Map->LOC;
+        Lines[i].Text.Offset = (u32)StringsSize;
+        Lines[i].Text.Count = (u32)File->Lines[i].count;
+        StringsSize += File->Lines[i].count;
+    }
+    
+    u32 SymbolAt = 0;
+    for(symbol_table *Table = File->SymbolTable; Table; Table = Table->Next)
+    {
+        for(int i = 0; i < Table->Used; i++, SymbolAt++)
+        {
+            symbol *Symbol = Table->Symbols + i;
+            Symbols[SymbolAt].Name.Offset = (u32)StringsSize;
+            Symbols[SymbolAt].Name.Count = (u32)Symbol->Name.count;
+            Symbols[SymbolAt].LineRef = (u32)Symbol->LineRef;
+            Symbols[SymbolAt].Declared = Symbol->Evaluated;
+            StringsSize += Symbol->Name.count;
+        }
+    }
+    
+    u32 RelocationAt = 0;
+    for(u32 i = 0; i < Header.InstructionCount; i++)
+    {
+        line_of_code *LOC = File->Program + i;
+        Instructions[i].Opcode = (u8)LOC->Opcode;
+        Instructions[i].Immediate = (u8)LOC->Immediate;
+        Instructions[i].Reserved = 0;
+        Instructions[i].LineInFile = (u32)LOC->LineInFile;
+        Instructions[i].Operand = LOC->Operand;
+        if(LOC->Label) {
+            Relocations[RelocationAt].Instruction = i;
+            Relocations[RelocationAt].Symbol = SymbolIndex(File->SymbolTable, LOC->Label);
+            RelocationAt++;
+        }
+    }
+    
+    u64 LinesSize = (u64)Header.LineCount*sizeof(object_line);
+    u64 InstructionsSize = (u64)Header.InstructionCount*sizeof(object_instruction);
+    u64 SymbolsSize = (u64)Header.SymbolCount*sizeof(object_symbol);
+    u64 RelocationsSize = (u64)Header.RelocationCount*sizeof(object_relocation);
+    Header.LinesOffset = ImageAlign(sizeof(object_header));
+    Header.InstructionsOffset = Header.LinesOffset + ImageAlign(LinesSize);
+    Header.SymbolsOffset = Header.InstructionsOffset + ImageAlign(InstructionsSize);
+    Header.RelocationsOffset = Header.SymbolsOffset + ImageAlign(SymbolsSize);
+    Header.StringsOffset = Header.RelocationsOffset + ImageAlign(RelocationsSize);
+    Header.StringsSize = StringsSize;
+    
+    int Ok = 0;
+    FILE *f = fopen(FilePath, "wb");
+    if(f) {
+        Ok = WriteImageSection(f, &Header, sizeof(Header)) &&
+            WriteImageSection(f, Lines, LinesSize) &&
+            WriteImageSection(f, Instructions, InstructionsSize) &&
+            WriteImageSection(f, Symbols, SymbolsSize) &&
+            WriteImageSection(f, Relocations, RelocationsSize);
+        
+        if(Ok) Ok = fwrite(File->Name.data, 1, File->Name.count, f) == File->Name.count;
+        for(u32 i = 0; Ok && i < Header.LineCount; i++) {
+            Ok = fwrite(File->Lines[i].data, 1, File->Lines[i].count, f) == File->Lines[i].count;
+        }
+        for(symbol_table *Table = File->SymbolTable; Ok && Table; Table = Table->Next) {
+            for(int i = 0; Ok && i < Table->Used; i++) {
+                String_View Name = Table->Symbols[i].Name;
+                Ok = fwrite(Name.data, 1, Name.count, f) == Name.count;
+            }
+        }
+        
+        if(fclose(f) != 0) Ok = 0;
+    }
+    
+    free(Lines);
+    free(Instructions);
+    free(Symbols);
+    free(Relocations);
+    return Ok;
+}
+
+// NOTE(vic): Back to the source_file it was written from, returns 0 and prints why on failure
+int LoadObjectFile(memory_arena **Arena, const char *FilePath, source_file *File, int FileIndex)
+{
+    String_View Content = sv_ReadEntireFile(FilePath);
+    if(!Content.data) {
+        fprintf(stderr, "ERROR: Could not read file %s: %s\n", FilePath, strerror(errno));
+        return 0;
+    }
+    
+    const u8 *Base = (const u8 *)Content.data;
+    object_header *Header = (object_header *)Base;
+    if(Content.count < sizeof(object_header) || Header->Magic != ALA_OBJECT_MAGIC) {
+        fprintf(stderr, "ERROR: %s is not an ALA object file\n", FilePath);
+        free((char *)Content.data);
+        return 0;
+    }
+    if(Header->Version != ALA_OBJECT_VERSION || Header->CellSize != sizeof(long int)) {
+        fprintf(stderr, "ERROR: %s was made by a different version of "PROGRAM_NAME" or for a different platform\n"
+                "NOTE: Make the object again with '-object'\n", FilePath);
+        free((char *)Content.data);
+        return 0;
+    }
+    if(Header->LinesOffset + (u64)Header->LineCount*sizeof(object_line) > Content.count ||
+       Header->InstructionsOffset + (u64)Header->InstructionCount*sizeof(object_instruction) > Content.count ||
+       Header->SymbolsOffset + (u64)Header->SymbolCount*sizeof(object_symbol) > Content.count ||
+       Header->RelocationsOffset + (u64)Header->RelocationCount*sizeof(object_relocation) > Content.count ||
+       Header->StringsOffset + Header->StringsSize > Content.count ||
+       Header->LineCount == 0)
+    {
+        fprintf(stderr, "ERROR: %s is truncated or corrupted\n", FilePath);
+        free((char *)Content.data);
+        return 0;
+    }
+    
+    object_line *Lines = (object_line *)(Base + Header->LinesOffset);
+    object_instruction *Instructions = (object_instruction *)(Base + Header->InstructionsOffset);
+    object_symbol *Symbols = (object_symbol *)(Base + Header->SymbolsOffset);
+    object_relocation *Relocations = (object_relocation *)(Base + Header->RelocationsOffset);
+    const char *Strings = (const char *)(Base + Header->StringsOffset);
+
+#define ObjectString(s) sv_from_parts(Strings + (s).Offset, (s).Count)
+#define CheckObject(Condition) \
+if(!(Condition)) { \
+fprintf(stderr, "ERROR: %s is truncated or corrupted\n", FilePath); \
+free((char *)Content.data); \
+File->Content = SV_NULL; \
+return 0; \
+}
+
+    CheckObject((u64)Header->Name.Offset + Header->Name.Count <= Header->StringsSize);
+    File->Content = Content;
+    File->Name = ObjectString(Header->Name);
+    File->LineCount = Header->LineCount;
+    File->LOCCount = Header->InstructionCount;
+    File->Lines = PushArray(Arena, File->LineCount, String_View);
+    File->LineMappings = PushArray(Arena, File->LineCount, line_map);
+    File->Program = PushArray(Arena, File->LineCount, line_of_code);
+    File->SymbolTable = PushStruct(Arena, symbol_table);
+    File->StartSymbol = 0;
+    File->StartLOC = Header->StartLOC;
+    File->IsObject = 1;
+    
+    CheckObject(Header->InstructionCount <= Header->LineCount && Header->StartLOC <= Header->InstructionCount);
+    for(u32 i = 0; i < Header->LineCount; i++)
+    {
+        CheckObject((u64)Lines[i].Text.Offset + Lines[i].Text.Count <= Header->StringsSize &&
+                    Lines[i].LOC <= Header->InstructionCount);
+        File->Lines[i] = ObjectString(Lines[i].Text);
+        File->LineMappings[i].LOC = Lines[i].LOC;
+        if(Lines[i].HasData) {
+            File->LineMappings[i].Data = PushStruct(Arena, long int);
+            *File->LineMappings[i].Data = Lines[i].Data;
+        }
+    }
+    
+    symbol **SymbolPointers = PushArray(Arena, Header->SymbolCount, symbol *);
+    symbol_table *CurrentSymbolTable = File->SymbolTable;
+    for(u32 i = 0; i < Header->SymbolCount; i++)
+    {
+        CheckObject((u64)Symbols[i].Name.Offset + Symbols[i].Name.Count <= Header->StringsSize &&
+                    Symbols[i].LineRef < Header->LineCount);
+        symbol Symbol = {
+            .Name = ObjectString(Symbols[i].Name),
+            .Evaluated = (int)Symbols[i].Declared,
+            .LineRef = Symbols[i].LineRef,
+            .FileIndex = FileIndex,
+        };
+        SymbolPointers[i] = AddSymbol(Arena, &CurrentSymbolTable, Symbol);
+        if(Header->StartSymbol == i) {
+            File->StartSymbol = SymbolPointers[i];
+        }
+    }
+    
+    for(u32 i = 0; i < Header->InstructionCount; i++)
+    {
+        CheckObject(Instructions[i].Opcode < IOP_COUNT && Instructions[i].LineInFile < Header->LineCount);
+        line_of_code *LOC = File->Program + i;
+        LOC->LineInFile = Instructions[i].LineInFile;
+        LOC->Opcode = Instructions[i].Opcode;
+        LOC->Operand = Instructions[i].Operand;
+        LOC->Immediate = Instructions[i].Immediate;
+        LOC->FileIndex = FileIndex;
+    }
+    
+    for(u32 i = 0; i < Header->RelocationCount; i++)
+    {
+        CheckObject(Relocations[i].Instruction < Header->InstructionCount &&
+                    Relocations[i].Symbol < Header->SymbolCount);
+        File->Program[Relocations[i].Instruction].Label = SymbolPointers[Relocations[i].Symbol];
+    }
+    
+    // NOTE(vic): Same as ParseInstruction, these have to fit in the linked instruction
+    for(u32 i = 0; i < Header->InstructionCount; i++)
+    {
+        line_of_code *LOC = File->Program + i;
+        long long MaxOperand = MaxLinkedOperand(LOC);
+        CheckObject(!MaxOperand || (LOC->Operand >= INT32_MIN && LOC->Operand <= MaxOperand));
+    }
+
+#undef ObjectString
+#undef CheckObject
+
+    return 1;
+}
@@ -0,0 +1,505 @@
+// NOTE(vic): -O, constant propagation and dead code removal on the linked program. What can fail
+// and jump targets always stay, so errors and jump limits don't change.
+
+#define REGISTER_ACC 1
+#define REGISTER_IX 2
+#define REGISTER_FLAG 4
+#define ALL_REGISTERS (REGISTER_ACC | REGISTER_IX | REGISTER_FLAG)
+
+typedef enum {
+    VALUE_UNSET, // not reached yet
+    VALUE_CONSTANT,
+    VALUE_UNKNOWN,
+} value_kind;
+
+typedef struct {
+    value_kind Kind;
+    long int Value;
+} known_value;
+
+typedef struct {
+    known_value ACC;
+    known_value IX;
+    known_value Flag;
+} register_state;
+
+typedef struct {
+    linked_program *Program;
+    u32 Count;
+    u8 *Removed;
+    u8 *Reachable;
+    u8 *ReturnSite; // right after a CALL, or where a SPAWN starts a hart
+    u8 *Pinned;
+    u8 *CellWritten;
+    u8 *CellRead;
+    u8 *LiveIn;
+    register_state *In;
+    u32 *Worklist;
+    int KeepsStores; // -debug, watchpoints stop on them
+} optimizer;
+
+static known_value Constant(long int Value) { return (known_value){ VALUE_CONSTANT, Value }; }
+static known_value Unknown(void) { return (known_value){ VALUE_UNKNOWN, 0 }; }
+
+static known_value MeetValue(known_value a, known_value b)
+{
+    if(a.Kind == VALUE_UNSET) return b;
+    if(b.Kind == VALUE_UNSET) return a;
+    if(a.Kind == VALUE_CONSTANT && b.Kind == VALUE_CONSTANT && a.Value == b.Value) return a;
+    return Unknown();
+}
+
+static int SameValue(known_value a, known_value b)
+{
+    return a.Kind == b.Kind && (a.Kind != VALUE_CONSTANT || a.Value == b.Value);
+}
+
+// NOTE(vic): Data instructions that read a single cell
+static int ReadsTargetCell(instruction *Instruction)
+{
+    switch(Instruction->Opcode)
+    {
+        case IOP_LDD: case IOP_ADD: return 1;
+        case IOP_CMP: case IOP_AND: case IOP_XOR: case IOP_OR:
+        case IOP_SUB: case IOP_MUL: case IOP_DIV: case IOP_MOD: return !Instruction->Immediate;
+        default: return 0;
+    }
+}
+
+// NOTE(vic): Instructions that never do anything besides setting registers (and can't fail)
+static int IsPureInstruction(instruction *Instruction)
+{
+    switch(Instruction->Opcode)
+    {
+        case IOP_LDM: case IOP_LDR: case IOP_LSL: case IOP_LSR:
+        case IOP_ACCINC: case IOP_ACCDEC: case IOP_IXINC: case IOP_IXDEC:
+        return 1;
+        case IOP_CMP: case IOP_AND: case IOP_XOR: case IOP_OR: case IOP_SUB: case IOP_MUL:
+        return Instruction->Immediate || Instruction->Target != INVALID_TARGET;
+        // NOTE(vic): A cell could hold 0 by the time they run
+        case IOP_DIV: case IOP_MOD:
+        return Instruction->Immediate && Instruction->Operand != 0;
+        case IOP_LDD: case IOP_ADD:
+        return Instruction->Target != INVALID_TARGET;
+        default:
+        return 0;
+    }
+}
+
+static int Successors(optimizer *Optimizer, u32 Index, u32 *Next)
+{
+    instruction *Instruction = Optimizer->Program->Instructions + Index;
+    int Count = 0;
+    int FallThrough = 1;
+    if(!Optimizer->Removed[Index]) {
+        switch(Instruction->Opcode)
+        {
+            case IOP_END: case IOP_RETURN: FallThrough = 0; break;
+            case IOP_JMP: case IOP_CALL: FallThrough = 0; // fallthrough
+            case IOP_JPE: case IOP_JPN: case IOP_JPG: case IOP_JPL:
+            {
+                if(Instruction->Target != INVALID_TARGET) Next[Count++] = Instruction->Target;
+            } break;
+        }
+    }
+    if(FallThrough && Index + 1 < Optimizer->Count) Next[Count++] = Index + 1;
+    return Count;
+}
+
+static void FindReachable(optimizer *Optimizer)
+{
+    linked_program *Program = Optimizer->Program;
+    memset(Optimizer->Reachable, 0, Optimizer->Count);
+    memset(Optimizer->ReturnSite, 0, Optimizer->Count);
+    size_t WorklistCount = 0;
+    if(Program->EntryPoint < Optimizer->Count) {
+        Optimizer->Reachable[Program->EntryPoint] = 1;
+        Optimizer->Worklist[WorklistCount++] = Program->EntryPoint;
+    }
+    
+    while(WorklistCount)
+    {
+        u32 Index = Optimizer->Worklist[--WorklistCount];
+        u32 Next[3];
+        int NextCount = Successors(Optimizer, Index, Next);
+        
+        // NOTE(vic): RETURN goes after some CALL
+        instruction *Instruction = Program->Instructions + Index;
+        if(!Optimizer->Removed[Index] && Instruction->Opcode == IOP_CALL && Index + 1 < Optimizer->Count) {
+            Next[NextCount++] = Index + 1;
+            Optimizer->ReturnSite[Index + 1] = 1;
+        }
+        if(!Optimizer->Removed[Index] && Instruction->Opcode == IOP_SPAWN && Instruction->Target != INVALID_TARGET) {
+            Next[NextCount++] = Instruction->Target;
+            Optimizer->ReturnSite[Instruction->Target] = 1;
+        }
+        
+        for(int i = 0; i < NextCount; i++) {
+            if(!Optimizer->Reachable[Next[i]]) {
+                Optimizer->Reachable[Next[i]] = 1;
+                Optimizer->Worklist[WorklistCount++] = Next[i];
+            }
+        }
+    }
+    
+    for(u32 i = 0; i < Optimizer->Count; i++) {
+        if(!Optimizer->Reachable[i]) Optimizer->Removed[i] = 1;
+    }
+}
+
+static void FindCellUses(optimizer *Optimizer)
+{
+    linked_program *Program = Optimizer->Program;
+    memset(Optimizer->CellWritten, 0, Program->CellCount);
+    memset(Optimizer->CellRead, 0, Program->CellCount);
+    memset(Optimizer->Pinned, 0, Optimizer->Count);
+    
+    for(u32 i = 0; i < Optimizer->Count; i++)
+    {
+        if(Optimizer->Removed[i]) continue;
+        
+        instruction *Instruction = Program->Instructions + i;
+        file_info *File = Program->Files + Instruction->AddressFileIndex;
+        int HasTarget = Instruction->Target != INVALID_TARGET;
+        switch(Instruction->Opcode)
+        {
+            case IOP_STO:
+            {
+                if(HasTarget) Optimizer->CellWritten[Instruction->Target] = 1;
+            } break;
+            
+            // NOTE(vic): STI reads the pointer and stores into the same cell, CAS compares and stores
+            case IOP_STI: case IOP_CAS:
+            {
+                if(HasTarget) Optimizer->CellWritten[Instruction->Target] = Optimizer->CellRead[Instruction->Target] = 1;
+            } break;
+            
+            case IOP_STX: case IOP_FILL:
+            {
+                memset(Optimizer->CellWritten + File->FirstCell, 1, File->LineCount);
+            } break;
+            
+            case IOP_COPY:
+            {
+                memset(Optimizer->CellWritten + File->FirstCell, 1, File->LineCount);
+                memset(Optimizer->CellRead + File->FirstCell, 1, File->LineCount);
+            } break;
+            
+            case IOP_LDI:
+            {
+                if(HasTarget) Optimizer->CellRead[Instruction->Target] = 1;
+                memset(Optimizer->CellRead + File->FirstCell, 1, File->LineCount);
+            } break;
+            
+            case IOP_LDX:
+            {
+                memset(Optimizer->CellRead + File->FirstCell, 1, File->LineCount);
+            } break;
+            
+            case IOP_JMP: case IOP_JPE: case IOP_JPN: case IOP_JPG: case IOP_JPL: case IOP_CALL: case IOP_SPAWN:
+            {
+                if(HasTarget) Optimizer->Pinned[Instruction->Target] = 1;
+            } break;
+            
+            default:
+            {
+                if(ReadsTargetCell(Instruction) && HasTarget) Optimizer->CellRead[Instruction->Target] = 1;
+            } break;
+        }
+    }
+}
+
+// NOTE(vic): Mirrors what Evaluate does, ACC and IX are ints there
+static register_state Transfer(optimizer *Optimizer, u32 Index, register_state In)
+{
+    linked_program *Program = Optimizer->Program;
+    instruction *Instruction = Program->Instructions + Index;
+    register_state Out = In;
+    if(Optimizer->Removed[Index]) return Out;
+    
+    // NOTE(vic): The operand of data instructions, when it's known
+    known_value Operand = Unknown();
+    if(Instruction->Immediate || Instruction->Opcode == IOP_LSL || Instruction->Opcode == IOP_LSR) {
+        Operand = Constant(Instruction->Operand);
+    }
+    else if(ReadsTargetCell(Instruction) && Instruction->Target != INVALID_TARGET &&
+            !Optimizer->CellWritten[Instruction->Target]) {
+        Operand = Constant(Program->Cells[Instruction->Target]);
+    }
+    int Known = In.ACC.Kind == VALUE_CONSTANT && Operand.Kind == VALUE_CONSTANT;
+    int ACC = (int)In.ACC.Value;
+    long int Value = Operand.Value;
+    
+    switch(Instruction->Opcode)
+    {
+        case IOP_LDM: Out.ACC = Constant((int)Instruction->Operand); break;
+        case IOP_LDD: Out.ACC = Operand.Kind == VALUE_CONSTANT ? Constant((int)Value) : Unknown(); break;
+        case IOP_LDR: Out.IX = Constant((int)Instruction->Operand); break;
+        case IOP_ADD: Out.ACC = Known ? Constant((int)(ACC + Value)) : Unknown(); break;
+        case IOP_CMP: Out.Flag = Known ? Constant(CompareValues(ACC, Value)) : Unknown(); break;
+        case IOP_AND: Out.ACC = Known ? Constant((int)(ACC & Value)) : Unknown(); break;
+        case IOP_XOR: Out.ACC = Known ? Constant((int)(ACC ^ Value)) : Unknown(); break;
+        case IOP_OR: Out.ACC = Known ? Constant((int)(ACC | Value)) : Unknown(); break;
+        case IOP_SUB: Out.ACC = Known ? Constant((int)((u32)ACC - (u32)Value)) : Unknown(); break;
+        case IOP_MUL: Out.ACC = Known ? Constant((int)((u32)ACC*(u32)Value)) : Unknown(); break;
+        
+        case IOP_DIV:
+        case IOP_MOD:
+        {
+            if(Known && Value != 0) {
+                Out.ACC = Constant((int)(Instruction->Opcode == IOP_DIV ? ACC/(long long)Value : ACC%(long long)Value));
+            }
+            else {
+                Out.ACC = Unknown();
+            }
+        } break;
+        
+        case IOP_LSL:
+        case IOP_LSR:
+        {
+            if(Known && Value >= 0 && Value < 32) {
+                Out.ACC = Constant(Instruction->Opcode == IOP_LSL ? (int)((u32)ACC << Value) : ACC >> Value);
+            }
+            else {
+                Out.ACC = Unknown();
+            }
+        } break;
+        
+        case IOP_ACCINC: Out.ACC = In.ACC.Kind == VALUE_CONSTANT ? Constant((int)((u32)ACC + 1)) : Unknown(); break;
+        case IOP_ACCDEC: Out.ACC = In.ACC.Kind == VALUE_CONSTANT ? Constant((int)((u32)ACC - 1)) : Unknown(); break;
+        case IOP_IXINC: Out.IX = In.IX.Kind == VALUE_CONSTANT ? Constant((int)((u32)In.IX.Value + 1)) : Unknown(); break;
+        case IOP_IXDEC: Out.IX = In.IX.Kind == VALUE_CONSTANT ? Constant((int)((u32)In.IX.Value - 1)) : Unknown(); break;
+        
+        case IOP_LDI: case IOP_LDX: case IOP_INP: case IOP_SPAWN: Out.ACC = Unknown(); break;
+        case IOP_CAS: Out.ACC = Unknown(); Out.Flag = Unknown(); break;
+        default: break;
+    }
+    return Out;
+}
+
+static void PropagateConstants(optimizer *Optimizer)
+{
+    linked_program *Program = Optimizer->Program;
+    memset(Optimizer->In, 0, Optimizer->Count*sizeof(register_state));
+    size_t WorklistCount = 0;
+    u8 *Queued = calloc(Optimizer->Count + 1, 1);
+    
+    // NOTE(vic): Evaluate starts with everything at 0, nothing is known after a RETURN or in a new hart
+    register_state Start = { Constant(0), Constant(0), Constant(0) };
+    register_state Anything = { Unknown(), Unknown(), Unknown() };
+    for(u32 i = 0; i < Optimizer->Count; i++) {
+        if(Optimizer->ReturnSite[i] && !Optimizer->Removed[i]) {
+            Optimizer->In[i] = Anything;
+            Optimizer->Worklist[WorklistCount++] = i;
+            Queued[i] = 1;
+        }
+    }
+    if(Program->EntryPoint < Optimizer->Count) {
+        register_state *In = Optimizer->In + Program->EntryPoint;
+        In->ACC = MeetValue(In->ACC, Start.ACC);
+        In->IX = MeetValue(In->IX, Start.IX);
+        In->Flag = MeetValue(In->Flag, Start.Flag);
+        if(!Queued[Program->EntryPoint]) {
+            Optimizer->Worklist[WorklistCount++] = Program->EntryPoint;
+            Queued[Program->EntryPoint] = 1;
+        }
+    }
+    
+    while(WorklistCount)
+    {
+        u32 Index = Optimizer->Worklist[--WorklistCount];
+        Queued[Index] = 0;
+        register_state Out = Transfer(Optimizer, Index, Optimizer->In[Index]);
+        
+        u32 Next[2];
+        int NextCount = Successors(Optimizer, Index, Next);
+        for(int i = 0; i < NextCount; i++)
+        {
+            register_state *In = Optimizer->In + Next[i];
+            register_state New = { MeetValue(In->ACC, Out.ACC), MeetValue(In->IX, Out.IX), MeetValue(In->Flag, Out.Flag) };
+            if(!SameValue(New.ACC, In->ACC) || !SameValue(New.IX, In->IX) || !SameValue(New.Flag, In->Flag)) {
+                *In = New;
+                if(!Queued[Next[i]]) {
+                    Optimizer->Worklist[WorklistCount++] = Next[i];
+                    Queued[Next[i]] = 1;
+                }
+            }
+        }
+    }
+    free(Queued);
+}
+
+// NOTE(vic): Returns 1 if anything changed
+static int FoldConstants(optimizer *Optimizer)
+{
+    int Changed = 0;
+    for(u32 i = 0; i < Optimizer->Count; i++)
+    {
+        if(Optimizer->Removed[i]) continue;
+        
+        instruction *Instruction = Optimizer->Program->Instructions + i;
+        register_state In = Optimizer->In[i];
+        register_state Out = Transfer(Optimizer, i, In);
+        int Opcode = Instruction->Opcode;
+        int SetsACC = IsPureInstruction(Instruction) && Opcode != IOP_CMP && Opcode != IOP_LDR &&
+            Opcode != IOP_IXINC && Opcode != IOP_IXDEC;
+        int SetsIX = Opcode == IOP_LDR || Opcode == IOP_IXINC || Opcode == IOP_IXDEC;
+        
+        if(SetsACC && Out.ACC.Kind == VALUE_CONSTANT && !(Opcode == IOP_LDM && Instruction->Operand == Out.ACC.Value)) {
+            Instruction->Opcode = IOP_LDM;
+            Instruction->Immediate = 1;
+            Instruction->Operand = Out.ACC.Value;
+            Changed = 1;
+        }
+        else if(SetsIX && Out.IX.Kind == VALUE_CONSTANT && !(Opcode == IOP_LDR && Instruction->Operand == Out.IX.Value)) {
+            Instruction->Opcode = IOP_LDR;
+            Instruction->Immediate = 1;
+            Instruction->Operand = Out.IX.Value;
+            Changed = 1;
+        }
+        else if(IsBranchInstruction(Opcode) && In.Flag.Kind == VALUE_CONSTANT) {
+            if(TakesBranch(Opcode, (int)In.Flag.Value)) {
+                Instruction->Opcode = IOP_JMP;
+                Changed = 1;
+            }
+            else if(!Optimizer->Pinned[i]) {
+                Optimizer->Removed[i] = 1;
+                Changed = 1;
+            }
+        }
+    }
+    return Changed;
+}
+
+static void InstructionRegisters(instruction *Instruction, u8 *Use, u8 *Def)
+{
+    *Use = *Def = 0;
+    switch(Instruction->Opcode)
+    {
+        case IOP_LDM: case IOP_LDD: case IOP_LDI: case IOP_INP: *Def = REGISTER_ACC; break;
+        case IOP_LDX: *Use = REGISTER_IX; *Def = REGISTER_ACC; break;
+        case IOP_LDR: *Def = REGISTER_IX; break;
+        case IOP_STO: case IOP_STI: case IOP_OUT: *Use = REGISTER_ACC; break;
+        case IOP_STX: *Use = REGISTER_ACC | REGISTER_IX; break;
+        case IOP_ADD: case IOP_AND: case IOP_XOR: case IOP_OR: case IOP_LSL: case IOP_LSR:
+        case IOP_ACCINC: case IOP_ACCDEC: case IOP_SUB: case IOP_MUL: case IOP_DIV: case IOP_MOD:
+        *Use = *Def = REGISTER_ACC; break;
+        case IOP_IXINC: case IOP_IXDEC: *Use = *Def = REGISTER_IX; break;
+        case IOP_CMP: *Use = REGISTER_ACC; *Def = REGISTER_FLAG; break;
+        case IOP_JPE: case IOP_JPN: case IOP_JPG: case IOP_JPL: *Use = REGISTER_FLAG; break;
+        case IOP_COPY: case IOP_FILL: *Use = REGISTER_ACC | REGISTER_IX; break;
+        case IOP_RETURN: *Use = ALL_REGISTERS; break;
+        case IOP_SPAWN: *Use = REGISTER_ACC | REGISTER_IX; *Def = REGISTER_ACC; break;
+        case IOP_CAS: *Use = REGISTER_ACC | REGISTER_IX; *Def = REGISTER_ACC | REGISTER_FLAG; break;
+        default: break;
+    }
+}
+
+// NOTE(vic): Backwards liveness of the registers, then removes what nothing needs
+static int RemoveDeadInstructions(optimizer *Optimizer)
+{
+    linked_program *Program = Optimizer->Program;
+    memset(Optimizer->LiveIn, 0, Optimizer->Count);
+    for(int Changed = 1; Changed;)
+    {
+        Changed = 0;
+        for(u32 i = Optimizer->Count; i-- > 0;)
+        {
+            if(!Optimizer->Reachable[i]) continue;
+            
+            u32 Next[2];
+            int NextCount = Successors(Optimizer, i, Next);
+            u8 LiveOut = 0;
+            for(int n = 0; n < NextCount; n++) LiveOut |= Optimizer->LiveIn[Next[n]];
+            
+            u8 Use = 0, Def = 0;
+            if(!Optimizer->Removed[i]) InstructionRegisters(Program->Instructions + i, &Use, &Def);
+            u8 LiveIn = Use | (LiveOut & ~Def);
+            if(LiveIn != Optimizer->LiveIn[i]) {
+                Optimizer->LiveIn[i] = LiveIn;
+                Changed = 1;
+            }
+        }
+    }
+    
+    int Removed = 0;
+    for(u32 i = 0; i < Optimizer->Count; i++)
+    {
+        if(Optimizer->Removed[i] || Optimizer->Pinned[i]) continue;
+        
+        instruction *Instruction = Program->Instructions + i;
+        u32 Next[2];
+        int NextCount = Successors(Optimizer, i, Next);
+        u8 LiveOut = 0;
+        for(int n = 0; n < NextCount; n++) LiveOut |= Optimizer->LiveIn[Next[n]];
+        
+        u8 Use, Def;
+        InstructionRegisters(Instruction, &Use, &Def);
+        int DeadStore = Instruction->Opcode == IOP_STO && Instruction->Target != INVALID_TARGET &&
+            !Optimizer->CellRead[Instruction->Target] && !Optimizer->KeepsStores;
+        if((IsPureInstruction(Instruction) && !(Def & LiveOut)) || DeadStore) {
+            Optimizer->Removed[i] = 1;
+            Removed = 1;
+        }
+    }
+    return Removed;
+}
+
+void OptimizeProgram(linked_program *Program, int Flags)
+{
+    optimizer Optimizer = {0};
+    Optimizer.Program = Program;
+    Optimizer.KeepsStores = IsSet(Flags, ALA_DEBUG);
+    Optimizer.Count = Program->InstructionCount;
+    u32 Count = Optimizer.Count + 1;
+    Optimizer.Removed = calloc(Count, 1);
+    Optimizer.Reachable = calloc(Count, 1);
+    Optimizer.ReturnSite = calloc(Count, 1);
+    Optimizer.Pinned = calloc(Count, 1);
+    Optimizer.LiveIn = calloc(Count, 1);
+    Optimizer.CellWritten = calloc(Program->CellCount + 1, 1);
+    Optimizer.CellRead = calloc(Program->CellCount + 1, 1);
+    Optimizer.In = calloc(Count, sizeof(register_state));
+    Optimizer.Worklist = calloc(2*Count + 2, sizeof(u32));
+    
+    // NOTE(vic): Folding a jump can make code unreachable and removing code can make more dead
+    for(int Round = 0, Changed = 1; Changed && Round < 16; Round++)
+    {
+        FindReachable(&Optimizer);
+        FindCellUses(&Optimizer);
+        PropagateConstants(&Optimizer);
+        Changed = FoldConstants(&Optimizer);
+        Changed |= RemoveDeadInstructions(&Optimizer);
+    }
+    
+    // NOTE(vic): Compact, removed instructions go to the next one that stays
+    u32 *NewIndex = calloc(Count, sizeof(u32));
+    u32 NewCount = 0;
+    for(u32 i = 0; i < Optimizer.Count; i++) {
+        NewIndex[i] = NewCount;
+        if(!Optimizer.Removed[i]) {
+            Program->InstructionInfo[NewCount] = Program->InstructionInfo[i];
+            Program->Instructions[NewCount++] = Program->Instructions[i];
+        }
+    }
+    NewIndex[Optimizer.Count] = NewCount;
+    for(u32 i = 0; i < NewCount; i++) {
+        instruction *Instruction = Program->Instructions + i;
+        if(IsJumpInstruction(Instruction->Opcode) && Instruction->Target != INVALID_TARGET) {
+            Instruction->Target = NewIndex[Instruction->Target];
+        }
+    }
+    Program->EntryPoint = NewIndex[Program->EntryPoint < Optimizer.Count ? Program->EntryPoint : Optimizer.Count];
+    Program->InstructionCount = NewCount;
+    
+    free(NewIndex);
+    free(Optimizer.Removed);
+    free(Optimizer.Reachable);
+    free(Optimizer.ReturnSite);
+    free(Optimizer.Pinned);
+    free(Optimizer.LiveIn);
+    free(Optimizer.CellWritten);
+    free(Optimizer.CellRead);
+    free(Optimizer.In);
+    free(Optimizer.Worklist);
+}
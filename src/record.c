@@ -0,0 +1,423 @@
+// NOTE(vic): -record / -replay, the inputs, outputs and a snapshot (at a jump) every SNAPSHOT_INTERVAL
+// steps with what changed since the last one
+
+#define ALA_RECORDING_MAGIC 0x524C4123 // "#ALR"
+#define ALA_RECORDING_VERSION 2
+#define SNAPSHOT_INTERVAL (1 << 20)
+
+typedef struct {
+    u32 Magic;
+    u32 Version;
+    u32 ProgramHash;
+    u32 CellSize; // sizeof(long int) where it was recorded
+    u32 InstructionCount;
+    u32 CellCount;
+} recording_header;
+
+typedef enum {
+    EVENT_INPUT = 1,
+    EVENT_OUTPUT = 2,
+    EVENT_SNAPSHOT = 3,
+    EVENT_END = 4,
+} event_kind;
+
+typedef struct {
+    u32 Kind;
+    u32 Count; // snapshots: number of record_delta after the registers
+    u64 Steps; // instructions run before this one
+    long int Value;
+} record_event;
+
+typedef struct {
+    int ACC;
+    int IX;
+    int LastCompareResult;
+    u32 Line;
+    u32 CallDepth;
+    u32 ReturnAddress; // top of the call stack, only to find divergences
+} record_registers;
+
+// NOTE(vic): Cells, then jump counts, then the call stack
+typedef struct {
+    u32 Index;
+    u32 Reserved;
+    long int Value;
+} record_delta;
+
+typedef struct {
+    u64 Steps;
+    record_registers Registers;
+    u32 FirstDelta;
+    u32 DeltaCount;
+} snapshot;
+
+typedef struct {
+    u64 Steps;
+    long int Value;
+} recorded_value;
+
+typedef struct {
+    int Replaying;
+    const char *Path;
+    linked_program *Program;
+    int *JumpCounts;
+    u32 *CallStack;
+    
+    // NOTE(vic): -record
+    FILE *File;
+    long int *ShadowCells;
+    int *ShadowJumpCounts;
+    u32 *ShadowCallStack;
+    u64 NextSnapshotStep;
+    
+    // NOTE(vic): -replay, snapshot 0 is the start of the program
+    long int *InitialCells;
+    recorded_value *Inputs;
+    recorded_value *Outputs;
+    snapshot *Snapshots;
+    record_delta *Deltas;
+    size_t InputCount, OutputCount, SnapshotCount;
+    size_t NextInput, NextOutput, NextSnapshot;
+    size_t OutputsPrinted; // outputs before this one were already printed, going back doesn't print them again
+} recording;
+
+u32 HashProgram(linked_program *Program)
+{
+    u32 Hash = HashName(sv_from_parts((const char *)Program->Instructions,
+                                      Program->InstructionCount*sizeof(instruction)));
+    Hash = Hash*31 + HashName(sv_from_parts((const char *)Program->Cells, Program->CellCount*sizeof(long int)));
+    return Hash*31 + HashName(sv_from_parts((const char *)Program->CellHasData, Program->CellCount));
+}
+
+recording *StartRecording(const char *Path, linked_program *Program)
+{
+    recording *Recording = calloc(1, sizeof(recording));
+    Recording->Path = Path;
+    Recording->Program = Program;
+    Recording->File = fopen(Path, "wb");
+    if(!Recording->File) {
+        fprintf(stderr, "ERROR: Could not write %s: %s\n", Path, strerror(errno));
+        exit(1);
+    }
+    
+    recording_header Header = {
+        .Magic = ALA_RECORDING_MAGIC,
+        .Version = ALA_RECORDING_VERSION,
+        .ProgramHash = HashProgram(Program),
+        .CellSize = sizeof(long int),
+        .InstructionCount = Program->InstructionCount,
+        .CellCount = Program->CellCount,
+    };
+    fwrite(&Header, sizeof(Header), 1, Recording->File);
+    
+    Recording->ShadowCells = malloc(Program->CellCount*sizeof(long int) + 1);
+    memcpy(Recording->ShadowCells, Program->Cells, Program->CellCount*sizeof(long int));
+    Recording->ShadowJumpCounts = calloc(Program->InstructionCount + 1, sizeof(int));
+    Recording->ShadowCallStack = calloc(MAX_CALL_DEPTH, sizeof(u32));
+    Recording->NextSnapshotStep = SNAPSHOT_INTERVAL;
+    return Recording;
+}
+
+// NOTE(vic): Returns 0 and prints the reason if the recording can't be replayed
+recording *StartReplay(const char *Path, linked_program *Program)
+{
+    String_View Content = sv_ReadEntireFile(Path);
+    if(!Content.data) {
+        fprintf(stderr, "ERROR: Could not read file %s: %s\n"
+                "NOTE: Make a recording first with '-record'\n", Path, strerror(errno));
+        return 0;
+    }
+    
+    recording_header *Header = (recording_header *)Content.data;
+    if(Content.count < sizeof(recording_header) || Header->Magic != ALA_RECORDING_MAGIC ||
+       Header->Version != ALA_RECORDING_VERSION || Header->CellSize != sizeof(long int))
+    {
+        fprintf(stderr, "ERROR: %s is not a recording this version of ALA can replay\n", Path);
+        return 0;
+    }
+    if(Header->ProgramHash != HashProgram(Program) || Header->InstructionCount != Program->InstructionCount ||
+       Header->CellCount != Program->CellCount)
+    {
+        fprintf(stderr, "ERROR: %s was recorded with a different program\n", Path);
+        return 0;
+    }
+    
+    recording *Recording = calloc(1, sizeof(recording));
+    Recording->Replaying = 1;
+    Recording->Path = Path;
+    Recording->Program = Program;
+    Recording->InitialCells = malloc(Program->CellCount*sizeof(long int) + 1);
+    memcpy(Recording->InitialCells, Program->Cells, Program->CellCount*sizeof(long int));
+    
+    // NOTE(vic): Count first so every array is allocated once
+    size_t DeltaCount = 0;
+    size_t SnapshotCount = 1;
+    const char *End = Content.data + Content.count;
+    for(int Pass = 0; Pass < 2; Pass++)
+    {
+        if(Pass == 1) {
+            Recording->Inputs = malloc((Recording->InputCount + 1)*sizeof(recorded_value));
+            Recording->Outputs = malloc((Recording->OutputCount + 1)*sizeof(recorded_value));
+            Recording->Snapshots = calloc(SnapshotCount, sizeof(snapshot));
+            Recording->Deltas = malloc((DeltaCount + 1)*sizeof(record_delta));
+            Recording->Snapshots[0].Registers.Line = Program->EntryPoint;
+            Recording->InputCount = Recording->OutputCount = 0;
+            Recording->SnapshotCount = 1;
+            DeltaCount = 0;
+        }
+        
+        const char *At = Content.data + sizeof(recording_header);
+        while(At < End)
+        {
+            record_event *Event = (record_event *)At;
+            At += sizeof(record_event);
+            if(At > End) goto corrupted;
+            
+            switch(Event->Kind)
+            {
+                case EVENT_INPUT:
+                {
+                    if(Pass == 1) Recording->Inputs[Recording->InputCount] = (recorded_value){ Event->Steps, Event->Value };
+                    Recording->InputCount++;
+                } break;
+                
+                case EVENT_OUTPUT:
+                {
+                    if(Pass == 1) Recording->Outputs[Recording->OutputCount] = (recorded_value){ Event->Steps, Event->Value };
+                    Recording->OutputCount++;
+                } break;
+                
+                case EVENT_SNAPSHOT:
+                {
+                    record_registers *Registers = (record_registers *)At;
+                    record_delta *Deltas = (record_delta *)(At + sizeof(record_registers));
+                    At += sizeof(record_registers) + (u64)Event->Count*sizeof(record_delta);
+                    if(At > End) goto corrupted;
+                    if(Registers->CallDepth > MAX_CALL_DEPTH) goto corrupted;
+                    
+                    for(u32 i = 0; i < Event->Count; i++) {
+                        if(Deltas[i].Index >= Program->CellCount + Program->InstructionCount + MAX_CALL_DEPTH) {
+                            goto corrupted;
+                        }
+                    }
+                    if(Pass == 0) {
+                        SnapshotCount++;
+                    }
+                    else {
+                        snapshot *Snapshot = Recording->Snapshots + Recording->SnapshotCount++;
+                        Snapshot->Steps = Event->Steps;
+                        Snapshot->Registers = *Registers;
+                        Snapshot->FirstDelta = (u32)DeltaCount;
+                        Snapshot->DeltaCount = Event->Count;
+                        memcpy(Recording->Deltas + DeltaCount, Deltas, Event->Count*sizeof(record_delta));
+                    }
+                    DeltaCount += Event->Count;
+                } break;
+                
+                case EVENT_END: break;
+                
+                default: goto corrupted;
+            }
+        }
+    }
+    
+    free((char *)Content.data);
+    return Recording;
+    
+    corrupted:
+    fprintf(stderr, "ERROR: %s is truncated or corrupted\n", Path);
+    free((char *)Content.data);
+    return 0;
+}
+
+// NOTE(vic): Called by Evaluate before the first instruction, returns the first step to snapshot at
+u64 BeginRecordedRun(recording *Recording, int *JumpCounts, u32 *CallStack)
+{
+    Recording->JumpCounts = JumpCounts;
+    Recording->CallStack = CallStack;
+    if(Recording->Replaying) {
+        return Recording->SnapshotCount > 1 ? Recording->Snapshots[1].Steps : ~(u64)0;
+    }
+    return Recording->NextSnapshotStep;
+}
+
+void ReportDivergence(recording *Recording, u64 Steps, const char *What)
+{
+    fflush(stdout);
+    fprintf(stderr, "\nERROR: The replay diverged from %s after %llu steps: %s\n"
+            "NOTE: The program or the ALA version changed since it was recorded\n",
+            Recording->Path, (unsigned long long)Steps, What);
+    Fail();
+}
+
+void WriteEvent(recording *Recording, event_kind Kind, u64 Steps, long int Value)
+{
+    record_event Event = { .Kind = Kind, .Steps = Steps, .Value = Value };
+    fwrite(&Event, sizeof(Event), 1, Recording->File);
+}
+
+// NOTE(vic): Taken while recording, compared while replaying, returns the step of the next one
+u64 RecordSnapshot(recording *Recording, machine_state *State)
+{
+    linked_program *Program = Recording->Program;
+    if(Recording->Replaying) {
+        // NOTE(vic): After going back in time the evaluator can ask early, skip what is behind
+        while(Recording->NextSnapshot < Recording->SnapshotCount &&
+              Recording->Snapshots[Recording->NextSnapshot].Steps < State->Steps) {
+            Recording->NextSnapshot++;
+        }
+        if(Recording->NextSnapshot < Recording->SnapshotCount &&
+           Recording->Snapshots[Recording->NextSnapshot].Steps == State->Steps)
+        {
+            record_registers *Registers = &Recording->Snapshots[Recording->NextSnapshot++].Registers;
+            if(Registers->ACC != State->ACC || Registers->IX != State->IX || Registers->Line != State->Line ||
+               Registers->LastCompareResult != State->LastCompareResult ||
+               Registers->CallDepth != State->CallDepth ||
+               (State->CallDepth && Registers->ReturnAddress != State->CallStack[State->CallDepth - 1]))
+            {
+                ReportDivergence(Recording, State->Steps, "the registers are different");
+            }
+        }
+        return Recording->NextSnapshot < Recording->SnapshotCount ?
+            Recording->Snapshots[Recording->NextSnapshot].Steps : ~(u64)0;
+    }
+    
+    u32 DeltaCount = 0;
+    for(u32 i = 0; i < Program->CellCount; i++) {
+        DeltaCount += Program->Cells[i] != Recording->ShadowCells[i];
+    }
+    for(u32 i = 0; i < Program->InstructionCount; i++) {
+        DeltaCount += Recording->JumpCounts[i] != Recording->ShadowJumpCounts[i];
+    }
+    for(u32 i = 0; i < State->CallDepth; i++) {
+        DeltaCount += State->CallStack[i] != Recording->ShadowCallStack[i];
+    }
+    
+    record_event Event = { .Kind = EVENT_SNAPSHOT, .Count = DeltaCount, .Steps = State->Steps };
+    record_registers Registers = {
+        .ACC = State->ACC,
+        .IX = State->IX,
+        .LastCompareResult = State->LastCompareResult,
+        .Line = (u32)State->Line,
+        .CallDepth = State->CallDepth,
+        .ReturnAddress = State->CallDepth ? State->CallStack[State->CallDepth - 1] : 0,
+    };
+    fwrite(&Event, sizeof(Event), 1, Recording->File);
+    fwrite(&Registers, sizeof(Registers), 1, Recording->File);
+    for(u32 i = 0; i < Program->CellCount; i++) {
+        if(Program->Cells[i] != Recording->ShadowCells[i]) {
+            record_delta Delta = { .Index = i, .Value = Program->Cells[i] };
+            fwrite(&Delta, sizeof(Delta), 1, Recording->File);
+            Recording->ShadowCells[i] = Program->Cells[i];
+        }
+    }
+    for(u32 i = 0; i < Program->InstructionCount; i++) {
+        if(Recording->JumpCounts[i] != Recording->ShadowJumpCounts[i]) {
+            record_delta Delta = { .Index = Program->CellCount + i, .Value = Recording->JumpCounts[i] };
+            fwrite(&Delta, sizeof(Delta), 1, Recording->File);
+            Recording->ShadowJumpCounts[i] = Recording->JumpCounts[i];
+        }
+    }
+    for(u32 i = 0; i < State->CallDepth; i++) {
+        if(State->CallStack[i] != Recording->ShadowCallStack[i]) {
+            record_delta Delta = { .Index = Program->CellCount + Program->InstructionCount + i,
+                .Value = State->CallStack[i] };
+            fwrite(&Delta, sizeof(Delta), 1, Recording->File);
+            Recording->ShadowCallStack[i] = State->CallStack[i];
+        }
+    }
+    
+    Recording->NextSnapshotStep = State->Steps + SNAPSHOT_INTERVAL;
+    return Recording->NextSnapshotStep;
+}
+
+int RecordedInput(recording *Recording, u64 Steps)
+{
+    if(!Recording->Replaying) {
+        int Value = getchar();
+        WriteEvent(Recording, EVENT_INPUT, Steps, Value);
+        return Value;
+    }
+    
+    if(Recording->NextInput >= Recording->InputCount ||
+       Recording->Inputs[Recording->NextInput].Steps != Steps) {
+        ReportDivergence(Recording, Steps, "INP was not run at this point when recording");
+    }
+    return (int)Recording->Inputs[Recording->NextInput++].Value;
+}
+
+// NOTE(vic): Returns 0 if the output must not be printed (it was already printed before going back)
+int RecordedOutput(recording *Recording, u64 Steps, int Value)
+{
+    if(!Recording->Replaying) {
+        WriteEvent(Recording, EVENT_OUTPUT, Steps, Value);
+        return 1;
+    }
+    
+    if(Recording->NextOutput >= Recording->OutputCount ||
+       Recording->Outputs[Recording->NextOutput].Steps != Steps ||
+       Recording->Outputs[Recording->NextOutput].Value != Value) {
+        ReportDivergence(Recording, Steps, "OUT printed something else when recording");
+    }
+    
+    size_t Output = Recording->NextOutput++;
+    if(Output < Recording->OutputsPrinted) return 0;
+    Recording->OutputsPrinted = Output + 1;
+    return 1;
+}
+
+void EndRecordedRun(recording *Recording, u64 Steps)
+{
+    if(!Recording->Replaying) {
+        WriteEvent(Recording, EVENT_END, Steps, 0);
+        if(fclose(Recording->File) != 0) {
+            fprintf(stderr, "ERROR: Could not write %s: %s\n", Recording->Path, strerror(errno));
+        }
+    }
+    else if(Recording->NextInput != Recording->InputCount || Recording->NextOutput != Recording->OutputCount) {
+        ReportDivergence(Recording, Steps, "the program ended before the recording did");
+    }
+}
+
+// NOTE(vic): Latest snapshot at or before Steps
+size_t FindSnapshot(recording *Recording, u64 Steps)
+{
+    size_t Index = 0;
+    while(Index + 1 < Recording->SnapshotCount && Recording->Snapshots[Index + 1].Steps <= Steps) Index++;
+    return Index;
+}
+
+// NOTE(vic): From the start of the program and the deltas up to Index
+void RestoreSnapshot(recording *Recording, size_t Index, machine_state *State)
+{
+    linked_program *Program = Recording->Program;
+    memcpy(Program->Cells, Recording->InitialCells, Program->CellCount*sizeof(long int));
+    memset(Recording->JumpCounts, 0, Program->InstructionCount*sizeof(int));
+    memset(Recording->CallStack, 0, MAX_CALL_DEPTH*sizeof(u32));
+    for(size_t s = 1; s <= Index; s++) {
+        snapshot *Snapshot = Recording->Snapshots + s;
+        for(u32 i = 0; i < Snapshot->DeltaCount; i++) {
+            record_delta *Delta = Recording->Deltas + Snapshot->FirstDelta + i;
+            u32 Index = Delta->Index - Program->CellCount;
+            if(Delta->Index < Program->CellCount) Program->Cells[Delta->Index] = Delta->Value;
+            else if(Index < Program->InstructionCount) Recording->JumpCounts[Index] = (int)Delta->Value;
+            else Recording->CallStack[Index - Program->InstructionCount] = (u32)Delta->Value;
+        }
+    }
+    
+    snapshot *Snapshot = Recording->Snapshots + Index;
+    State->ACC = Snapshot->Registers.ACC;
+    State->IX = Snapshot->Registers.IX;
+    State->LastCompareResult = Snapshot->Registers.LastCompareResult;
+    State->CallDepth = Snapshot->Registers.CallDepth;
+    State->Line = Snapshot->Registers.Line;
+    State->Steps = Snapshot->Steps;
+    
+    Recording->NextInput = 0;
+    while(Recording->NextInput < Recording->InputCount &&
+          Recording->Inputs[Recording->NextInput].Steps < Snapshot->Steps) Recording->NextInput++;
+    Recording->NextOutput = 0;
+    while(Recording->NextOutput < Recording->OutputCount &&
+          Recording->Outputs[Recording->NextOutput].Steps < Snapshot->Steps) Recording->NextOutput++;
+    Recording->NextSnapshot = Index + 1;
+}
@@ -0,0 +1,514 @@
+// NOTE(vic): -server keeps programs linked and runs each in a child with the stdin, stdout and
+// stderr the -client sends over a Unix socket
+
+#ifdef __linux__
+#include <signal.h>
+#include <sys/signalfd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+
+#define SERVER_CACHE_SIZE 32
+#define SERVER_MAX_RUNS 64
+#define SERVER_MAX_REQUEST (1 << 20)
+
+typedef struct {
+    u32 ArgCount;
+    u32 Size; // working directory and arguments that follow, each ending in 0
+} server_request;
+
+typedef struct {
+    u64 Key; // flags that change parsing, file names and contents
+    u64 LastUsed; // 0 if the slot is empty
+    memory_arena *Arena; // first block, everything below lives in it
+    source_file *Files;
+    int FileCount;
+    linked_program Program;
+} cached_program;
+
+typedef struct {
+    pid_t Child;
+    int Client; // gets the exit status
+} server_run;
+
+typedef struct {
+    cached_program Cache[SERVER_CACHE_SIZE];
+    u64 Clock;
+    server_run Runs[SERVER_MAX_RUNS];
+    int RunCount;
+    int Listener;
+    int Signals; // SIGCHLD
+    tmp_cstr tc;
+} server;
+
+// NOTE(vic): Somewhere only this user can create the socket, a name in /tmp anyone could take first
+const char *SocketPathOrDefault(const char *SocketPath)
+{
+    static char Default[256];
+    if(SocketPath) return SocketPath;
+    const char *RuntimeDirectory = getenv("XDG_RUNTIME_DIR");
+    if(RuntimeDirectory && RuntimeDirectory[0]) {
+        snprintf(Default, sizeof(Default), "%s/ala.sock", RuntimeDirectory);
+        return Default;
+    }
+    
+    char Directory[64];
+    snprintf(Directory, sizeof(Directory), "/tmp/ala-%u", (unsigned)getuid());
+    struct stat Info;
+    if(mkdir(Directory, 0700) < 0 && errno != EEXIST) {
+        fprintf(stderr, "ERROR: Could not create %s: %s\n", Directory, strerror(errno));
+        return 0;
+    }
+    if(lstat(Directory, &Info) < 0 || !S_ISDIR(Info.st_mode) || Info.st_uid != getuid() || (Info.st_mode & 077)) {
+        fprintf(stderr, "ERROR: %s isn't a directory only you can use, the socket can't go there\n"
+                "NOTE: Choose another socket with '-server=<path>' and '-client=<path>'\n", Directory);
+        return 0;
+    }
+    snprintf(Default, sizeof(Default), "%s/ala.sock", Directory);
+    return Default;
+}
+
+static int MakeSocketAddress(const char *SocketPath, struct sockaddr_un *Address)
+{
+    memset(Address, 0, sizeof(*Address));
+    Address->sun_family = AF_UNIX;
+    if(strlen(SocketPath) >= sizeof(Address->sun_path)) {
+        fprintf(stderr, "ERROR: Socket path %s is too long\n", SocketPath);
+        return 0;
+    }
+    strcpy(Address->sun_path, SocketPath);
+    return 1;
+}
+
+static int WriteAll(int fd, const void *Data, size_t Size)
+{
+    const u8 *At = (const u8 *)Data;
+    while(Size) {
+        ssize_t Written = write(fd, At, Size);
+        if(Written < 0 && errno == EINTR) continue;
+        if(Written <= 0) return 0;
+        At += Written;
+        Size -= (size_t)Written;
+    }
+    return 1;
+}
+
+static int ReadAll(int fd, void *Data, size_t Size)
+{
+    u8 *At = (u8 *)Data;
+    while(Size) {
+        ssize_t Read = read(fd, At, Size);
+        if(Read < 0 && errno == EINTR) continue;
+        if(Read <= 0) return 0;
+        At += Read;
+        Size -= (size_t)Read;
+    }
+    return 1;
+}
+
+int RunClient(const char *SocketPath, int argc, char **args, int ClientArg)
+{
+    SocketPath = SocketPathOrDefault(SocketPath);
+    struct sockaddr_un Address;
+    if(!SocketPath || !MakeSocketAddress(SocketPath, &Address)) {
+        return 1;
+    }
+    
+    int Server = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if(Server < 0 || connect(Server, (struct sockaddr *)&Address, sizeof(Address)) < 0) {
+        fprintf(stderr, "ERROR: Could not connect to the server at %s: %s\n"
+                "NOTE: Start one with '"PROGRAM_NAME" -server'\n", SocketPath, strerror(errno));
+        return 1;
+    }
+    
+    // NOTE(vic): The working directory, arguments and terminal only go to a server this user started
+    struct stat Info;
+    if(lstat(SocketPath, &Info) < 0 || !S_ISSOCK(Info.st_mode) || Info.st_uid != getuid()) {
+        fprintf(stderr, "ERROR: The socket %s doesn't belong to you, not sending anything to it\n", SocketPath);
+        return 1;
+    }
+    
+    char WorkingDirectory[4096];
+    if(!getcwd(WorkingDirectory, sizeof(WorkingDirectory))) {
+        fprintf(stderr, "ERROR: Could not get the working directory: %s\n", strerror(errno));
+        return 1;
+    }
+    
+    // NOTE(vic): The program name and '-client' stay here, the server parses the rest like main does
+    size_t Size = strlen(WorkingDirectory) + 1;
+    for(int i = 1; i < argc; i++) {
+        if(i != ClientArg) Size += strlen(args[i]) + 1;
+    }
+    char *Payload = malloc(Size);
+    char *At = Payload;
+    At += sprintf(At, "%s", WorkingDirectory) + 1;
+    for(int i = 1; i < argc; i++) {
+        if(i != ClientArg) At += sprintf(At, "%s", args[i]) + 1;
+    }
+    
+    server_request Request = { .ArgCount = (u32)(argc - 2), .Size = (u32)Size };
+    int Fds[3] = { STDIN_FILENO, STDOUT_FILENO, STDERR_FILENO };
+    union {
+        struct cmsghdr Header;
+        char Bytes[CMSG_SPACE(sizeof(Fds))];
+    } Control;
+    memset(&Control, 0, sizeof(Control));
+    struct iovec Vector = { .iov_base = &Request, .iov_len = sizeof(Request) };
+    struct msghdr Message = {0};
+    Message.msg_iov = &Vector;
+    Message.msg_iovlen = 1;
+    Message.msg_control = Control.Bytes;
+    Message.msg_controllen = sizeof(Control.Bytes);
+    struct cmsghdr *Rights = CMSG_FIRSTHDR(&Message);
+    Rights->cmsg_level = SOL_SOCKET;
+    Rights->cmsg_type = SCM_RIGHTS;
+    Rights->cmsg_len = CMSG_LEN(sizeof(Fds));
+    memcpy(CMSG_DATA(Rights), Fds, sizeof(Fds));
+    
+    fflush(stdout);
+    s32 Status = 1;
+    if(sendmsg(Server, &Message, 0) != (ssize_t)sizeof(Request) || !WriteAll(Server, Payload, Size) ||
+       !ReadAll(Server, &Status, sizeof(Status)))
+    {
+        fprintf(stderr, "ERROR: The server at %s stopped before the program ended\n", SocketPath);
+        Status = 1;
+    }
+    free(Payload);
+    close(Server);
+    return Status;
+}
+
+static void FreeCachedProgram(cached_program *Cached)
+{
+    if(!Cached->LastUsed) return;
+    for(int i = 0; i < Cached->FileCount; i++) {
+        free((char *)Cached->Files[i].Content.data);
+    }
+    FreeArena(Cached->Arena);
+    memset(Cached, 0, sizeof(*Cached));
+}
+
+// NOTE(vic): Only runs of .ala files are cached, anything else runs in the child as it would without a server
+static int IsCacheable(command_line *CommandLine)
+{
+    if(CommandLine->Flags & (ALA_COMPILE | ALA_OBJECT | ALA_WATCH)) return 0;
+    for(int i = 0; i < CommandLine->FileCount; i++) {
+        String_View Path = sv_from_cstr(CommandLine->Files[i]);
+        if(sv_ends_with(Path, SV(".alb")) || sv_ends_with(Path, SV(".alo")) || sv_ends_with(Path, SV(".alt"))) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+static u64 HashBytes(u64 Hash, const void *Data, size_t Size)
+{
+    const u8 *Bytes = (const u8 *)Data;
+    for(size_t i = 0; i < Size; i++) {
+        Hash = (Hash ^ Bytes[i])*1099511628211ull;
+    }
+    return Hash;
+}
+
+// NOTE(vic): 0 if it can't be cached, *Failed if that's because it had errors
+static cached_program *FindCachedProgram(server *Server, command_line *CommandLine, int *Failed)
+{
+    int FileCount = CommandLine->FileCount;
+    int ParseFlags = CommandLine->Flags & ALA_EXTRA;
+    String_View *Contents = calloc(FileCount, sizeof(String_View));
+    u64 Key = HashBytes(14695981039346656037ull, &ParseFlags, sizeof(ParseFlags));
+    size_t ContentSize = 0;
+    *Failed = 0;
+    for(int i = 0; i < FileCount; i++)
+    {
+        Contents[i] = sv_ReadEntireFile(CommandLine->Files[i]);
+        if(!Contents[i].data) {
+            for(int j = 0; j < i; j++) free((char *)Contents[j].data);
+            free(Contents);
+            return 0;
+        }
+        Key = HashBytes(Key, CommandLine->Files[i], strlen(CommandLine->Files[i]) + 1);
+        Key = HashBytes(Key, &Contents[i].count, sizeof(Contents[i].count));
+        Key = HashBytes(Key, Contents[i].data, Contents[i].count);
+        ContentSize += Contents[i].count;
+    }
+    
+    cached_program *Slot = Server->Cache;
+    for(int i = 0; i < SERVER_CACHE_SIZE; i++)
+    {
+        cached_program *Cached = Server->Cache + i;
+        if(Cached->LastUsed && Cached->Key == Key && Cached->FileCount == FileCount) {
+            for(int j = 0; j < FileCount; j++) free((char *)Contents[j].data);
+            free(Contents);
+            Cached->LastUsed = ++Server->Clock;
+            return Cached;
+        }
+        if(Cached->LastUsed < Slot->LastUsed) Slot = Cached;
+    }
+    
+    // NOTE(vic): Least recently used goes, parsing happens here so the next run can skip it
+    FreeCachedProgram(Slot);
+    Slot->Key = Key;
+    Slot->FileCount = FileCount;
+    Slot->Arena = CreateArena(64*1024 + 16*ContentSize);
+    memory_arena *Arena = Slot->Arena;
+    Slot->Files = PushArray(&Arena, FileCount, source_file);
+    for(int i = 0; i < FileCount; i++)
+    {
+        size_t NameLength = strlen(CommandLine->Files[i]);
+        char *Name = PushArray(&Arena, NameLength + 1, char);
+        memcpy(Name, CommandLine->Files[i], NameLength);
+        Slot->Files[i].Name = sv_from_parts(Name, NameLength);
+        Slot->Files[i].Content = Contents[i];
+    }
+    free(Contents);
+    Slot->LastUsed = ++Server->Clock;
+    
+    int Ok = 1;
+    for(int i = 0; Ok && i < FileCount; i++) {
+        Ok = TryParseSourceFile(&Arena, &Server->tc, Slot->Files + i, i, CommandLine->Flags, stderr);
+    }
+    if(!Ok || !TryLinkProgram(&Arena, Slot->Files, FileCount, &Slot->Program)) {
+        FreeCachedProgram(Slot);
+        *Failed = 1;
+        return 0;
+    }
+    return Slot;
+}
+
+static void SendStatus(int Client, s32 Status)
+{
+    WriteAll(Client, &Status, sizeof(Status));
+    close(Client);
+}
+
+static void FinishRuns(server *Server, int Block)
+{
+    int Status;
+    pid_t Child;
+    while((Child = waitpid(-1, &Status, Block ? 0 : WNOHANG)) > 0)
+    {
+        Block = 0;
+        for(int i = 0; i < Server->RunCount; i++) {
+            if(Server->Runs[i].Child != Child) continue;
+            SendStatus(Server->Runs[i].Client, WIFEXITED(Status) ? WEXITSTATUS(Status) : 128 + WTERMSIG(Status));
+            Server->Runs[i] = Server->Runs[--Server->RunCount];
+            break;
+        }
+    }
+}
+
+static void StartRun(server *Server, int Client, int *Fds, command_line *CommandLine, cached_program *Cached)
+{
+    if(Server->RunCount == SERVER_MAX_RUNS) {
+        FinishRuns(Server, 1);
+    }
+    
+    fflush(stdout);
+    fflush(stderr);
+    pid_t Child = fork();
+    if(Child == 0) {
+        sigset_t Signals;
+        sigemptyset(&Signals);
+        sigaddset(&Signals, SIGCHLD);
+        sigprocmask(SIG_UNBLOCK, &Signals, 0);
+        signal(SIGPIPE, SIG_DFL);
+        close(Server->Listener);
+        close(Server->Signals);
+        close(Client);
+        for(int i = 0; i < 3; i++) {
+            dup2(Fds[i], i);
+            close(Fds[i]);
+        }
+        
+        if(Cached) {
+            // NOTE(vic): Transforming writes to the instructions, the cached copy stays as linked
+            if(IsSet(CommandLine->Flags, ALA_STATS)) {
+                StartStats(CommandLine->StatsPath);
+            }
+            if(IsSet(CommandLine->Flags, ALA_CYCLES)) {
+                StartCycles(CommandLine->CostsPath);
+            }
+            linked_program Program = Cached->Program;
+            TransformProgram(&Program, CommandLine->Flags);
+            RunProgram(&Program, CommandLine->Flags, 0, sv_from_cstr(CommandLine->Files[0]),
+                       CommandLine->TraceSize, CommandLine->InputsPath, CommandLine->SnapshotAt,
+                       CommandLine->ExpectPath);
+            exit(0);
+        }
+        exit(RunCommandLine(CommandLine));
+    }
+    
+    if(Child < 0) {
+        fprintf(stderr, "ERROR: Could not run the program: %s\n", strerror(errno));
+        SendStatus(Client, 1);
+        return;
+    }
+    Server->Runs[Server->RunCount].Child = Child;
+    Server->Runs[Server->RunCount].Client = Client;
+    Server->RunCount++;
+}
+
+static int ReceiveRequest(int Client, server_request *Request, int *Fds)
+{
+    union {
+        struct cmsghdr Header;
+        char Bytes[CMSG_SPACE(3*sizeof(int))];
+    } Control;
+    struct iovec Vector = { .iov_base = Request, .iov_len = sizeof(*Request) };
+    struct msghdr Message = {0};
+    Message.msg_iov = &Vector;
+    Message.msg_iovlen = 1;
+    Message.msg_control = Control.Bytes;
+    Message.msg_controllen = sizeof(Control.Bytes);
+    
+    if(recvmsg(Client, &Message, MSG_CMSG_CLOEXEC) != (ssize_t)sizeof(*Request)) return 0;
+    struct cmsghdr *Rights = CMSG_FIRSTHDR(&Message);
+    if(!Rights || Rights->cmsg_level != SOL_SOCKET || Rights->cmsg_type != SCM_RIGHTS ||
+       Rights->cmsg_len != CMSG_LEN(3*sizeof(int)))
+    {
+        return 0;
+    }
+    memcpy(Fds, CMSG_DATA(Rights), 3*sizeof(int));
+    return 1;
+}
+
+static void HandleRequest(server *Server, int Client)
+{
+    server_request Request;
+    int Fds[3];
+    if(!ReceiveRequest(Client, &Request, Fds)) {
+        close(Client);
+        return;
+    }
+    
+    char *Payload = 0;
+    char **Args = 0;
+    if(Request.Size == 0 || Request.Size > SERVER_MAX_REQUEST || Request.ArgCount > Request.Size) goto invalid;
+    Payload = malloc(Request.Size);
+    if(!ReadAll(Client, Payload, Request.Size) || Payload[Request.Size - 1] != 0) goto invalid;
+    
+    // NOTE(vic): Args[0] stands in for the program name, like in main
+    Args = calloc(Request.ArgCount + 2, sizeof(char *));
+    Args[0] = PROGRAM_NAME;
+    char *At = Payload + strlen(Payload) + 1;
+    for(u32 i = 1; i <= Request.ArgCount; i++) {
+        if(At >= Payload + Request.Size) goto invalid;
+        Args[i] = At;
+        At += strlen(At) + 1;
+    }
+    
+    // NOTE(vic): Diagnostics from here on go to the client, as if it had run everything itself
+    int SavedStderr = dup(STDERR_FILENO);
+    dup2(Fds[2], STDERR_FILENO);
+    
+    command_line CommandLine = {0};
+    cached_program *Cached = 0;
+    int Failed = 0;
+    if(chdir(Payload) < 0) {
+        fprintf(stderr, "ERROR: Could not go to %s: %s\n", Payload, strerror(errno));
+        Failed = 1;
+    }
+    else if(!ParseCommandLine((int)Request.ArgCount + 1, Args, &CommandLine)) {
+        Failed = 1;
+    }
+    else if(IsCacheable(&CommandLine)) {
+        Cached = FindCachedProgram(Server, &CommandLine, &Failed);
+    }
+    
+    if(Failed) {
+        SendStatus(Client, 1);
+    }
+    else {
+        StartRun(Server, Client, Fds, &CommandLine, Cached);
+    }
+    
+    dup2(SavedStderr, STDERR_FILENO);
+    close(SavedStderr);
+    for(int i = 0; i < 3; i++) close(Fds[i]);
+    free(CommandLine.Files);
+    free(Args);
+    free(Payload);
+    return;
+    
+    invalid:
+    for(int i = 0; i < 3; i++) close(Fds[i]);
+    free(Args);
+    free(Payload);
+    close(Client);
+}
+
+void Serve(const char *SocketPath)
+{
+    SocketPath = SocketPathOrDefault(SocketPath);
+    struct sockaddr_un Address;
+    if(!SocketPath || !MakeSocketAddress(SocketPath, &Address)) {
+        exit(1);
+    }
+    
+    server *Server = calloc(1, sizeof(server));
+    Server->tc.Capacity = 1024;
+    Server->tc.Cstr = (char *)malloc(1024);
+    
+    // NOTE(vic): A socket nobody answers on is left over from a server that didn't quit cleanly
+    Server->Listener = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if(Server->Listener >= 0 && connect(Server->Listener, (struct sockaddr *)&Address, sizeof(Address)) == 0) {
+        fprintf(stderr, "ERROR: A server is already listening on %s\n", SocketPath);
+        exit(1);
+    }
+    close(Server->Listener);
+    unlink(SocketPath);
+    
+    Server->Listener = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if(Server->Listener < 0 || bind(Server->Listener, (struct sockaddr *)&Address, sizeof(Address)) < 0 ||
+       chmod(SocketPath, 0600) < 0 || listen(Server->Listener, SOMAXCONN) < 0)
+    {
+        fprintf(stderr, "ERROR: Could not listen on %s: %s\n", SocketPath, strerror(errno));
+        exit(1);
+    }
+    
+    sigset_t Signals;
+    sigemptyset(&Signals);
+    sigaddset(&Signals, SIGCHLD);
+    sigprocmask(SIG_BLOCK, &Signals, 0);
+    Server->Signals = signalfd(-1, &Signals, SFD_CLOEXEC);
+    signal(SIGPIPE, SIG_IGN);
+    
+    fprintf(stderr, "NOTE: Listening on %s, run programs with '"PROGRAM_NAME" -client <file>', "
+            "press Ctrl+C to quit\n", SocketPath);
+    
+    for(;;)
+    {
+        struct pollfd Poll[2] = {
+            { .fd = Server->Listener, .events = POLLIN },
+            { .fd = Server->Signals, .events = POLLIN },
+        };
+        if(poll(Poll, 2, -1) < 0) continue;
+        
+        if(Poll[1].revents & POLLIN) {
+            struct signalfd_siginfo Info;
+            read(Server->Signals, &Info, sizeof(Info));
+            FinishRuns(Server, 0);
+        }
+        if(Poll[0].revents & POLLIN) {
+            int Client = accept(Server->Listener, 0, 0);
+            if(Client >= 0) {
+                fcntl(Client, F_SETFD, FD_CLOEXEC);
+                HandleRequest(Server, Client);
+            }
+        }
+    }
+}
+#else
+int RunClient(const char *SocketPath, int argc, char **args, int ClientArg)
+{
+    fprintf(stderr, "ERROR: '-client' is only supported on linux\n");
+    return 1;
+}
+
+void Serve(const char *SocketPath)
+{
+    fprintf(stderr, "ERROR: '-server' is only supported on linux\n");
+    exit(1);
+}
+#endif
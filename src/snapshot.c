@@ -0,0 +1,102 @@
+// NOTE(vic): -snapshot[=<where>] with -inputs, what runs before the first INP (or <where>) runs
+// once and every input starts from a copy of the machine there
+
+typedef struct {
+    u32 Stop; // instruction to take it at, INVALID_TARGET for only the INPs
+    int Taken;
+    u8 *SavedOpcodes; // while the stops are in the program
+    
+    int ACC;
+    int IX;
+    int LastCompareResult;
+    u32 CallDepth;
+    u32 Line;
+    u64 Steps;
+    u32 *CallStack;
+    long int *Cells;
+    int *JumpCounts;
+    
+    char *Output; // what the program printed before it
+    size_t OutputSize;
+} run_snapshot;
+
+int FindSnapshotStop(linked_program *Program, String_View Where, u32 *Stop)
+{
+    if(Where.count == 0) {
+        *Stop = INVALID_TARGET;
+        return 1;
+    }
+    return ParseBreakLocation(Program, Program->EntryPoint, Where, Stop);
+}
+
+void PlaceSnapshotStops(run_snapshot *Snapshot, linked_program *Program)
+{
+    Snapshot->SavedOpcodes = malloc(Program->InstructionCount + 1);
+    for(u32 i = 0; i < Program->InstructionCount; i++)
+    {
+        instruction *Instruction = Program->Instructions + i;
+        Snapshot->SavedOpcodes[i] = Instruction->Opcode;
+        if(Instruction->Opcode == IOP_INP || i == Snapshot->Stop) {
+            Instruction->Opcode = IOP_SNAPSHOT;
+        }
+    }
+}
+
+void RemoveSnapshotStops(run_snapshot *Snapshot, linked_program *Program)
+{
+    if(!Snapshot->SavedOpcodes) return;
+    for(u32 i = 0; i < Program->InstructionCount; i++) {
+        Program->Instructions[i].Opcode = Snapshot->SavedOpcodes[i];
+    }
+    free(Snapshot->SavedOpcodes);
+    Snapshot->SavedOpcodes = 0;
+}
+
+// NOTE(vic): Called by Evaluate when it reaches an IOP_SNAPSHOT, before the instruction runs
+void TakeSnapshot(run_snapshot *Snapshot, linked_program *Program, machine_state *State, int *JumpCounts)
+{
+    if(Snapshot->Stop != INVALID_TARGET && Program->Instructions[State->Line].Opcode == IOP_SNAPSHOT &&
+       Snapshot->SavedOpcodes[State->Line] == IOP_INP && State->Line != Snapshot->Stop)
+    {
+        fprintf(stderr, "WARNING: The program reads input before the '-snapshot' location, "
+                "the snapshot is taken at the first INP instead\n");
+    }
+    
+    Snapshot->Taken = 1;
+    Snapshot->ACC = State->ACC;
+    Snapshot->IX = State->IX;
+    Snapshot->LastCompareResult = State->LastCompareResult;
+    Snapshot->CallDepth = State->CallDepth;
+    Snapshot->Line = (u32)State->Line;
+    Snapshot->Steps = State->Steps;
+    Snapshot->CallStack = malloc(MAX_CALL_DEPTH*sizeof(u32));
+    memcpy(Snapshot->CallStack, State->CallStack, State->CallDepth*sizeof(u32));
+    Snapshot->Cells = malloc(Program->CellCount*sizeof(long int));
+    memcpy(Snapshot->Cells, Program->Cells, Program->CellCount*sizeof(long int));
+    Snapshot->JumpCounts = malloc((Program->InstructionCount + 1)*sizeof(int));
+    memcpy(Snapshot->JumpCounts, JumpCounts, (Program->InstructionCount + 1)*sizeof(int));
+}
+
+// NOTE(vic): Called by Evaluate before the first instruction of a run that starts from it
+void StartFromSnapshot(run_snapshot *Snapshot, linked_program *Program, machine_state *State, int *JumpCounts)
+{
+    State->ACC = Snapshot->ACC;
+    State->IX = Snapshot->IX;
+    State->LastCompareResult = Snapshot->LastCompareResult;
+    State->CallDepth = Snapshot->CallDepth;
+    State->Line = Snapshot->Line;
+    State->Steps = Snapshot->Steps;
+    memcpy(State->CallStack, Snapshot->CallStack, Snapshot->CallDepth*sizeof(u32));
+    memcpy(Program->Cells, Snapshot->Cells, Program->CellCount*sizeof(long int));
+    memcpy(JumpCounts, Snapshot->JumpCounts, (Program->InstructionCount + 1)*sizeof(int));
+    fwrite(Snapshot->Output, 1, Snapshot->OutputSize, stdout);
+}
+
+void FreeSnapshot(run_snapshot *Snapshot)
+{
+    free(Snapshot->CallStack);
+    free(Snapshot->Cells);
+    free(Snapshot->JumpCounts);
+    free(Snapshot->Output);
+    memset(Snapshot, 0, sizeof(*Snapshot));
+}
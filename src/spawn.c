@@ -0,0 +1,191 @@
+// NOTE(vic): SPAWN, JOIN and CAS (-extra), a hart per OS thread, or with -deterministic all of
+// them on one taking turns of HART_SLICE instructions
+
+#define HART_SLICE 64
+
+typedef struct hart hart;
+
+typedef struct {
+    linked_program *Program;
+    int Flags;
+    int Deterministic;
+    u32 volatile LastId;
+    
+    // NOTE(vic): -deterministic, the harts that haven't ended in the order they take turns
+    hart **Turns;
+    u32 TurnCount;
+    u32 TurnCapacity;
+    u32 Turn; // the one running
+} hart_group;
+
+struct hart {
+    hart_group *Group;
+    u32 Id;
+    hart *Children; // spawned and not joined yet
+    hart *NextSibling;
+    thread Thread;
+    
+    // NOTE(vic): Where it starts, with -deterministic where its last turn stopped
+    machine_state State;
+    u32 *CallStack;
+    int *JumpCounts;
+    int Ended;
+};
+
+evaluator *PickEvaluator(int Flags, run_options *Options);
+
+// NOTE(vic): What -O runs in one go would skip the points where harts take turns
+static int SpawnsHarts(linked_program *Program)
+{
+    for(u32 i = 0; i < Program->InstructionCount; i++) {
+        if(Program->Instructions[i].Opcode == IOP_SPAWN) return 1;
+    }
+    return 0;
+}
+
+static void HartError(linked_program *Program, instruction *I, const char *Flag, int Deterministic)
+{
+    instruction_info *Info = InfoOf(Program, I);
+    fprintf(stderr, "\n"SV_Fmt"(%u): ERROR: SPAWN can't be used with '%s'",
+            SV_Arg(Program->FileNames[Info->FileIndex]), Info->LineInFile, Flag);
+    if(!Deterministic) {
+        fprintf(stderr, "\nNOTE: Every hart runs on its own OS thread, '-deterministic' runs them all on this one");
+    }
+    FailAt(Program, I);
+}
+
+// NOTE(vic): The first SPAWN of a run makes the hart that was running until then (the first one)
+hart *StartHarts(linked_program *Program, int Flags, run_options *Options, instruction *I, int Deterministic)
+{
+    if(Options->Recording) HartError(Program, I, IsSet(Flags, ALA_REPLAY) ? "-replay" : "-record", 1);
+    if(Options->Snapshot) HartError(Program, I, "-snapshot", 1);
+    if(!Deterministic) {
+        if(IsSet(Flags, ALA_DEBUG)) HartError(Program, I, "-debug", 0);
+        if(Options->Trace) HartError(Program, I, "-trace", 0);
+        if(Options->Cycles) HartError(Program, I, "-cycles", 0);
+        else if(Options->Stats) HartError(Program, I, "-stats", 0);
+        if(Options->Expect) HartError(Program, I, "-expect", 0);
+        if(Options->Coverage) HartError(Program, I, "-coverage", 0);
+        if(Options->Profile) HartError(Program, I, "-profile", 0);
+    }
+    
+    hart_group *Group = calloc(1, sizeof(hart_group));
+    Group->Program = Program;
+    Group->Flags = Flags;
+    Group->Deterministic = Deterministic;
+    hart *Hart = calloc(1, sizeof(hart));
+    Hart->Group = Group;
+    if(Deterministic) {
+        Group->TurnCapacity = 8;
+        Group->Turns = malloc(Group->TurnCapacity*sizeof(hart *));
+        Group->Turns[Group->TurnCount++] = Hart;
+        Hart->CallStack = malloc(MAX_CALL_DEPTH*sizeof(u32));
+    }
+    return Hart;
+}
+
+static void *RunHart(void *Data)
+{
+    hart *Hart = (hart *)Data;
+    run_options Options = { .Hart = Hart };
+    PickEvaluator(Hart->Group->Flags, &Options)(Hart->Group->Program, Hart->Group->Flags, &Options);
+    return 0;
+}
+
+// NOTE(vic): Returns the number of the new hart
+u32 SpawnHart(hart *Hart, instruction *I, int ACC, int IX)
+{
+    hart_group *Group = Hart->Group;
+    hart *Child = calloc(1, sizeof(hart));
+    Child->Group = Group;
+    Child->Id = AtomicIncrement(&Group->LastId);
+    Child->State.ACC = ACC;
+    Child->State.IX = IX;
+    Child->State.Line = I->Target;
+    Child->NextSibling = Hart->Children;
+    Hart->Children = Child;
+    
+    if(!Group->Deterministic) {
+        Child->Thread = StartThread(RunHart, Child);
+        return Child->Id;
+    }
+    
+    Child->CallStack = malloc(MAX_CALL_DEPTH*sizeof(u32));
+    Child->JumpCounts = calloc(Group->Program->InstructionCount + 1, sizeof(int));
+    if(Group->TurnCount == Group->TurnCapacity) {
+        Group->TurnCapacity *= 2;
+        Group->Turns = realloc(Group->Turns, Group->TurnCapacity*sizeof(hart *));
+    }
+    Group->Turns[Group->TurnCount++] = Child;
+    return Child->Id;
+}
+
+// NOTE(vic): Returns 0 if some are still running (-deterministic), it has to try again on its next turn
+int JoinHarts(hart *Hart)
+{
+    if(Hart->Group->Deterministic) {
+        for(hart *Child = Hart->Children; Child; Child = Child->NextSibling) {
+            if(!Child->Ended) return 0;
+        }
+    }
+    while(Hart->Children)
+    {
+        hart *Child = Hart->Children;
+        if(!Hart->Group->Deterministic) JoinThread(Child->Thread);
+        Hart->Children = Child->NextSibling;
+        free(Child);
+    }
+    return 1;
+}
+
+// NOTE(vic): Everything but the steps, the calls go to Evaluate's one call stack
+static hart *TakeTurn(hart_group *Group, machine_state *State, int **JumpCounts)
+{
+    hart *Next = Group->Turns[Group->Turn];
+    u32 *CallStack = State->CallStack;
+    u64 Steps = State->Steps;
+    *State = Next->State;
+    State->CallStack = CallStack;
+    State->Steps = Steps;
+    memcpy(CallStack, Next->CallStack, State->CallDepth*sizeof(u32));
+    *JumpCounts = Next->JumpCounts;
+    return Next;
+}
+
+// NOTE(vic): -deterministic, the end of Hart's turn, State goes on with the next one
+hart *SwitchHart(hart *Hart, machine_state *State, int **JumpCounts)
+{
+    hart_group *Group = Hart->Group;
+    Hart->State = *State;
+    memcpy(Hart->CallStack, State->CallStack, State->CallDepth*sizeof(u32));
+    Hart->JumpCounts = *JumpCounts;
+    Group->Turn = (Group->Turn + 1) % Group->TurnCount;
+    return TakeTurn(Group, State, JumpCounts);
+}
+
+// NOTE(vic): After END, returns the hart that goes on with -deterministic or 0
+hart *EndHart(hart *Hart, machine_state *State, int **JumpCounts)
+{
+    hart_group *Group = Hart->Group;
+    if(!JoinHarts(Hart)) {
+        return SwitchHart(Hart, State, JumpCounts);
+    }
+    if(Hart->Id != 0) {
+        if(!Group->Deterministic) return 0;
+        
+        Hart->Ended = 1;
+        free(Hart->CallStack);
+        free(*JumpCounts);
+        Group->TurnCount--;
+        memmove(Group->Turns + Group->Turn, Group->Turns + Group->Turn + 1,
+                (Group->TurnCount - Group->Turn)*sizeof(hart *));
+        Group->Turn %= Group->TurnCount;
+        return TakeTurn(Group, State, JumpCounts);
+    }
+    
+    free(Hart->CallStack);
+    free(Group->Turns);
+    free(Group);
+    free(Hart);
+    return 0;
+}
@@ -0,0 +1,163 @@
+// NOTE(vic): -stats[=<file>], written at exit. Only the lines control jumps to are counted while
+// it runs, every line then ran as often as it was jumped to plus what fell through to it.
+
+#define MAX_STATS_BLOCKS 64
+
+typedef struct {
+    const char *Path; // 0 for stderr
+    
+    double LoadSeconds; // reading the files, .alo objects and .alb images
+    double ParseSeconds;
+    double ResolveSeconds;
+    double LinkSeconds;
+    double TransformSeconds;
+    double EvaluateSeconds;
+    double EvaluateStarted; // while Evaluate runs, 0 otherwise
+    
+    u64 OpcodeCounts[IOP_SNAPSHOT + 1];
+    u64 *BlockCounts; // while Evaluate runs, one per instruction and one past the end
+    instruction *Instructions;
+    u32 InstructionCount;
+    u32 FailedAt; // the instruction the run failed at, InstructionCount if it didn't
+    u64 SkippedSteps; // run in one go by -O in IOP_IDIOM, counted as if they had run
+    u64 Jumps; // taken, CALLs and RETURNs too
+    
+    // NOTE(vic): The arena stops growing after linking, its blocks are copied here then
+    u32 BlockCount;
+    size_t BlockUsed[MAX_STATS_BLOCKS];
+    size_t BlockSize[MAX_STATS_BLOCKS];
+} run_stats;
+
+static run_stats RunStats;
+
+static const char *StatsOpcodeNames[IOP_SNAPSHOT + 1] = {
+    [IOP_ACCINC] = "INC_ACC",
+    [IOP_ACCDEC] = "DEC_ACC",
+    [IOP_IXINC] = "INC_IX",
+    [IOP_IXDEC] = "DEC_IX",
+    [IOP_BREAK] = "break",
+    [IOP_IDIOM] = "idiom",
+    [IOP_MEMO_CALL] = "memo_call",
+    [IOP_MEMO_RETURN] = "memo_return",
+    [IOP_SNAPSHOT] = "snapshot",
+};
+
+void RecordArenaStats(memory_arena *Arena)
+{
+    RunStats.BlockCount = 0;
+    for(; Arena && RunStats.BlockCount < MAX_STATS_BLOCKS; Arena = Arena->Next)
+    {
+        RunStats.BlockUsed[RunStats.BlockCount] = Arena->Used;
+        RunStats.BlockSize[RunStats.BlockCount] = Arena->Size;
+        RunStats.BlockCount++;
+    }
+}
+
+void BeginStatsRun(run_stats *Stats, linked_program *Program)
+{
+    Stats->BlockCounts = calloc(Program->InstructionCount + 1, sizeof(u64));
+    Stats->Instructions = Program->Instructions;
+    Stats->InstructionCount = Program->InstructionCount;
+    Stats->FailedAt = Program->InstructionCount;
+    Stats->EvaluateStarted = GetSeconds();
+}
+
+// NOTE(vic): Called by FailAt, the run didn't fall through from Index to the ones after it
+void StopStatsAt(u32 Index)
+{
+    run_stats *Stats = &RunStats;
+    if(Stats->BlockCounts && Index < Stats->InstructionCount) Stats->FailedAt = Index;
+}
+
+static int FallsThrough(int Opcode)
+{
+    switch(Opcode)
+    {
+        case IOP_JMP: case IOP_JPE: case IOP_JPN: case IOP_JPG: case IOP_JPL: case IOP_END:
+        case IOP_CALL: case IOP_RETURN: case IOP_MEMO_CALL: case IOP_MEMO_RETURN: return 0;
+        default: return 1;
+    }
+}
+
+void AddCycles(u32 Index, u64 Count); // cycles.c
+
+void EndStatsRun(run_stats *Stats)
+{
+    Stats->EvaluateSeconds += GetSeconds() - Stats->EvaluateStarted;
+    Stats->EvaluateStarted = 0;
+    
+    u64 Count = 0;
+    for(u32 i = 0; i < Stats->InstructionCount; i++)
+    {
+        int Opcode = Stats->Instructions[i].Opcode;
+        if(i > 0 && i - 1 == Stats->FailedAt && Count > 0) Count--;
+        Count = (i > 0 && FallsThrough(Stats->Instructions[i - 1].Opcode) ? Count : 0) + Stats->BlockCounts[i];
+        Stats->OpcodeCounts[Opcode] += Count;
+        AddCycles(i, Count);
+    }
+    free(Stats->BlockCounts);
+    Stats->BlockCounts = 0;
+}
+
+static void WriteStats(void)
+{
+    run_stats *Stats = &RunStats;
+    if(!ReportsAtExit) return;
+    if(Stats->EvaluateStarted != 0) {
+        // NOTE(vic): It failed
+        EndStatsRun(Stats);
+    }
+    
+    fflush(stdout);
+    FILE *Out = Stats->Path ? fopen(Stats->Path, "w") : stderr;
+    if(!Out) {
+        fprintf(stderr, "ERROR: Could not write %s: %s\n", Stats->Path, strerror(errno));
+        return;
+    }
+    
+    if(Out == stderr) {
+        // NOTE(vic): Errors don't end their line
+        fprintf(Out, "\n");
+    }
+    
+    u64 Instructions = 0;
+    for(int i = 0; i <= IOP_SNAPSHOT; i++) Instructions += Stats->OpcodeCounts[i];
+    
+    fprintf(Out, "load_seconds %.6f\n", Stats->LoadSeconds);
+    fprintf(Out, "parse_seconds %.6f\n", Stats->ParseSeconds);
+    fprintf(Out, "resolve_seconds %.6f\n", Stats->ResolveSeconds);
+    fprintf(Out, "link_seconds %.6f\n", Stats->LinkSeconds);
+    fprintf(Out, "transform_seconds %.6f\n", Stats->TransformSeconds);
+    fprintf(Out, "evaluate_seconds %.6f\n", Stats->EvaluateSeconds);
+    fprintf(Out, "instructions %llu\n", (unsigned long long)Instructions);
+    fprintf(Out, "instructions_run_in_one_go %llu\n", (unsigned long long)Stats->SkippedSteps);
+    fprintf(Out, "instructions_per_second %.0f\n",
+            Stats->EvaluateSeconds > 0 ? (Instructions - Stats->SkippedSteps)/Stats->EvaluateSeconds : 0.0);
+    fprintf(Out, "jumps_taken %llu\n", (unsigned long long)Stats->Jumps);
+    for(int i = 0; i <= IOP_SNAPSHOT; i++)
+    {
+        if(!Stats->OpcodeCounts[i]) continue;
+        if(StatsOpcodeNames[i]) {
+            fprintf(Out, "opcode_%s %llu\n", StatsOpcodeNames[i], (unsigned long long)Stats->OpcodeCounts[i]);
+        }
+        else {
+            fprintf(Out, "opcode_"SV_Fmt" %llu\n", SV_Arg(InstructionList[i]), (unsigned long long)Stats->OpcodeCounts[i]);
+        }
+    }
+    for(u32 i = 0; i < Stats->BlockCount; i++)
+    {
+        fprintf(Out, "arena_block_%u_used %zu\n", i, Stats->BlockUsed[i]);
+        fprintf(Out, "arena_block_%u_size %zu\n", i, Stats->BlockSize[i]);
+    }
+    fprintf(Out, "peak_memory_bytes %zu\n", GetPeakMemory());
+    
+    if(Out != stderr) {
+        fclose(Out);
+    }
+}
+
+void StartStats(const char *Path)
+{
+    RunStats.Path = Path;
+    atexit(WriteStats);
+}
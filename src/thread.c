@@ -0,0 +1,107 @@
+// NOTE(vic): Threads, atomics, a clock and the peak memory, for windows and linux
+
+#ifdef _WIN32
+#define thread_local __declspec(thread)
+
+typedef HANDLE thread;
+typedef DWORD (WINAPI *thread_proc_)(void *);
+
+thread StartThread(void *(*Proc)(void *), void *Data)
+{
+    // NOTE(vic): The return value is ignored, only the signature changes
+    return CreateThread(NULL, 0, (thread_proc_)(void *)Proc, Data, 0, NULL);
+}
+
+void JoinThread(thread Thread)
+{
+    WaitForSingleObject(Thread, INFINITE);
+    CloseHandle(Thread);
+}
+
+// NOTE(vic): Returns what *Value held, New is only stored if that was Expected
+long int AtomicCompareSwap(long int volatile *Value, long int Expected, long int New)
+{
+    return InterlockedCompareExchange(Value, New, Expected);
+}
+
+u32 AtomicIncrement(u32 volatile *Value)
+{
+    return (u32)InterlockedIncrement((LONG volatile *)Value);
+}
+
+int GetProcessorCount(void)
+{
+    SYSTEM_INFO Info;
+    GetSystemInfo(&Info);
+    return (int)Info.dwNumberOfProcessors;
+}
+
+double GetSeconds(void)
+{
+    LARGE_INTEGER Frequency, Counter;
+    QueryPerformanceFrequency(&Frequency);
+    QueryPerformanceCounter(&Counter);
+    return (double)Counter.QuadPart/(double)Frequency.QuadPart;
+}
+
+#include <psapi.h>
+size_t GetPeakMemory(void)
+{
+    PROCESS_MEMORY_COUNTERS Counters;
+    if(!K32GetProcessMemoryInfo(GetCurrentProcess(), &Counters, sizeof(Counters))) return 0;
+    return Counters.PeakWorkingSetSize;
+}
+#else
+#include <pthread.h>
+#include <time.h>
+#include <sys/resource.h>
+#define thread_local _Thread_local
+
+typedef pthread_t thread;
+
+thread StartThread(void *(*Proc)(void *), void *Data)
+{
+    pthread_t Thread;
+    if(pthread_create(&Thread, NULL, Proc, Data) != 0) {
+        fprintf(stderr, "ERROR: Could not start a thread: %s\n", strerror(errno));
+        exit(1);
+    }
+    return Thread;
+}
+
+void JoinThread(thread Thread)
+{
+    pthread_join(Thread, NULL);
+}
+
+long int AtomicCompareSwap(long int volatile *Value, long int Expected, long int New)
+{
+    __atomic_compare_exchange_n(Value, &Expected, New, 0, __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST);
+    return Expected;
+}
+
+u32 AtomicIncrement(u32 volatile *Value)
+{
+    return __atomic_add_fetch(Value, 1, __ATOMIC_SEQ_CST);
+}
+
+int GetProcessorCount(void)
+{
+    long Count = sysconf(_SC_NPROCESSORS_ONLN);
+    return Count > 0 ? (int)Count : 1;
+}
+
+double GetSeconds(void)
+{
+    struct timespec Now;
+    clock_gettime(CLOCK_MONOTONIC, &Now);
+    return (double)Now.tv_sec + (double)Now.tv_nsec*1e-9;
+}
+
+size_t GetPeakMemory(void)
+{
+    struct rusage Usage;
+    if(getrusage(RUSAGE_SELF, &Usage) != 0) return 0;
+    return (size_t)Usage.ru_maxrss*1024; // NOTE(vic): In kilobytes on linux
+}
+#endif
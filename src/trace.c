@@ -0,0 +1,178 @@
+// NOTE(vic): -trace[=N], a ring (a power of two, at least N) of the instructions run and how
+// ACC and IX changed, the last N go to first.alt
+
+#define ALA_TRACE_MAGIC 0x544C4123 // "#ALT"
+#define ALA_TRACE_VERSION 1
+#define DEFAULT_TRACE_SIZE (1 << 16)
+
+typedef struct {
+    u32 Magic;
+    u32 Version;
+    u32 ProgramHash;
+    u32 Capacity;
+    u64 Count; // entries ever written, the file has the last min(Count, Capacity)
+    int ACC; // before the last entry ran
+    int IX;
+    u32 Ended; // reached the end, otherwise an error stopped the program
+    u32 Reserved;
+} trace_header;
+
+typedef struct {
+    u32 Instruction;
+    s32 ACCDelta;
+    s32 IXDelta;
+} trace_entry;
+
+typedef struct {
+    const char *Path;
+    u32 ProgramHash;
+    trace_entry *Entries;
+    u32 Mask;
+    u32 Size; // N, the ring can hold more
+    u64 Count;
+    int LastACC;
+    int LastIX;
+} trace;
+
+// NOTE(vic): The one being written, so the atexit handler can find it
+trace *RunningTrace;
+
+trace *StartTrace(const char *Path, linked_program *Program, u32 Size)
+{
+    u32 Capacity = 1;
+    while(Capacity < Size) Capacity <<= 1;
+    
+    trace *Trace = calloc(1, sizeof(trace));
+    Trace->Path = Path;
+    // NOTE(vic): Before the program runs, it changes the cells (and -debug the opcodes)
+    Trace->ProgramHash = HashProgram(Program);
+    Trace->Entries = calloc(Capacity, sizeof(trace_entry));
+    Trace->Mask = Capacity - 1;
+    Trace->Size = Size;
+    return Trace;
+}
+
+#define TraceInstruction(Trace, Index, ACC, IX) { \
+trace_entry *Entry_ = (Trace)->Entries + ((Trace)->Count++ & (Trace)->Mask); \
+Entry_->Instruction = (u32)(Index); \
+Entry_->ACCDelta = (s32)((u32)(ACC) - (u32)(Trace)->LastACC); \
+Entry_->IXDelta = (s32)((u32)(IX) - (u32)(Trace)->LastIX); \
+(Trace)->LastACC = (ACC); \
+(Trace)->LastIX = (IX); \
+}
+
+void WriteTrace(trace *Trace, int Ended)
+{
+    trace_header Header = {
+        .Magic = ALA_TRACE_MAGIC,
+        .Version = ALA_TRACE_VERSION,
+        .ProgramHash = Trace->ProgramHash,
+        .Capacity = Trace->Size,
+        .Count = Trace->Count,
+        .ACC = Trace->LastACC,
+        .IX = Trace->LastIX,
+        .Ended = (u32)Ended,
+    };
+    
+    // NOTE(vic): Oldest entry first
+    u64 Stored = Trace->Count < Header.Capacity ? Trace->Count : Header.Capacity;
+    u64 First = Trace->Count - Stored;
+    FILE *f = fopen(Trace->Path, "wb");
+    int Ok = f && fwrite(&Header, sizeof(Header), 1, f) == 1;
+    for(u64 i = First; Ok && i < Trace->Count; i++) {
+        Ok = fwrite(Trace->Entries + (i & Trace->Mask), sizeof(trace_entry), 1, f) == 1;
+    }
+    if(!f || fclose(f) != 0 || !Ok) {
+        fprintf(stderr, "ERROR: Could not write %s: %s\n", Trace->Path, strerror(errno));
+    }
+}
+
+void WriteTraceAtExit(void)
+{
+    if(RunningTrace) {
+        WriteTrace(RunningTrace, 0);
+        fprintf(stderr, "\nNOTE: The last instructions run are in %s\n", RunningTrace->Path);
+        RunningTrace = 0;
+    }
+}
+
+// NOTE(vic): Called by Evaluate before the first instruction
+void BeginTrace(trace *Trace)
+{
+    RunningTrace = Trace;
+    static int Registered;
+    if(!Registered) {
+        atexit(WriteTraceAtExit);
+        Registered = 1;
+    }
+}
+
+void EndTrace(trace *Trace)
+{
+    RunningTrace = 0;
+    WriteTrace(Trace, 1);
+}
+
+// NOTE(vic): Oldest first, the registers are rebuilt backwards from the ones in the header
+int DecodeTrace(const char *Path, linked_program *Program)
+{
+    String_View Content = sv_ReadEntireFile(Path);
+    if(!Content.data) {
+        fprintf(stderr, "ERROR: Could not read file %s: %s\n", Path, strerror(errno));
+        return 0;
+    }
+    
+    trace_header *Header = (trace_header *)Content.data;
+    if(Content.count < sizeof(trace_header) || Header->Magic != ALA_TRACE_MAGIC ||
+       Header->Version != ALA_TRACE_VERSION)
+    {
+        fprintf(stderr, "ERROR: %s is not a trace this version of ALA can read\n", Path);
+        return 0;
+    }
+    if(Header->ProgramHash != HashProgram(Program)) {
+        fprintf(stderr, "ERROR: %s was traced with a different program\n", Path);
+        return 0;
+    }
+    
+    trace_entry *Entries = (trace_entry *)(Header + 1);
+    u64 Stored = (Content.count - sizeof(trace_header))/sizeof(trace_entry);
+    u64 FirstStep = Header->Count - Stored;
+    for(u64 i = 0; i < Stored; i++) {
+        if(Entries[i].Instruction >= Program->InstructionCount) {
+            fprintf(stderr, "ERROR: %s is corrupted\n", Path);
+            return 0;
+        }
+    }
+    
+    int *ACC = malloc((Stored + 1)*sizeof(int));
+    int *IX = malloc((Stored + 1)*sizeof(int));
+    if(Stored) {
+        ACC[Stored - 1] = Header->ACC;
+        IX[Stored - 1] = Header->IX;
+    }
+    for(u64 i = Stored - 1; i > 0 && i < Stored; i--) {
+        ACC[i - 1] = (int)((u32)ACC[i] - (u32)Entries[i].ACCDelta);
+        IX[i - 1] = (int)((u32)IX[i] - (u32)Entries[i].IXDelta);
+    }
+    
+    printf("%llu instructions run, the last %llu:\n", (unsigned long long)Header->Count,
+           (unsigned long long)Stored);
+    for(u64 i = 0; i < Stored; i++) {
+        instruction_info *Info = Program->InstructionInfo + Entries[i].Instruction;
+        String_View Text = SV_NULL;
+        if(Program->Lines) {
+            Text = sv_trim(Program->Lines[Program->Files[Info->FileIndex].FirstCell + Info->LineInFile]);
+        }
+        printf("%llu: "SV_Fmt"(%u): "SV_Fmt" [ACC = %d, IX = %d]\n", (unsigned long long)(FirstStep + i),
+               SV_Arg(Program->FileNames[Info->FileIndex]), Info->LineInFile, SV_Arg(Text),
+               ACC[i], IX[i]);
+    }
+    if(!Header->Ended && Stored) {
+        printf("The program stopped with an error (or was quit) in the last instruction\n");
+    }
+    
+    free(ACC);
+    free(IX);
+    free((char *)Content.data);
+    return 1;
+}
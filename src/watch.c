@@ -0,0 +1,175 @@
+// NOTE(vic): -watch, only the files that change are parsed again, then everything is relinked
+
+#ifdef __linux__
+#include <poll.h>
+#include <sys/inotify.h>
+#include <sys/wait.h>
+
+typedef struct {
+    int WatchDescriptor;
+    String_View BaseName;
+    int Dirty;
+    int Broken; // last parse failed, can't link until it is fixed
+    memory_arena *Arena; // the last parse, freed when the file is parsed again
+} watched_file;
+
+int TryLinkProgram(memory_arena **Arena, source_file *Files, int FileCount, linked_program *Program)
+{
+    jmp_buf Recover;
+    if(setjmp(Recover)) {
+        RecoverPoint = 0;
+        return 0;
+    }
+    RecoverPoint = &Recover;
+    int StartFileIndex = ResolveSymbols(Arena, Files, FileCount);
+    LinkProgram(Arena, Files, FileCount, StartFileIndex, Program);
+    RecoverPoint = 0;
+    return 1;
+}
+
+// NOTE(vic): In a child, so an error doesn't end the watch and the cells stay as linked
+void RunWatchedProgram(linked_program *Program, int Flags)
+{
+    fflush(stdout);
+    fflush(stderr);
+    pid_t Child = fork();
+    if(Child == 0) {
+        run_options Options = {0};
+        TransformProgram(Program, Flags);
+        Evaluate(Program, Flags, &Options);
+        fflush(stdout);
+        _exit(0);
+    }
+    
+    int Status = 0;
+    if(Child < 0 || waitpid(Child, &Status, 0) < 0) {
+        fprintf(stderr, "ERROR: Could not run the program: %s\n", strerror(errno));
+        return;
+    }
+    fflush(stdout);
+    fprintf(stderr, "\nNOTE: Program exited with status %d, waiting for changes\n",
+            WIFEXITED(Status) ? WEXITSTATUS(Status) : -1);
+}
+
+int TryParseWatchedFile(watched_file *Watched, tmp_cstr *tc, source_file *File, int FileIndex, int Flags)
+{
+    FreeArena(Watched->Arena);
+    Watched->Arena = CreateArena(64*1024 + 16*File->Content.count);
+    memory_arena *Arena = Watched->Arena;
+    return TryParseSourceFile(&Arena, tc, File, FileIndex, Flags, stderr);
+}
+
+void MarkChangedFiles(int Notify, watched_file *Watched, int FileCount)
+{
+    union {
+        struct inotify_event Event;
+        char Bytes[4096];
+    } Buffer;
+    
+    ssize_t Size = read(Notify, &Buffer, sizeof(Buffer));
+    for(ssize_t At = 0; At < Size;)
+    {
+        struct inotify_event *Event = (struct inotify_event *)(Buffer.Bytes + At);
+        String_View Name = sv_from_cstr(Event->len ? Event->name : "");
+        for(int i = 0; i < FileCount; i++) {
+            if(Watched[i].WatchDescriptor == Event->wd && sv_eq(Watched[i].BaseName, Name)) {
+                Watched[i].Dirty = 1;
+            }
+        }
+        At += sizeof(struct inotify_event) + Event->len;
+    }
+}
+
+void Watch(memory_arena **Arena, tmp_cstr *tc, source_file *Files, int FileCount, int Flags)
+{
+    int Notify = inotify_init1(IN_CLOEXEC);
+    if(Notify < 0) {
+        fprintf(stderr, "ERROR: Could not start watching files: %s\n", strerror(errno));
+        exit(1);
+    }
+    
+    // NOTE(vic): Watch the directories, editors usually replace the file instead of writing to it
+    watched_file *Watched = PushArray(Arena, FileCount, watched_file);
+    for(int i = 0; i < FileCount; i++)
+    {
+        // NOTE(vic): Objects are already parsed, there's nothing to watch
+        if(Files[i].IsObject) {
+            Watched[i].WatchDescriptor = -1;
+            continue;
+        }
+        
+        String_View Path = Files[i].Name;
+        size_t LastSlash = Path.count;
+        while(LastSlash > 0 && Path.data[LastSlash - 1] != '/') LastSlash--;
+        String_View Directory = LastSlash ? sv_from_parts(Path.data, LastSlash) : SV(".");
+        Watched[i].BaseName = sv_from_parts(Path.data + LastSlash, Path.count - LastSlash);
+        
+        char *DirectoryCstr = TmpCstrFill(tc, Directory.data, Directory.count);
+        Watched[i].WatchDescriptor = inotify_add_watch(Notify, DirectoryCstr,
+                                                       IN_CLOSE_WRITE | IN_MOVED_TO);
+        if(Watched[i].WatchDescriptor < 0) {
+            fprintf(stderr, "ERROR: Could not watch "SV_Fmt": %s\n", SV_Arg(Path), strerror(errno));
+            exit(1);
+        }
+        
+        Watched[i].Broken = !TryParseWatchedFile(Watched + i, tc, Files + i, i, Flags);
+    }
+    
+    fprintf(stderr, "NOTE: Watching %d file%s for changes, press Ctrl+C to quit\n",
+            FileCount, FileCount == 1 ? "" : "s");
+    
+    for(;;)
+    {
+        int AnyBroken = 0;
+        for(int i = 0; i < FileCount; i++) AnyBroken |= Watched[i].Broken;
+        
+        // NOTE(vic): ResolveSymbols sets every definition again, nothing of a link outlives its run
+        memory_arena *LinkArena = CreateArena(1024*1024);
+        memory_arena *Link = LinkArena;
+        linked_program Program = {0};
+        if(!AnyBroken && TryLinkProgram(&Link, Files, FileCount, &Program)) {
+            RunWatchedProgram(&Program, Flags);
+        }
+        FreeArena(LinkArena);
+        
+        // NOTE(vic): Wait for a change, then give the editor a moment to finish writing
+        int AnyDirty = 0;
+        while(!AnyDirty)
+        {
+            MarkChangedFiles(Notify, Watched, FileCount);
+            struct pollfd Poll = { .fd = Notify, .events = POLLIN };
+            while(poll(&Poll, 1, 50) > 0) {
+                MarkChangedFiles(Notify, Watched, FileCount);
+            }
+            for(int i = 0; i < FileCount; i++) AnyDirty |= Watched[i].Dirty;
+        }
+        
+        for(int i = 0; i < FileCount; i++)
+        {
+            if(!Watched[i].Dirty) continue;
+            
+            source_file *File = Files + i;
+            char *Path = TmpCstrFill(tc, File->Name.data, File->Name.count);
+            String_View Content = sv_ReadEntireFile(Path);
+            if(!Content.data) {
+                // NOTE(vic): Probably in the middle of being replaced, wait for the next event
+                fprintf(stderr, "ERROR: Could not read file "SV_Fmt": %s\n", SV_Arg(File->Name), strerror(errno));
+                Watched[i].Broken = 1;
+                continue;
+            }
+            
+            free((char *)File->Content.data);
+            File->Content = Content;
+            Watched[i].Dirty = 0;
+            fprintf(stderr, "NOTE: "SV_Fmt" changed\n", SV_Arg(File->Name));
+            Watched[i].Broken = !TryParseWatchedFile(Watched + i, tc, File, i, Flags);
+        }
+    }
+}
+#else
+void Watch(memory_arena **Arena, tmp_cstr *tc, source_file *Files, int FileCount, int Flags)
+{
+    fprintf(stderr, "ERROR: '-watch' is only supported on linux\n");
+    exit(1);
+}
+#endif